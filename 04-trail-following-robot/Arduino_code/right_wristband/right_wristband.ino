@@ -22,6 +22,9 @@ const int motor_pins[] = {D5, D2, D1};   //motor connect signal pin
 const int NUM_MOTORS = sizeof(motor_pins)/sizeof(motor_pins[0]);
 const int motor_interval[] = {500, 250, 125, 100, 50};  //vibrate cycle T/2
 const int pwm_min = 500;
+// obs_detect sends only changes plus a heartbeat every second, without either the motors stop
+const unsigned long cmd_timeout = 5000;   // [ms]
+unsigned long last_cmd = 0;
 
 void vibration_cb(const haptic_msgs::Wristband &msg);
 
@@ -42,6 +45,7 @@ void vibration_cb(const haptic_msgs::Wristband &msg) {
         vb_msg.motors[i].intensity = msg.right.motors[i].intensity;
         vb_msg.motors[i].frequency = msg.right.motors[i].frequency;
     }
+    last_cmd = millis();
     Serial.println("Get motors cmd.");
 }
 
@@ -102,6 +106,8 @@ int intensity2pwm (int intensity_level) {
 
 void outIO() {
     for(int i = 0; i < NUM_MOTORS; i++) {
+        if (vb_msg.motors[i].frequency <= 0)
+            continue;
         analogWrite(motor_pins[i], pwm[i]);
         delay(motor_interval[vb_msg.motors[i].frequency-1]);
         analogWrite(motor_pins[i], 0);
@@ -129,6 +135,12 @@ void printOut() {
 
 void loop() {
     if (nh.connected()) {
+        if (millis() - last_cmd > cmd_timeout) {
+            for(int i = 0; i < NUM_MOTORS; i++) {
+                vb_msg.motors[i].intensity = 0;
+                vb_msg.motors[i].frequency = 0;
+            }
+        }
         for(int i = 0; i < NUM_MOTORS; i++)
             pwm[i] = intensity2pwm(vb_msg.motors[i].intensity);
         outIO();
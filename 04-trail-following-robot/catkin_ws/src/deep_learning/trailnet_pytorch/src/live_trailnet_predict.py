@@ -74,7 +74,12 @@ class TrailnetNode(object):
         self.old_btn_state = 0
 
         # ROS subscriber
-        self.sub_image = rospy.Subscriber('image_raw', Image, self.image_cb)
+        USE_IMAGE_TENSOR = rospy.get_param('~use_image_tensor', True)
+        if USE_IMAGE_TENSOR:
+            # already resized and normalized by video_stream_opencv
+            self.sub_image = rospy.Subscriber('image_tensor', Image, self.tensor_cb, queue_size=1)
+        else:
+            self.sub_image = rospy.Subscriber('image_raw', Image, self.image_cb)
         self.sub_joy = rospy.Subscriber('joy', Joy, self.joy_cb)
         self.pub_nav = rospy.Publisher('cmd_vel', Twist, queue_size=1)
 
@@ -84,6 +89,7 @@ class TrailnetNode(object):
         USE_CUDA = rospy.get_param('~use_cuda', True)
         CLASS_URL = 'https://drive.google.com/uc?id=1QrUIUSQSCSagcMgV_1RnQjQKqRhuaBFf'
         INPUT_IMG_SIZE = (101, 101)
+        self.input_size = INPUT_IMG_SIZE
 
         
         # Check the model folder is existing
@@ -152,24 +158,40 @@ class TrailnetNode(object):
             except CvBridgeError as e:
                 print(e)
 
-            with torch.no_grad():
-                input_image = self.data_transform(cv_image).unsqueeze(0)
-                output_idx = np.argmax(self.model(input_image.cuda()).cpu())
-                prediction = self.CLASSES[output_idx]
-                
-                # Car command 
-                cmd_msg = Twist()
-                if prediction == 'S':
-                    cmd_msg.linear.x = 0.3
-                    cmd_msg.angular.z = 0.0
-                elif prediction == 'L':
-                    cmd_msg.linear.x = 0.2
-                    cmd_msg.angular.z = -0.5
-                elif prediction == 'R':
-                    cmd_msg.linear.x = 0.2
-                    cmd_msg.angular.z = 0.5
-                
-                self.pub_nav.publish(cmd_msg)
+            self.predict(self.data_transform(cv_image).unsqueeze(0))
+
+
+    def tensor_cb(self, msg):
+        # 32FC1 planes of (pixel / 255 - 0.5) in RGB order, 3 * 101 rows of 101
+        if self.flag_auto:
+            height, width = self.input_size
+            if msg.encoding != '32FC1' or msg.height != 3 * height or msg.width != width:
+                rospy.logerr_throttle(10, 'image_tensor is %s %dx%d, expected 32FC1 %dx%d (3 planes of %dx%d), '
+                                      'publish a 3 channel encoding' % (msg.encoding, msg.width, msg.height,
+                                                                        width, 3 * height, width, height))
+                return
+            planes = np.frombuffer(msg.data, dtype=np.float32).reshape(1, 3, height, width)
+            self.predict(torch.from_numpy(planes.copy()))
+
+
+    def predict(self, input_image):
+        with torch.no_grad():
+            output_idx = np.argmax(self.model(input_image.cuda()).cpu())
+            prediction = self.CLASSES[output_idx]
+            
+            # Car command 
+            cmd_msg = Twist()
+            if prediction == 'S':
+                cmd_msg.linear.x = 0.3
+                cmd_msg.angular.z = 0.0
+            elif prediction == 'L':
+                cmd_msg.linear.x = 0.2
+                cmd_msg.angular.z = -0.5
+            elif prediction == 'R':
+                cmd_msg.linear.x = 0.2
+                cmd_msg.angular.z = 0.5
+            
+            self.pub_nav.publish(cmd_msg)
             
 
     def shutdown_cb(self):
@@ -0,0 +1,133 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace laser_odometry {
+
+struct Pose2D {
+    double x;
+    double y;
+    double theta;
+
+    Pose2D() : x(0), y(0), theta(0) {}
+    Pose2D(double x_, double y_, double theta_) : x(x_), y(y_), theta(theta_) {}
+};
+
+/** a (*) b, poses as rigid transforms */
+Pose2D compose(const Pose2D &a, const Pose2D &b);
+/** a^-1 */
+Pose2D inverse(const Pose2D &a);
+
+struct MatcherConfig {
+    double resolution;      // fine grid cell [m]
+    int    coarse_factor;   // coarse cell = coarse_factor * resolution
+    double sigma;           // spread of the likelihood around a reference point [m]
+    double range_min;       // [m]
+    double range_max;       // [m]
+    double linear_window;   // +- translation searched around the guess [m]
+    double angular_window;  // +- rotation searched around the guess [rad]
+    int    coarse_angle_step; // coarse rotation step in beams
+    int    max_points;      // scan points scored, at most 256
+
+    MatcherConfig()
+        : resolution(0.025), coarse_factor(4), sigma(0.05), range_min(0.1), range_max(8.0),
+          linear_window(0.3), angular_window(0.35), coarse_angle_step(2), max_points(256) {}
+};
+
+/**
+ * 8 bit likelihood field around the reference scan origin. Rows are padded
+ * with 16 zero bytes, a 16 byte load starting at any column stays in the buffer.
+ */
+class LikelihoodGrid {
+public:
+    LikelihoodGrid() : width_(0), height_(0), stride_(0), resolution_(0), origin_x_(0), origin_y_(0) {}
+
+    /** Splats a precomputed kernel at every point (x, y in the reference frame) */
+    void build(const std::vector<float> &x, const std::vector<float> &y, double resolution,
+               double sigma, double half_extent);
+
+    /** Max pooling, the coarse score bounds the fine scores it covers */
+    void downsample(const LikelihoodGrid &fine, int factor);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int stride() const { return stride_; }
+    double resolution() const { return resolution_; }
+    double originX() const { return origin_x_; }
+    double originY() const { return origin_y_; }
+    const uint8_t *row(int y) const { return &data_[(size_t)y * stride_]; }
+
+private:
+    void resize(int width, int height);
+
+    int width_, height_, stride_;
+    double resolution_;
+    double origin_x_, origin_y_;   // world position of cell (0, 0)
+    std::vector<uint8_t> data_;
+};
+
+/**
+ * Polar correlative scan matcher. Rotation candidates are multiples of the beam
+ * angle, i.e. index shifts in a precomputed cos/sin table, so no point is rotated
+ * explicitly. For each rotation and row offset the scores of 16 neighbouring
+ * translations are accumulated with one SIMD add per point, first on the coarse
+ * max-pooled grid over the whole window, then on the fine grid around the best
+ * coarse cell.
+ */
+class ScanMatcher {
+public:
+    explicit ScanMatcher(const MatcherConfig &config = MatcherConfig());
+
+    /** Must be called before setReference and whenever the scan layout changes */
+    void setScanGeometry(float angle_min, float angle_increment, size_t count);
+
+    /** Builds the likelihood grids from a scan, later scans are matched against it */
+    bool setReference(const float *ranges, size_t count);
+
+    bool hasReference() const { return has_reference_; }
+
+    /**
+     * @brief pose of the scan in the reference frame
+     * @param guess  initial estimate, the search window is centred on it
+     * @param pose   best pose found
+     * @param score  0..1, mean likelihood of the scan points at pose
+     * @return false if the scan has too few valid points or no reference is set
+     */
+    bool match(const float *ranges, size_t count, const Pose2D &guess, Pose2D &pose, double &score);
+
+    const MatcherConfig &config() const { return config_; }
+
+private:
+    struct Candidate {
+        int rotation;   // beams
+        int dx, dy;     // cells of the grid searched
+        uint32_t score;
+    };
+
+    void selectPoints(const float *ranges, size_t count);
+    void searchGrid(const LikelihoodGrid &grid, const Pose2D &guess, int rot_begin, int rot_end,
+                    int rot_step, int x_begin, int x_count, int y_begin, int y_count,
+                    Candidate &best, std::vector<uint16_t> *best_scores);
+
+    MatcherConfig config_;
+    float angle_min_;
+    float angle_increment_;
+    size_t count_;
+    int max_shift_;                 // beams covered by the trig tables beyond the scan
+    std::vector<float> cos_;
+    std::vector<float> sin_;
+
+    bool has_reference_;
+    LikelihoodGrid fine_;
+    LikelihoodGrid coarse_;
+
+    std::vector<int> beams_;        // selected beams of the current scan
+    std::vector<float> ranges_;
+    std::vector<int32_t> cell_x_;
+    std::vector<int32_t> cell_y_;
+    std::vector<const uint8_t *> rows_;
+    std::vector<uint16_t> scores_;
+};
+
+}
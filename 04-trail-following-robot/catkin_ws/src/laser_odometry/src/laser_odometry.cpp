@@ -0,0 +1,207 @@
+#include <math.h>
+#include <algorithm>
+#include <ros/ros.h>
+#include <nodelet/nodelet.h>
+#include <sensor_msgs/LaserScan.h>
+#include <nav_msgs/Odometry.h>
+#include <tf/transform_listener.h>
+#include <tf/transform_broadcaster.h>
+#include <laser_odometry/scan_matcher.h>
+
+namespace laser_odometry {
+
+/**
+ * Incremental odometry from consecutive lidar scans. Every scan is matched
+ * against the last keyframe, a new keyframe is taken once the robot moved
+ * far enough or the match got poor. Poses are kept for the laser frame and
+ * converted to base_frame with the static mount transform.
+ */
+class LaserOdometry {
+    public:
+    LaserOdometry(ros::NodeHandle nh, ros::NodeHandle nh_private)
+        : nh_(nh), has_mount_(false), has_last_(false), has_keyframe_pose_(false) {
+        MatcherConfig config;
+        nh_private.param<std::string>("base_frame", base_frame_, "base_link");
+        nh_private.param<std::string>("odom_frame", odom_frame_, "odom");
+        nh_private.param<bool>("publish_tf", publish_tf_, true);
+        nh_private.param<double>("keyframe_distance", keyframe_distance_, 0.1);
+        nh_private.param<double>("keyframe_angle", keyframe_angle_, 0.1);
+        nh_private.param<double>("min_score", min_score_, 0.3);
+        nh_private.param<double>("resolution", config.resolution, config.resolution);
+        nh_private.param<int>("coarse_factor", config.coarse_factor, config.coarse_factor);
+        nh_private.param<double>("sigma", config.sigma, config.sigma);
+        nh_private.param<double>("range_min", config.range_min, config.range_min);
+        nh_private.param<double>("range_max", config.range_max, config.range_max);
+        nh_private.param<double>("linear_window", config.linear_window, config.linear_window);
+        nh_private.param<double>("angular_window", config.angular_window, config.angular_window);
+        nh_private.param<int>("coarse_angle_step", config.coarse_angle_step, config.coarse_angle_step);
+        nh_private.param<int>("max_points", config.max_points, config.max_points);
+        matcher_ = ScanMatcher(config);
+
+        sub_laser_ = nh_.subscribe<sensor_msgs::LaserScan>("scan", 1, &LaserOdometry::laserscan_cb, this);
+        pub_odom_ = nh_.advertise<nav_msgs::Odometry>("laser_odom", 10);
+    }
+
+    /** Mount of the lidar on the robot, looked up once, the transform is static */
+    bool lookup_mount(const std::string &laser_frame){
+        if(has_mount_)
+            return true;
+        if(!listener_.canTransform(base_frame_, laser_frame, ros::Time(0))){
+            ROS_WARN_THROTTLE(5.0, "laser_odometry: waiting for transform %s -> %s",
+                base_frame_.c_str(), laser_frame.c_str());
+            return false;
+        }
+        tf::StampedTransform mount;
+        try{
+            listener_.lookupTransform(base_frame_, laser_frame, ros::Time(0), mount);
+        }
+        catch (const tf::TransformException& ex){
+            ROS_WARN_THROTTLE(5.0, "laser_odometry: %s", ex.what());
+            return false;
+        }
+        base_to_laser_ = Pose2D(mount.getOrigin().x(), mount.getOrigin().y(), tf::getYaw(mount.getRotation()));
+        laser_to_base_ = inverse(base_to_laser_);
+        has_mount_ = true;
+        return true;
+    }
+
+    void laserscan_cb(const sensor_msgs::LaserScan::ConstPtr& scan){
+        if(!lookup_mount(scan->header.frame_id))
+            return;
+
+        const float *ranges = scan->ranges.empty() ? NULL : &scan->ranges[0];
+        size_t count = scan->ranges.size();
+        matcher_.setScanGeometry(scan->angle_min, scan->angle_increment, count);
+        if(!has_keyframe_pose_){
+            // odom starts at the robot pose of the first scan
+            keyframe_ = base_to_laser_;
+            has_keyframe_pose_ = true;
+        }
+        if(!matcher_.hasReference()){
+            // first scan or the scan layout changed: restart from the current pose
+            if(matcher_.setReference(ranges, count)){
+                keyframe_ = compose(keyframe_, relative_);
+                relative_ = Pose2D();
+                velocity_ = Pose2D();
+                last_stamp_ = scan->header.stamp;
+                has_last_ = true;
+            }
+            return;
+        }
+
+        // constant velocity guess for the scan in the keyframe
+        double dt = has_last_ ? (scan->header.stamp - last_stamp_).toSec() : 0.0;
+        Pose2D guess = compose(relative_, velocity_);
+        Pose2D pose;
+        double score = 0;
+        if(!matcher_.match(ranges, count, guess, pose, score)){
+            ROS_WARN_THROTTLE(5.0, "laser_odometry: too few valid points in scan");
+            return;
+        }
+
+        Pose2D laser = compose(keyframe_, pose);
+        velocity_ = compose(inverse(relative_), pose);
+        relative_ = pose;
+        Pose2D step = compose(compose(base_to_laser_, velocity_), laser_to_base_);
+        publish(scan->header.stamp, compose(laser, laser_to_base_), step, dt, score);
+
+        double distance = sqrt(pose.x * pose.x + pose.y * pose.y);
+        if(distance > keyframe_distance_ || fabs(pose.theta) > keyframe_angle_ || score < min_score_){
+            if(matcher_.setReference(ranges, count)){
+                keyframe_ = laser;
+                relative_ = Pose2D();
+            }
+        }
+        last_stamp_ = scan->header.stamp;
+    }
+
+    void publish(const ros::Time &stamp, const Pose2D &base, const Pose2D &step, double dt, double score){
+        geometry_msgs::Quaternion q = tf::createQuaternionMsgFromYaw(base.theta);
+
+        if(publish_tf_){
+            geometry_msgs::TransformStamped t;
+            t.header.stamp = stamp;
+            t.header.frame_id = odom_frame_;
+            t.child_frame_id = base_frame_;
+            t.transform.translation.x = base.x;
+            t.transform.translation.y = base.y;
+            t.transform.rotation = q;
+            broadcaster_.sendTransform(t);
+        }
+
+        nav_msgs::Odometry odom;
+        odom.header.stamp = stamp;
+        odom.header.frame_id = odom_frame_;
+        odom.child_frame_id = base_frame_;
+        odom.pose.pose.position.x = base.x;
+        odom.pose.pose.position.y = base.y;
+        odom.pose.pose.orientation = q;
+        if(dt > 0){
+            odom.twist.twist.linear.x = step.x / dt;
+            odom.twist.twist.linear.y = step.y / dt;
+            odom.twist.twist.angular.z = step.theta / dt;
+        }
+
+        // a match is good to about a cell and a beam, worse the lower its score
+        const MatcherConfig &config = matcher_.config();
+        double weight = 1.0 / std::max(score, 0.05);
+        double var_xy = config.resolution * config.resolution * weight;
+        double var_yaw = 0.01 * 0.01 * weight;
+        for(int i = 0; i < 36; i++){
+            odom.pose.covariance[i] = 0;
+            odom.twist.covariance[i] = 0;
+        }
+        odom.pose.covariance[0] = odom.pose.covariance[7] = var_xy;
+        odom.pose.covariance[14] = odom.pose.covariance[21] = odom.pose.covariance[28] = 1e6;
+        odom.pose.covariance[35] = var_yaw;
+        if(dt > 0){
+            odom.twist.covariance[0] = odom.twist.covariance[7] = var_xy / (dt * dt);
+            odom.twist.covariance[14] = odom.twist.covariance[21] = odom.twist.covariance[28] = 1e6;
+            odom.twist.covariance[35] = var_yaw / (dt * dt);
+        }
+        pub_odom_.publish(odom);
+    }
+
+    private:
+    ros::NodeHandle nh_;
+    ros::Subscriber sub_laser_;
+    ros::Publisher pub_odom_;
+    tf::TransformListener listener_;
+    tf::TransformBroadcaster broadcaster_;
+
+    std::string base_frame_;
+    std::string odom_frame_;
+    bool publish_tf_;
+    double keyframe_distance_;
+    double keyframe_angle_;
+    double min_score_;
+
+    ScanMatcher matcher_;
+    bool has_mount_;
+    Pose2D base_to_laser_;      // laser pose in base_frame
+    Pose2D laser_to_base_;
+    bool has_last_;
+    bool has_keyframe_pose_;
+    Pose2D keyframe_;           // laser pose of the keyframe in odom_frame
+    Pose2D relative_;           // laser pose of the last scan in the keyframe
+    Pose2D velocity_;           // laser motion between the last two scans
+    ros::Time last_stamp_;
+};
+
+
+/**
+ * Nodelet wrapper: loaded into the lidar manager the scans arrive without
+ * serialization.
+ */
+class LaserOdometryNodelet: public nodelet::Nodelet {
+    boost::shared_ptr<LaserOdometry> odometry_;
+
+    virtual void onInit(){
+        odometry_.reset(new LaserOdometry(getNodeHandle(), getPrivateNodeHandle()));
+    }
+};
+
+} // namespace
+
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(laser_odometry::LaserOdometryNodelet, nodelet::Nodelet)
@@ -0,0 +1,327 @@
+#include <laser_odometry/scan_matcher.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace laser_odometry {
+
+namespace {
+
+const int LANES = 16;
+
+/** out[j] = sum over rows of rows[i][j], j < 16 */
+inline void accumulate16(const uint8_t *const *rows, size_t count, uint16_t *out)
+{
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = zero, hi = zero;
+    for (size_t i = 0; i < count; i++) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[i]));
+        lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+        hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), lo);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), hi);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint16x8_t lo = vdupq_n_u16(0), hi = vdupq_n_u16(0);
+    for (size_t i = 0; i < count; i++) {
+        uint8x16_t v = vld1q_u8(rows[i]);
+        lo = vaddw_u8(lo, vget_low_u8(v));
+        hi = vaddw_u8(hi, vget_high_u8(v));
+    }
+    vst1q_u16(out, lo);
+    vst1q_u16(out + 8, hi);
+#else
+    memset(out, 0, LANES * sizeof(uint16_t));
+    for (size_t i = 0; i < count; i++) {
+        for (int j = 0; j < LANES; j++) {
+            out[j] += rows[i][j];
+        }
+    }
+#endif
+}
+
+inline double normalizeAngle(double a)
+{
+    return atan2(sin(a), cos(a));
+}
+
+/** Offset of the parabola vertex through (-1, a), (0, b), (1, c) */
+inline double peakOffset(double a, double b, double c)
+{
+    double d = a - 2 * b + c;
+    if (d >= 0) {
+        return 0;
+    }
+    return std::max(-0.5, std::min(0.5, 0.5 * (a - c) / d));
+}
+
+}
+
+Pose2D compose(const Pose2D &a, const Pose2D &b)
+{
+    double c = cos(a.theta), s = sin(a.theta);
+    return Pose2D(a.x + c * b.x - s * b.y, a.y + s * b.x + c * b.y, normalizeAngle(a.theta + b.theta));
+}
+
+Pose2D inverse(const Pose2D &a)
+{
+    double c = cos(a.theta), s = sin(a.theta);
+    return Pose2D(-c * a.x - s * a.y, s * a.x - c * a.y, -a.theta);
+}
+
+/*----------------------------------------------------------------
+                        LikelihoodGrid
+----------------------------------------------------------------*/
+void LikelihoodGrid::resize(int width, int height)
+{
+    width_ = width;
+    height_ = height;
+    stride_ = width + LANES;
+    // one spare row as well: loads start at most at the last column of the last row
+    data_.assign((size_t)stride_ * (height_ + 1), 0);
+}
+
+void LikelihoodGrid::build(const std::vector<float> &x, const std::vector<float> &y, double resolution,
+                           double sigma, double half_extent)
+{
+    int cells = (int)ceil(2 * half_extent / resolution);
+    resolution_ = resolution;
+    origin_x_ = origin_y_ = -half_extent;
+    resize(cells, cells);
+
+    int radius = std::max(1, (int)ceil(3 * sigma / resolution));
+    int side = 2 * radius + 1;
+    std::vector<uint8_t> kernel(side * side);
+    for (int ky = -radius; ky <= radius; ky++) {
+        for (int kx = -radius; kx <= radius; kx++) {
+            double d2 = (kx * kx + ky * ky) * resolution * resolution;
+            kernel[(ky + radius) * side + kx + radius] = (uint8_t)(255.0 * exp(-0.5 * d2 / (sigma * sigma)) + 0.5);
+        }
+    }
+
+    for (size_t i = 0; i < x.size(); i++) {
+        int cx = (int)floor((x[i] - origin_x_) / resolution);
+        int cy = (int)floor((y[i] - origin_y_) / resolution);
+        if (cx - radius < 0 || cy - radius < 0 || cx + radius >= width_ || cy + radius >= height_) {
+            continue;
+        }
+        for (int ky = 0; ky < side; ky++) {
+            uint8_t *dst = &data_[(size_t)(cy - radius + ky) * stride_ + cx - radius];
+            const uint8_t *k = &kernel[ky * side];
+            for (int kx = 0; kx < side; kx++) {
+                dst[kx] = std::max(dst[kx], k[kx]);
+            }
+        }
+    }
+}
+
+void LikelihoodGrid::downsample(const LikelihoodGrid &fine, int factor)
+{
+    resolution_ = fine.resolution_ * factor;
+    origin_x_ = fine.origin_x_;
+    origin_y_ = fine.origin_y_;
+    resize((fine.width_ + factor - 1) / factor, (fine.height_ + factor - 1) / factor);
+    for (int y = 0; y < fine.height_; y++) {
+        const uint8_t *src = fine.row(y);
+        uint8_t *dst = &data_[(size_t)(y / factor) * stride_];
+        for (int x = 0; x < fine.width_; x++) {
+            dst[x / factor] = std::max(dst[x / factor], src[x]);
+        }
+    }
+}
+
+/*----------------------------------------------------------------
+                        ScanMatcher
+----------------------------------------------------------------*/
+ScanMatcher::ScanMatcher(const MatcherConfig &config)
+    : config_(config), angle_min_(0), angle_increment_(0), count_(0), max_shift_(0),
+      has_reference_(false)
+{
+    config_.max_points = std::max(1, std::min(config_.max_points, 256));
+    config_.coarse_factor = std::max(1, config_.coarse_factor);
+    config_.coarse_angle_step = std::max(1, config_.coarse_angle_step);
+}
+
+void ScanMatcher::setScanGeometry(float angle_min, float angle_increment, size_t count)
+{
+    if (angle_min == angle_min_ && angle_increment == angle_increment_ && count == count_) {
+        return;
+    }
+    angle_min_ = angle_min;
+    angle_increment_ = angle_increment;
+    count_ = count;
+    has_reference_ = false;
+
+    // a half turn of guess plus the search window, all as index shifts
+    max_shift_ = (int)ceil((M_PI + config_.angular_window) / fabs(angle_increment)) + 1;
+    size_t size = count + 2 * max_shift_;
+    cos_.resize(size);
+    sin_.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        double angle = angle_min + ((int)i - max_shift_) * (double)angle_increment;
+        cos_[i] = cos(angle);
+        sin_[i] = sin(angle);
+    }
+}
+
+bool ScanMatcher::setReference(const float *ranges, size_t count)
+{
+    if (count != count_ || count == 0) {
+        return false;
+    }
+    std::vector<float> x, y;
+    x.reserve(count);
+    y.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        float r = ranges[i];
+        if (r > config_.range_min && r < config_.range_max) {
+            x.push_back(r * cos_[i + max_shift_]);
+            y.push_back(r * sin_[i + max_shift_]);
+        }
+    }
+    if (x.size() < 10) {
+        return false;
+    }
+    double half_extent = config_.range_max + config_.linear_window + 3 * config_.sigma;
+    fine_.build(x, y, config_.resolution, config_.sigma, half_extent);
+    coarse_.downsample(fine_, config_.coarse_factor);
+    has_reference_ = true;
+    return true;
+}
+
+void ScanMatcher::selectPoints(const float *ranges, size_t count)
+{
+    beams_.clear();
+    ranges_.clear();
+    size_t valid = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (ranges[i] > config_.range_min && ranges[i] < config_.range_max) {
+            valid++;
+        }
+    }
+    // uniform decimation keeps the scores within 16 bit (255 * 256)
+    size_t step = (valid + config_.max_points - 1) / config_.max_points;
+    size_t n = 0;
+    for (size_t i = 0; i < count && beams_.size() < (size_t)config_.max_points; i++) {
+        if (ranges[i] > config_.range_min && ranges[i] < config_.range_max) {
+            if (n++ % step == 0) {
+                beams_.push_back(i);
+                ranges_.push_back(ranges[i]);
+            }
+        }
+    }
+}
+
+void ScanMatcher::searchGrid(const LikelihoodGrid &grid, const Pose2D &guess, int rot_begin, int rot_end,
+                             int rot_step, int x_begin, int x_count, int y_begin, int y_count,
+                             Candidate &best, std::vector<uint16_t> *best_scores)
+{
+    size_t points = beams_.size();
+    int blocks = (x_count + LANES - 1) / LANES;
+    double inv_res = 1.0 / grid.resolution();
+    cell_x_.resize(points);
+    cell_y_.resize(points);
+    rows_.resize(points);
+    scores_.resize((size_t)y_count * blocks * LANES);
+
+    for (int rot = rot_begin; rot <= rot_end; rot += rot_step) {
+        for (size_t i = 0; i < points; i++) {
+            size_t t = beams_[i] + max_shift_ + rot;
+            cell_x_[i] = (int32_t)floor((ranges_[i] * cos_[t] + guess.x - grid.originX()) * inv_res) + x_begin;
+            cell_y_[i] = (int32_t)floor((ranges_[i] * sin_[t] + guess.y - grid.originY()) * inv_res) + y_begin;
+        }
+
+        bool improved = false;
+        for (int dy = 0; dy < y_count; dy++) {
+            for (int b = 0; b < blocks; b++) {
+                size_t n = 0;
+                for (size_t i = 0; i < points; i++) {
+                    int cx = cell_x_[i] + b * LANES;
+                    int cy = cell_y_[i] + dy;
+                    // points leaving the grid score 0
+                    if (cx >= 0 && cx < grid.width() && cy >= 0 && cy < grid.height()) {
+                        rows_[n++] = grid.row(cy) + cx;
+                    }
+                }
+                uint16_t *acc = &scores_[((size_t)dy * blocks + b) * LANES];
+                accumulate16(&rows_[0], n, acc);
+                int lanes = std::min(LANES, x_count - b * LANES);
+                for (int j = 0; j < lanes; j++) {
+                    if (acc[j] > best.score) {
+                        best.score = acc[j];
+                        best.rotation = rot;
+                        best.dx = x_begin + b * LANES + j;
+                        best.dy = y_begin + dy;
+                        improved = true;
+                    }
+                }
+            }
+        }
+        if (improved && best_scores) {
+            *best_scores = scores_;
+        }
+    }
+}
+
+bool ScanMatcher::match(const float *ranges, size_t count, const Pose2D &guess, Pose2D &pose, double &score)
+{
+    if (!has_reference_ || count != count_) {
+        return false;
+    }
+    selectPoints(ranges, count);
+    if (beams_.size() < 10) {
+        return false;
+    }
+
+    // the guess rotation is rounded to whole beams, the search covers the rest
+    double increment = angle_increment_;
+    int window = (int)ceil(config_.angular_window / fabs(increment));
+    int center = (int)lround(normalizeAngle(guess.theta) / increment);
+    center = std::max(-max_shift_ + window + 1, std::min(max_shift_ - window - 1, center));
+
+    // coarse: whole window on the max pooled grid
+    int coarse_cells = (int)ceil(config_.linear_window / coarse_.resolution());
+    Candidate coarse = {center, 0, 0, 0};
+    searchGrid(coarse_, guess, center - window, center + window, config_.coarse_angle_step,
+               -coarse_cells, 2 * coarse_cells + 1, -coarse_cells, 2 * coarse_cells + 1, coarse, NULL);
+
+    // fine: one coarse cell and one coarse rotation step around the coarse optimum
+    int factor = config_.coarse_factor;
+    int step = config_.coarse_angle_step;
+    Candidate fine = {coarse.rotation, 0, 0, 0};
+    std::vector<uint16_t> table;
+    searchGrid(fine_, guess, coarse.rotation - step + 1, coarse.rotation + step - 1, 1,
+               coarse.dx * factor - factor, 2 * factor + 1, coarse.dy * factor - factor, 2 * factor + 1,
+               fine, &table);
+
+    // sub-cell peak from the neighbouring translations of the best rotation
+    int width = (2 * factor + 1 + LANES - 1) / LANES * LANES;
+    int bx = fine.dx - (coarse.dx * factor - factor);
+    int by = fine.dy - (coarse.dy * factor - factor);
+    double ox = 0, oy = 0;
+    if (!table.empty() && bx > 0 && bx < 2 * factor && by > 0 && by < 2 * factor) {
+        const uint16_t *row = &table[(size_t)by * width];
+        ox = peakOffset(row[bx - 1], row[bx], row[bx + 1]);
+        oy = peakOffset(table[(size_t)(by - 1) * width + bx], row[bx], table[(size_t)(by + 1) * width + bx]);
+    }
+
+    // and between the neighbouring beam rotations at that cell
+    Candidate prev = {0, 0, 0, 0}, next = {0, 0, 0, 0};
+    searchGrid(fine_, guess, fine.rotation - 1, fine.rotation - 1, 1, fine.dx, 1, fine.dy, 1, prev, NULL);
+    searchGrid(fine_, guess, fine.rotation + 1, fine.rotation + 1, 1, fine.dx, 1, fine.dy, 1, next, NULL);
+    double otheta = peakOffset(prev.score, fine.score, next.score);
+
+    pose.x = guess.x + (fine.dx + ox) * fine_.resolution();
+    pose.y = guess.y + (fine.dy + oy) * fine_.resolution();
+    pose.theta = normalizeAngle((fine.rotation + otheta) * increment);
+    score = fine.score / (255.0 * beams_.size());
+    return true;
+}
+
+}
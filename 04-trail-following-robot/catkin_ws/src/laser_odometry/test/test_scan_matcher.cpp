@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <vector>
+#include <laser_odometry/scan_matcher.h>
+
+using namespace laser_odometry;
+
+namespace {
+
+const size_t BEAMS = 360;
+const float ANGLE_MIN = -M_PI;
+const float ANGLE_INCREMENT = 2 * M_PI / BEAMS;
+
+struct Segment {
+    double x0, y0, x1, y1;
+};
+
+/** A 7 x 5.5 m room off centre with a pillar and a cabinet, no symmetry a match could flip to */
+std::vector<Segment> room() {
+    const Segment walls[] = {
+        {-3.0, -2.5,  4.0, -2.5}, { 4.0, -2.5,  4.0,  3.0},
+        { 4.0,  3.0, -3.0,  3.0}, {-3.0,  3.0, -3.0, -2.5},
+        { 1.0,  1.0,  1.4,  1.0}, { 1.4,  1.0,  1.4,  1.4},
+        { 1.4,  1.4,  1.0,  1.4}, { 1.0,  1.4,  1.0,  1.0},
+        {-3.0,  0.5, -2.4,  0.5}, {-2.4,  0.5, -2.4, -1.5},
+        {-2.4, -1.5, -3.0, -1.5},
+    };
+    return std::vector<Segment>(walls, walls + sizeof(walls) / sizeof(walls[0]));
+}
+
+/** Ranges seen by a laser at pose in the room frame, beams that hit nothing are 0 */
+std::vector<float> raycast(const Pose2D &pose) {
+    std::vector<Segment> segments = room();
+    std::vector<float> ranges(BEAMS, 0.0f);
+    for (size_t i = 0; i < BEAMS; i++) {
+        double angle = pose.theta + ANGLE_MIN + (double)i * ANGLE_INCREMENT;
+        double dx = cos(angle), dy = sin(angle);
+        double nearest = INFINITY;
+        for (size_t s = 0; s < segments.size(); s++) {
+            const Segment &g = segments[s];
+            double ex = g.x1 - g.x0, ey = g.y1 - g.y0;
+            double den = dx * ey - dy * ex;
+            if (fabs(den) < 1e-12) {
+                continue;
+            }
+            double qx = g.x0 - pose.x, qy = g.y0 - pose.y;
+            double t = (qx * ey - qy * ex) / den;   // along the beam
+            double u = (qx * dy - qy * dx) / den;   // along the segment
+            if (t > 0 && u >= 0 && u <= 1) {
+                nearest = std::min(nearest, t);
+            }
+        }
+        if (nearest < INFINITY) {
+            ranges[i] = (float)nearest;
+        }
+    }
+    return ranges;
+}
+
+/** Matches a scan taken at truth against one taken at the origin */
+void expectMatch(const Pose2D &truth, const Pose2D &guess) {
+    MatcherConfig config;
+    ScanMatcher matcher(config);
+    matcher.setScanGeometry(ANGLE_MIN, ANGLE_INCREMENT, BEAMS);
+    std::vector<float> reference = raycast(Pose2D());
+    ASSERT_TRUE(matcher.setReference(&reference[0], BEAMS));
+
+    std::vector<float> scan = raycast(truth);
+    Pose2D pose;
+    double score = 0;
+    ASSERT_TRUE(matcher.match(&scan[0], BEAMS, guess, pose, score));
+    EXPECT_NEAR(truth.x, pose.x, config.resolution);
+    EXPECT_NEAR(truth.y, pose.y, config.resolution);
+    EXPECT_NEAR(0.0, atan2(sin(pose.theta - truth.theta), cos(pose.theta - truth.theta)), ANGLE_INCREMENT);
+    EXPECT_GT(score, 0.5);
+}
+
+}
+
+TEST(ScanMatcher, ShiftedAndRotatedScan) {
+    expectMatch(Pose2D(0.12, -0.08, 0.1), Pose2D());
+    expectMatch(Pose2D(-0.2, 0.15, -0.25), Pose2D());
+    // a guess off by a few cells and beams
+    expectMatch(Pose2D(0.07, 0.21, 0.05), Pose2D(0.15, 0.1, -0.05));
+}
+
+TEST(ScanMatcher, GuessAcrossThePiSeam) {
+    // truth and guess on either side of +-pi, the rotation search must wrap
+    expectMatch(Pose2D(0.1, 0.05, M_PI - 0.05), Pose2D(0.05, 0.0, -M_PI + 0.03));
+    expectMatch(Pose2D(-0.06, 0.1, -M_PI + 0.04), Pose2D(0.0, 0.05, M_PI - 0.06));
+    expectMatch(Pose2D(0.0, -0.1, M_PI), Pose2D(0.0, 0.0, -M_PI));
+}
+
+TEST(ScanMatcher, Compose) {
+    Pose2D a(1.0, 2.0, M_PI / 2), b(0.5, -0.25, M_PI / 2 + 0.1);
+    Pose2D c = compose(a, b);
+    EXPECT_NEAR(1.25, c.x, 1e-9);
+    EXPECT_NEAR(2.5, c.y, 1e-9);
+    EXPECT_NEAR(-M_PI + 0.1, c.theta, 1e-9);
+    Pose2D identity = compose(c, inverse(c));
+    EXPECT_NEAR(0.0, identity.x, 1e-9);
+    EXPECT_NEAR(0.0, identity.y, 1e-9);
+    EXPECT_NEAR(0.0, identity.theta, 1e-9);
+}
+
+TEST(ScanMatcher, TooFewPoints) {
+    ScanMatcher matcher;
+    matcher.setScanGeometry(ANGLE_MIN, ANGLE_INCREMENT, BEAMS);
+    std::vector<float> empty(BEAMS, 0.0f);
+    EXPECT_FALSE(matcher.setReference(&empty[0], BEAMS));
+    EXPECT_FALSE(matcher.hasReference());
+
+    std::vector<float> reference = raycast(Pose2D());
+    ASSERT_TRUE(matcher.setReference(&reference[0], BEAMS));
+    Pose2D pose;
+    double score = 0;
+    EXPECT_FALSE(matcher.match(&empty[0], BEAMS, Pose2D(), pose, score));
+    EXPECT_FALSE(matcher.match(&reference[0], BEAMS - 1, Pose2D(), pose, score));
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
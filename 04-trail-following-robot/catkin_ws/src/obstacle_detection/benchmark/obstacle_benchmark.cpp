@@ -0,0 +1,466 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+#include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/LaserScan.h>
+#include <haptic_msgs/Wristband.h>
+#include <obstacle_detection/ObstacleArray.h>
+#include <obstacle_detection/obstacle_detector.h>
+#include <obstacle_detection/obstacle_messages.h>
+#include <obstacle_detection/legacy_pipeline.h>
+
+using namespace obstacle_detection;
+
+/**
+ * Replays LaserScans through the obstacle detection pipelines without a
+ * running ROS master or lidar:
+ *   pcl       the original callback: projectLaser, ConditionalRemoval,
+ *             transformPointCloud, point_to_field, vote > 30 and the wristband fill
+ *   detector  ObstacleDetector as used by obs_detect: kernel votes, grid,
+ *             latch, segmentation, wristband and obstacle array fill
+ * Every pipeline sees the same scans. Per stage latency, allocations and
+ * scans/s are printed as JSON on stdout, votes are compared to the first pipeline.
+ *
+ * usage: obstacle_detection_benchmark [--scans N] [--bag FILE [--topic /scan]]
+ *                                     [--pipelines pcl,detector] [--no-grid]
+ */
+
+static std::atomic<uint64_t> g_allocations(0);
+
+void *operator new(size_t size) {
+    g_allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+namespace {
+
+inline uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct StageStats {
+    std::string name;
+    std::vector<uint64_t> samples;  // ns per scan
+    uint64_t total_ns;
+    uint64_t allocations;
+
+    explicit StageStats(const std::string &n) : name(n), total_ns(0), allocations(0) {}
+
+    uint64_t percentile(double q) {
+        if (samples.empty()) {
+            return 0;
+        }
+        std::sort(samples.begin(), samples.end());
+        return samples[(size_t)(q * (samples.size() - 1))];
+    }
+};
+
+/** Times the stages of one scan, stage() closes the previous one */
+class StageTimer {
+public:
+    explicit StageTimer(std::vector<StageStats> &stages) : stages_(stages), current_(-1), start_(0), allocs_(0) {}
+
+    void stage(size_t index) {
+        close();
+        current_ = (int)index;
+        allocs_ = g_allocations;
+        start_ = nowNs();
+    }
+
+    void close() {
+        if (current_ < 0) {
+            return;
+        }
+        uint64_t ns = nowNs() - start_;
+        // before push_back, growing the samples is not the stage's allocation
+        uint64_t allocations = g_allocations - allocs_;
+        StageStats &s = stages_[current_];
+        s.samples.push_back(ns);
+        s.total_ns += ns;
+        s.allocations += allocations;
+        current_ = -1;
+    }
+
+private:
+    std::vector<StageStats> &stages_;
+    int current_;
+    uint64_t start_;
+    uint64_t allocs_;
+};
+
+/** A scan -> wristband implementation under test, add replacements to makePipeline() */
+class Pipeline {
+public:
+    virtual ~Pipeline() {}
+    virtual const char *name() const = 0;
+    virtual void stageNames(std::vector<StageStats> &stages) const = 0;
+    virtual void run(const sensor_msgs::LaserScan &scan, StageTimer &timer) = 0;
+    /** Zone votes of the last scan, NUM_FIELDS entries */
+    virtual const uint16_t *votes() const = 0;
+    virtual const haptic_msgs::Wristband &wristband() const = 0;
+};
+
+void initWristband(haptic_msgs::Wristband &wmsg) {
+    wmsg.left.motors.resize(3);
+    wmsg.right.motors.resize(3);
+}
+
+void fillWristband(haptic_msgs::Wristband &wmsg, const WristbandCommand &left, const WristbandCommand &right) {
+    for (size_t i = 0; i < wmsg.left.motors.size(); i++) {
+        wmsg.left.motors[i].frequency = left.frequency;
+        wmsg.left.motors[i].intensity = left.intensity;
+        wmsg.right.motors[i].frequency = right.frequency;
+        wmsg.right.motors[i].intensity = right.intensity;
+    }
+}
+
+class PclPipeline : public Pipeline {
+public:
+    PclPipeline() : tf_(launchMount()) {
+        initWristband(wmsg_);
+    }
+
+    const char *name() const { return "pcl"; }
+
+    void stageNames(std::vector<StageStats> &stages) const {
+        const char *names[] = {"projection", "filtering", "transform", "classification", "message"};
+        for (size_t i = 0; i < 5; i++) {
+            stages.push_back(StageStats(names[i]));
+        }
+    }
+
+    void run(const sensor_msgs::LaserScan &scan, StageTimer &timer) {
+        timer.stage(0);
+        // fresh clouds per scan like the original callback
+        PointCloudXYZ::Ptr cloud(new PointCloudXYZ);
+        PointCloudXYZ::Ptr cloud_filtered(new PointCloudXYZ);
+        legacyProject(projector_, scan, *cloud);
+
+        timer.stage(1);
+        legacyCrop(cloud, *cloud_filtered);
+
+        timer.stage(2);
+        pcl_ros::transformPointCloud (*cloud_filtered, *cloud_filtered, tf_);
+
+        timer.stage(3);
+        legacyClassify(*cloud_filtered, votes_);
+
+        timer.stage(4);
+        unsigned active = 0;
+        for (int i = 0; i < DONT_CARE; i++) {
+            if (votes_[i] > 30) {
+                active |= 1u << i;
+            }
+        }
+        WristbandCommand left, right;
+        ObstacleDetector::pattern(active, left, right);
+        fillWristband(wmsg_, left, right);
+        timer.close();
+    }
+
+    const uint16_t *votes() const { return votes_; }
+    const haptic_msgs::Wristband &wristband() const { return wmsg_; }
+
+private:
+    laser_geometry::LaserProjection projector_;
+    tf::Transform tf_;
+    uint16_t votes_[NUM_FIELDS];
+    haptic_msgs::Wristband wmsg_;
+};
+
+class DetectorPipeline : public Pipeline {
+public:
+    explicit DetectorPipeline(const DetectorConfig &config) : detector_(config) {
+        detector_.setMount(toAffine(launchMount()));
+        initWristband(wmsg_);
+        obstacles_.header.frame_id = "base_link";
+    }
+
+    const char *name() const { return "detector"; }
+
+    void stageNames(std::vector<StageStats> &stages) const {
+        const char *names[] = {"vote", "grid", "latch", "segment", "message"};
+        for (size_t i = 0; i < 5; i++) {
+            stages.push_back(StageStats(names[i]));
+        }
+    }
+
+    void run(const sensor_msgs::LaserScan &scan, StageTimer &timer) {
+        ScanView view;
+        view.ranges = scan.ranges.empty() ? NULL : &scan.ranges[0];
+        view.count = scan.ranges.size();
+        view.angle_min = scan.angle_min;
+        view.angle_increment = scan.angle_increment;
+        view.range_min = scan.range_min;
+        view.range_max = scan.range_max;
+        view.stamp = scan.header.stamp.toSec();
+
+        timer.stage(0);
+        detector_.vote(view, NULL);
+        timer.stage(1);
+        if (detector_.config().use_grid) {
+            // a standing robot, replayed scans carry no odometry
+            detector_.updateGrid(view, Affine2D());
+        }
+        timer.stage(2);
+        detector_.decide(view.stamp);
+        timer.stage(3);
+        detector_.segment(view);
+
+        timer.stage(4);
+        const Detection &d = detector_.detection();
+        fillWristband(wmsg_, d.left, d.right);
+        obstacles_.header.stamp = scan.header.stamp;
+        fillObstacles(detector_.segmenter().clusters(), obstacles_);
+        timer.close();
+    }
+
+    const uint16_t *votes() const { return detector_.detection().votes; }
+    const haptic_msgs::Wristband &wristband() const { return wmsg_; }
+
+private:
+    ObstacleDetector detector_;
+    haptic_msgs::Wristband wmsg_;
+    ObstacleArray obstacles_;
+};
+
+Pipeline *makePipeline(const std::string &name, const DetectorConfig &config) {
+    if (name == "pcl") {
+        return new PclPipeline();
+    }
+    if (name == "detector") {
+        return new DetectorPipeline(config);
+    }
+    return NULL;
+}
+
+/** Distance along a ray from the origin to a circle, INFINITY if missed */
+double rayCircle(double c, double s, double cx, double cy, double radius) {
+    double b = c * cx + s * cy;
+    double disc = b * b - (cx * cx + cy * cy - radius * radius);
+    if (disc < 0) {
+        return INFINITY;
+    }
+    double t = b - sqrt(disc);
+    return t > 0 ? t : INFINITY;
+}
+
+/**
+ * A corridor 1.8 m wide with a post coming towards the robot, 720 beams at 7 Hz.
+ * Ranges are in the laser frame, the robot looks along -x of the laser.
+ */
+std::vector<sensor_msgs::LaserScan> syntheticScans(size_t count) {
+    const size_t beams = 720;
+    std::vector<sensor_msgs::LaserScan> scans(count);
+    uint32_t seed = 1;
+    for (size_t k = 0; k < count; k++) {
+        sensor_msgs::LaserScan &scan = scans[k];
+        scan.header.frame_id = "laser_frame";
+        scan.header.stamp = ros::Time(1.0 + k / 7.0);
+        scan.angle_min = -M_PI;
+        scan.angle_max = M_PI;
+        scan.angle_increment = 2 * M_PI / beams;
+        scan.range_min = 0.1;
+        scan.range_max = 16.0;
+        scan.ranges.resize(beams);
+        // the post approaches from 4 m to 0.4 m and starts over
+        double post = 4.0 - fmod(k * 0.05, 3.6);
+        for (size_t i = 0; i < beams; i++) {
+            double angle = scan.angle_min + i * scan.angle_increment;
+            double c = cos(angle), s = sin(angle);
+            double r = INFINITY;
+            if (s != 0) {
+                r = std::min(r, (s > 0 ? 0.9 : -0.9) / s);
+            }
+            if (c < 0) {
+                r = std::min(r, -6.0 / c);
+            }
+            r = std::min(r, rayCircle(c, s, -post, 0.2, 0.1));
+            seed = seed * 1664525u + 1013904223u;
+            if ((seed >> 8) % 37 == 0) {
+                r = 0.0;
+            } else {
+                r += ((int)((seed >> 12) % 21) - 10) * 0.001;
+            }
+            scan.ranges[i] = r;
+        }
+    }
+    return scans;
+}
+
+bool readBag(const std::string &path, const std::string &topic, size_t limit,
+             std::vector<sensor_msgs::LaserScan> &scans) {
+    try {
+        rosbag::Bag bag(path, rosbag::bagmode::Read);
+        rosbag::View view(bag, rosbag::TopicQuery(std::vector<std::string>(1, topic)));
+        BOOST_FOREACH(const rosbag::MessageInstance &m, view) {
+            sensor_msgs::LaserScan::ConstPtr scan = m.instantiate<sensor_msgs::LaserScan>();
+            if (scan) {
+                scans.push_back(*scan);
+            }
+            if (limit && scans.size() >= limit) {
+                break;
+            }
+        }
+    } catch (const rosbag::BagException &e) {
+        fprintf(stderr, "%s: %s\n", path.c_str(), e.what());
+        return false;
+    }
+    return !scans.empty();
+}
+
+void printStage(StageStats &stats, size_t scans, bool last) {
+    printf("        \"%s\": {\"us_per_scan\": %.2f, \"p50_us\": %.2f, \"p99_us\": %.2f, "
+           "\"allocations_per_scan\": %.2f}%s\n",
+           stats.name.c_str(), stats.total_ns / 1e3 / scans, stats.percentile(0.5) / 1e3,
+           stats.percentile(0.99) / 1e3, (double)stats.allocations / scans, last ? "" : ",");
+}
+
+bool sameWristband(const haptic_msgs::Wristband &a, const haptic_msgs::Wristband &b) {
+    for (size_t i = 0; i < a.left.motors.size(); i++) {
+        if (a.left.motors[i].frequency != b.left.motors[i].frequency ||
+            a.left.motors[i].intensity != b.left.motors[i].intensity ||
+            a.right.motors[i].frequency != b.right.motors[i].frequency ||
+            a.right.motors[i].intensity != b.right.motors[i].intensity) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    size_t scans = 2000;
+    std::string bag, topic = "/scan", pipelines = "pcl,detector";
+    DetectorConfig config;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--scans" && i + 1 < argc) {
+            scans = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--bag" && i + 1 < argc) {
+            bag = argv[++i];
+        } else if (arg == "--topic" && i + 1 < argc) {
+            topic = argv[++i];
+        } else if (arg == "--pipelines" && i + 1 < argc) {
+            pipelines = argv[++i];
+        } else if (arg == "--no-grid") {
+            config.use_grid = false;
+        } else {
+            fprintf(stderr, "usage: %s [--scans N] [--bag FILE [--topic /scan]] [--pipelines pcl,detector] "
+                    "[--no-grid]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (scans == 0) {
+        scans = 1;
+    }
+
+    std::vector<sensor_msgs::LaserScan> input;
+    if (!bag.empty()) {
+        if (!readBag(bag, topic, 0, input)) {
+            fprintf(stderr, "no %s scans in %s\n", topic.c_str(), bag.c_str());
+            return 1;
+        }
+    } else {
+        input = syntheticScans(std::min<size_t>(scans, 500));
+    }
+
+    std::vector<boost::shared_ptr<Pipeline> > list;
+    size_t pos = 0;
+    while (pos <= pipelines.size()) {
+        size_t end = pipelines.find(',', pos);
+        if (end == std::string::npos) {
+            end = pipelines.size();
+        }
+        std::string name = pipelines.substr(pos, end - pos);
+        boost::shared_ptr<Pipeline> p(makePipeline(name, config));
+        if (!p) {
+            fprintf(stderr, "unknown pipeline %s\n", name.c_str());
+            return 1;
+        }
+        list.push_back(p);
+        pos = end + 1;
+    }
+
+    std::vector<std::vector<StageStats> > stages(list.size());
+    std::vector<uint64_t> wall(list.size(), 0);
+    std::vector<size_t> vote_mismatches(list.size(), 0), wristband_mismatches(list.size(), 0);
+    for (size_t p = 0; p < list.size(); p++) {
+        list[p]->stageNames(stages[p]);
+    }
+    // pipelines take turns on every scan, replays loop over the input with fresh stamps
+    size_t points = 0;
+    double period = input.size() > 1 ? (input.back().header.stamp - input.front().header.stamp).toSec() /
+                                           (input.size() - 1) : 0.1;
+    for (size_t k = 0; k < scans; k++) {
+        sensor_msgs::LaserScan scan = input[k % input.size()];
+        double loop = (k / input.size()) * (input.size() * period);
+        scan.header.stamp = input[k % input.size()].header.stamp + ros::Duration(loop);
+        points += scan.ranges.size();
+        for (size_t p = 0; p < list.size(); p++) {
+            StageTimer timer(stages[p]);
+            uint64_t start = nowNs();
+            list[p]->run(scan, timer);
+            wall[p] += nowNs() - start;
+            if (p > 0) {
+                vote_mismatches[p] += memcmp(list[p]->votes(), list[0]->votes(), NUM_FIELDS * sizeof(uint16_t)) != 0;
+                wristband_mismatches[p] += !sameWristband(list[p]->wristband(), list[0]->wristband());
+            }
+        }
+    }
+
+    printf("{\n  \"benchmark\": \"obstacle_detection\",\n");
+    printf("  \"input\": \"%s\",\n", bag.empty() ? "synthetic" : bag.c_str());
+    printf("  \"scans\": %llu,\n", (unsigned long long)scans);
+    printf("  \"points_per_scan\": %.1f,\n", (double)points / scans);
+    printf("  \"use_grid\": %s,\n", config.use_grid ? "true" : "false");
+    printf("  \"results\": [\n");
+    for (size_t p = 0; p < list.size(); p++) {
+        printf("    {\n");
+        printf("      \"pipeline\": \"%s\",\n", list[p]->name());
+        printf("      \"scans_per_second\": %.0f,\n", scans / (wall[p] / 1e9));
+        printf("      \"us_per_scan\": %.2f,\n", wall[p] / 1e3 / scans);
+        if (p > 0) {
+            // votes of identical zones must agree, the wristbands differ by the grid and latch
+            printf("      \"vote_mismatches\": %llu,\n", (unsigned long long)vote_mismatches[p]);
+            printf("      \"wristband_mismatches\": %llu,\n", (unsigned long long)wristband_mismatches[p]);
+        }
+        printf("      \"stages\": {\n");
+        for (size_t s = 0; s < stages[p].size(); s++) {
+            printStage(stages[p][s], scans, s + 1 == stages[p].size());
+        }
+        printf("      }\n");
+        printf("    }%s\n", p + 1 == list.size() ? "" : ",");
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
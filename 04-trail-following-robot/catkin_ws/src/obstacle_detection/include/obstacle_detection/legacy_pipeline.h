@@ -0,0 +1,114 @@
+#pragma once
+#include <math.h>
+#include <string.h>
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <laser_geometry/laser_geometry.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/filters/conditional_removal.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <pcl_ros/transforms.h>
+#include <tf/transform_datatypes.h>
+#include <obstacle_detection/obstacle_kernel.h>
+
+namespace obstacle_detection {
+
+/*
+ * The projectLaser -> ConditionalRemoval -> transform -> point_to_field chain
+ * obs_detect ran before ObstacleKernel, kept as the reference the kernel test
+ * and the replay benchmark compare against. The steps are separate so the
+ * benchmark can time them one by one; legacyVotes() runs them all.
+ */
+
+typedef pcl::PointCloud<pcl::PointXYZ> PointCloudXYZ;
+
+/** point_to_field of the original detector, the sectors it left unset count as DONT_CARE */
+inline int legacyField(float x, float y) {
+    const float PI = 3.14159265f;
+    float d = sqrt(y*y + x*x);
+    float angle = atan2(y, x) * 180 / PI;
+    int label = DONT_CARE;
+    if(d < 1){
+        if(fabsf(angle) <= 40.0f/2)
+            label = DANGER_FRONT;
+        else if(angle > 40.0f/2 && angle < 90.0f/2)
+            label = DANGER_LEFT;
+        else if(angle < -40.0f/2 && angle > -90.0f/2)
+            label = DANGER_RIGHT;
+    }
+    else if(d >= 1 && d < 1.5){
+        if(fabsf(angle) <= 40.0f/2)
+            label = UNSAFETY_FRONT;
+        else if(angle > 40.0f/2 && angle < 90.0f/2)
+            label = UNSAFETY_LEFT;
+        else if(angle < -40.0f/2 && angle > -90.0f/2)
+            label = UNSAFETY_RIGHT;
+    }
+    return label;
+}
+
+/** projectLaser and the conversion to PCL */
+inline void legacyProject(laser_geometry::LaserProjection &projector, const sensor_msgs::LaserScan &scan,
+                          PointCloudXYZ &cloud) {
+    sensor_msgs::PointCloud2 cloud_in;
+    projector.projectLaser(scan, cloud_in);
+    pcl::fromROSMsg(cloud_in, cloud);
+}
+
+/** The crop box in the laser frame, organized: removed points become NaN */
+inline void legacyCrop(const PointCloudXYZ::Ptr &cloud, PointCloudXYZ &cloud_filtered) {
+    pcl::ConditionAnd<pcl::PointXYZ>::Ptr range_cond (new pcl::ConditionAnd<pcl::PointXYZ> ());
+    range_cond->addComparison (pcl::FieldComparison<pcl::PointXYZ>::ConstPtr (new
+        pcl::FieldComparison<pcl::PointXYZ> ("x", pcl::ComparisonOps::GT, -1.5)));
+    range_cond->addComparison (pcl::FieldComparison<pcl::PointXYZ>::ConstPtr (new
+        pcl::FieldComparison<pcl::PointXYZ> ("x", pcl::ComparisonOps::LT, 0.0)));
+    range_cond->addComparison (pcl::FieldComparison<pcl::PointXYZ>::ConstPtr (new
+        pcl::FieldComparison<pcl::PointXYZ> ("y", pcl::ComparisonOps::GT, -0.8)));
+    range_cond->addComparison (pcl::FieldComparison<pcl::PointXYZ>::ConstPtr (new
+        pcl::FieldComparison<pcl::PointXYZ> ("y", pcl::ComparisonOps::LT, 0.8)));
+    pcl::ConditionalRemoval<pcl::PointXYZ> condrem;
+    condrem.setCondition (range_cond);
+    condrem.setInputCloud (cloud);
+    condrem.setKeepOrganized(true);
+    condrem.filter (cloud_filtered);
+}
+
+/** Points per field, NUM_FIELDS entries */
+inline void legacyClassify(const PointCloudXYZ &cloud, uint16_t *vote) {
+    memset(vote, 0, NUM_FIELDS * sizeof(uint16_t));
+    for (size_t i = 0; i < cloud.points.size(); i++){
+        vote[legacyField(cloud.points[i].x, cloud.points[i].y)]++;
+    }
+}
+
+/** The whole chain, tf1 is the laser mount */
+inline void legacyVotes(const sensor_msgs::LaserScan &scan, const tf::Transform &tf1, uint16_t *vote) {
+    laser_geometry::LaserProjection projector;
+    PointCloudXYZ::Ptr cloud(new PointCloudXYZ);
+    PointCloudXYZ::Ptr cloud_filtered(new PointCloudXYZ);
+    legacyProject(projector, scan, *cloud);
+    legacyCrop(cloud, *cloud_filtered);
+    pcl_ros::transformPointCloud (*cloud_filtered, *cloud_filtered, tf1);
+    legacyClassify(*cloud_filtered, vote);
+}
+
+/** Static transform of obstacle_nodelets.launch: 0.01 0 0.13, yaw 180 deg */
+inline tf::Transform launchMount() {
+    tf::Transform t;
+    t.setOrigin(tf::Vector3(0.01, 0.0, 0.13));
+    t.setRotation(tf::Quaternion(0.0, 0.0, 1.0, 0.0));
+    return t;
+}
+
+inline Affine2D toAffine(const tf::Transform &t) {
+    Affine2D a;
+    const tf::Matrix3x3 &r = t.getBasis();
+    a.xx = r[0][0]; a.xy = r[0][1];
+    a.yx = r[1][0]; a.yy = r[1][1];
+    a.x = t.getOrigin().x();
+    a.y = t.getOrigin().y();
+    return a;
+}
+
+}
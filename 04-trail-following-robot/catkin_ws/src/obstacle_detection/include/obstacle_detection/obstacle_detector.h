@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <obstacle_detection/obstacle_kernel.h>
+#include <obstacle_detection/rolling_grid.h>
+#include <obstacle_detection/zone_latch.h>
+#include <obstacle_detection/scan_segmenter.h>
+
+namespace obstacle_detection {
+
+/** The fields of a sensor_msgs/LaserScan the detector reads */
+struct ScanView {
+    const float *ranges;
+    size_t count;
+    float angle_min, angle_increment;
+    float range_min, range_max;
+    double stamp;       // [s]
+};
+
+struct DetectorConfig {
+    bool use_grid;          // decide on the occupancy grid instead of the votes of a single scan
+    int grid_min_cells;     // occupied cells that make a zone active
+    GridConfig grid;
+    LatchConfig latch;      // threshold is set from use_grid / grid_min_cells
+    SegmenterConfig segments;
+
+    DetectorConfig() : use_grid(true), grid_min_cells(3) {}
+};
+
+/** Command of one wristband, its three motors vibrate alike */
+struct WristbandCommand {
+    int16_t frequency;
+    int16_t intensity;
+};
+
+struct Detection {
+    uint16_t votes[NUM_FIELDS];         // points of this scan per field
+    uint16_t grid_votes[NUM_FIELDS];    // occupied grid cells per field, if use_grid
+    unsigned active;                    // latched zones, bit 1 << field
+    WristbandCommand left, right;
+};
+
+/**
+ * Everything between a LaserScan and the wristband command, without ROS:
+ * zone votes, occupancy grid, zone latch, haptic pattern and obstacle
+ * clusters. LaserObstacleDetection feeds it from the scan callback, the
+ * replay benchmark from recorded or synthetic scans.
+ *
+ * process() runs the stages in order, they are public to be timed one by one.
+ */
+class ObstacleDetector {
+public:
+    explicit ObstacleDetector(const DetectorConfig &config = DetectorConfig());
+
+    void setZones(const ZoneConfig &zones) { kernel_.setZones(zones); }
+    void setMount(const Affine2D &laser_to_base);
+
+    /**
+     * @param base_to_odom  pose of base_link in the odom frame, moves the grid
+     * @param kept          if not NULL, the points inside the crop box in base_link
+     */
+    const Detection &process(const ScanView &scan, const Affine2D &base_to_odom, std::vector<Point2D> *kept);
+
+    void vote(const ScanView &scan, std::vector<Point2D> *kept);
+    void updateGrid(const ScanView &scan, const Affine2D &base_to_odom);
+    void decide(double stamp);
+    void segment(const ScanView &scan);
+
+    /** Wristband pattern of the active zones */
+    static void pattern(unsigned active, WristbandCommand &left, WristbandCommand &right);
+
+    const DetectorConfig &config() const { return config_; }
+    const Detection &detection() const { return detection_; }
+    const ObstacleKernel &kernel() const { return kernel_; }
+    const RollingGrid &grid() const { return grid_; }
+    const ScanSegmenter &segmenter() const { return segmenter_; }
+    const Affine2D &mount() const { return mount_; }
+
+private:
+    DetectorConfig config_;
+    Affine2D mount_;
+    ObstacleKernel kernel_;
+    RollingGrid grid_;
+    ZoneLatch latch_;
+    ScanSegmenter segmenter_;
+    Detection detection_;
+};
+
+}
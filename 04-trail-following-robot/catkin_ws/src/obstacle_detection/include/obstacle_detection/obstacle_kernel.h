@@ -0,0 +1,122 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace obstacle_detection {
+
+enum Field {
+    DANGER_FRONT = 0,
+    DANGER_LEFT,
+    DANGER_RIGHT,
+    UNSAFETY_FRONT,
+    UNSAFETY_LEFT,
+    UNSAFETY_RIGHT,
+    DONT_CARE,
+    NUM_FIELDS
+};
+
+extern const char *const FIELD_NAMES[NUM_FIELDS];
+
+/** Detection fields in base_link, the crop box in the laser frame */
+struct ZoneConfig {
+    float danger_distance;   // [m]
+    float unsafety_distance; // [m]
+    float degree_of_view;    // full opening of the left/front/right sectors [deg]
+    float degree_of_center;  // opening of the front sector [deg]
+    float crop_x_min, crop_x_max;
+    float crop_y_min, crop_y_max;
+
+    ZoneConfig()
+        : danger_distance(1.0f), unsafety_distance(1.5f), degree_of_view(90.0f), degree_of_center(40.0f),
+          crop_x_min(-1.5f), crop_x_max(0.0f), crop_y_min(-0.8f), crop_y_max(0.8f) {}
+};
+
+/** 2D rigid transform, p' = R p + t */
+struct Affine2D {
+    float xx, xy, yx, yy;
+    float x, y;
+
+    Affine2D() : xx(1), xy(0), yx(0), yy(1), x(0), y(0) {}
+};
+
+/** a * b, b applied first */
+inline Affine2D compose(const Affine2D &a, const Affine2D &b) {
+    Affine2D c;
+    c.xx = a.xx * b.xx + a.xy * b.yx; c.xy = a.xx * b.xy + a.xy * b.yy;
+    c.yx = a.yx * b.xx + a.yy * b.yx; c.yy = a.yx * b.xy + a.yy * b.yy;
+    c.x = a.xx * b.x + a.xy * b.y + a.x;
+    c.y = a.yx * b.x + a.yy * b.y + a.y;
+    return c;
+}
+
+inline Affine2D inverse(const Affine2D &a) {
+    Affine2D c;
+    c.xx = a.xx; c.xy = a.yx;
+    c.yx = a.xy; c.yy = a.yy;
+    c.x = -(c.xx * a.x + c.xy * a.y);
+    c.y = -(c.yx * a.x + c.yy * a.y);
+    return c;
+}
+
+struct Point2D {
+    float x, y;
+};
+
+/**
+ * LaserScan ranges to zone votes in a single pass, without intermediate clouds.
+ * Along one beam the crop box, the zone circles and the sector lines are crossed
+ * at fixed ranges, so for every beam the field is a step function of the range.
+ * These per-beam range thresholds are rebuilt when the scan geometry, the
+ * transform or the zones change; classifying a point is then a compare against
+ * the thresholds of its beam, the transform is only applied for the debug cloud.
+ *
+ * Votes are the same as projectLaser -> ConditionalRemoval (organized) ->
+ * transformPointCloud -> point_to_field: every projected point gets one vote,
+ * points removed by the crop box or outside all sectors count as DONT_CARE.
+ */
+class ObstacleKernel {
+public:
+    ObstacleKernel();
+
+    /** Recomputes the beam directions when the layout changed */
+    void setGeometry(float angle_min, float angle_increment, size_t count);
+    void setTransform(const Affine2D &laser_to_base);
+    void setZones(const ZoneConfig &zones);
+
+    const ZoneConfig &zones() const { return zones_; }
+
+    /**
+     * @param votes  NUM_FIELDS counters, overwritten
+     * @param kept   if not NULL, filled with the points inside the crop box in base_link
+     */
+    void vote(const float *ranges, size_t count, float range_min, float range_max,
+              uint16_t *votes, std::vector<Point2D> *kept) const;
+
+    /** Exact field of a point in the laser frame, INSIDE_CROP set if the crop box keeps it */
+    int classify(float lx, float ly) const;
+
+    static const int INSIDE_CROP = 0x80;
+
+private:
+    /** Field of the range interval [start, end) of a beam */
+    struct Segment {
+        float end;
+        uint8_t field;
+    };
+
+    int classifyBase(float x, float y) const;
+    void rebuild();
+
+    ZoneConfig zones_;
+    Affine2D transform_;
+    float danger2_, unsafety2_;
+    float tan_center_, tan_view_;   // tan of the half openings
+
+    float angle_min_, angle_increment_;
+    std::vector<double> cos_, sin_;     // double, as in laser_geometry
+    std::vector<uint32_t> first_;       // first segment of each beam
+    std::vector<Segment> segments_;     // last segment of a beam ends at infinity
+};
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <math.h>
+#include <vector>
+#include <obstacle_detection/ObstacleArray.h>
+#include <obstacle_detection/scan_segmenter.h>
+
+namespace obstacle_detection {
+
+/**
+ * One Obstacle per cluster of the segmenter, the header is left to the
+ * caller. The obstacles of msg are reused from scan to scan.
+ */
+inline void fillObstacles(const std::vector<Cluster> &clusters, ObstacleArray &msg) {
+    msg.obstacles.resize(clusters.size());
+    for (size_t i = 0; i < clusters.size(); i++) {
+        const Cluster &c = clusters[i];
+        Obstacle &o = msg.obstacles[i];
+        o.id = c.id;
+        o.points = c.points;
+        o.nearest.x = c.nearest.x;
+        o.nearest.y = c.nearest.y;
+        o.distance = c.distance;
+        o.bearing = atan2f(c.nearest.y, c.nearest.x);
+        o.bearing_right = atan2f(c.right.y, c.right.x);
+        o.bearing_left = atan2f(c.left.y, c.left.x);
+        o.width = hypotf(c.left.x - c.right.x, c.left.y - c.right.y);
+        o.centroid.x = c.centroid.x;
+        o.centroid.y = c.centroid.y;
+        o.closing_speed = c.closing_speed;
+    }
+}
+
+}
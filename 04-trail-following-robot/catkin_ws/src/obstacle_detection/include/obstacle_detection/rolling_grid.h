@@ -0,0 +1,87 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <obstacle_detection/obstacle_kernel.h>
+
+namespace obstacle_detection {
+
+struct GridConfig {
+    int   size_log2;        // the window is 2^size_log2 cells square
+    float resolution;       // [m]
+    int   hit;              // log-odds added at a beam end
+    int   miss;             // log-odds added along a beam (negative)
+    int   occupied;         // a cell is occupied at or above this log-odds
+    float decay;            // log-odds per second every cell moves back towards 0
+    float max_range;        // beams are traced up to this range [m]
+    float change;           // a beam is traced again when its range changed more than this [m]
+
+    GridConfig()
+        : size_log2(7), resolution(0.05f), hit(24), miss(-6), occupied(40), decay(60.0f),
+          max_range(3.0f), change(0.05f) {}
+};
+
+/**
+ * Occupancy around the robot in int8 log-odds. The grid is fixed in the odom
+ * frame and addressed as a ring: world cell (x, y) lives at (x & mask, y & mask),
+ * so following the robot only clears the rows/columns entering the window.
+ *
+ * Updates are incremental: a beam whose end moved less than `change` since its
+ * last trace only reinforces its end cell, the free space along it is traced
+ * again only for beams that changed or after the laser moved.
+ */
+class RollingGrid {
+public:
+    explicit RollingGrid(const GridConfig &config = GridConfig());
+
+    void setGeometry(float angle_min, float angle_increment, size_t count);
+
+    /**
+     * @param laser_to_odom  laser pose in the odom frame at the scan
+     * @param stamp          scan time [s], drives the decay
+     */
+    void update(const float *ranges, size_t count, float range_min, float range_max,
+                const Affine2D &laser_to_odom, double stamp);
+
+    /**
+     * Occupied cells within radius of the laser counted per field, the fields
+     * as ObstacleKernel::classify gives them for the cell centres.
+     */
+    void vote(const ObstacleKernel &kernel, const Affine2D &laser_to_odom, float radius, uint16_t *votes) const;
+
+    int size() const { return size_; }
+    float resolution() const { return config_.resolution; }
+    const GridConfig &config() const { return config_; }
+    /** World cell of the lower left corner of the window */
+    int originX() const { return origin_x_; }
+    int originY() const { return origin_y_; }
+    int8_t cell(int x, int y) const { return data_[((y & mask_) << config_.size_log2) + (x & mask_)]; }
+    bool inside(int x, int y) const {
+        return x >= origin_x_ && x < origin_x_ + size_ && y >= origin_y_ && y < origin_y_ + size_;
+    }
+
+    /** Beams traced in full / only reinforced by the last update */
+    size_t traced() const { return traced_; }
+    size_t reinforced() const { return reinforced_; }
+
+private:
+    int8_t &at(int x, int y) { return data_[((y & mask_) << config_.size_log2) + (x & mask_)]; }
+    void add(int x, int y, int delta);
+    void scroll(int origin_x, int origin_y);
+    void decay(double stamp);
+    void trace(float x0, float y0, float x1, float y1, bool hit);
+
+    GridConfig config_;
+    int size_, mask_;
+    std::vector<int8_t> data_;
+    int origin_x_, origin_y_;
+    double last_stamp_;
+    float decay_carry_;
+
+    std::vector<float> cos_, sin_;
+    std::vector<float> last_range_;     // range of the last full trace per beam, 0 if none
+    Affine2D last_pose_;                // laser pose of the last full traces
+    size_t traced_, reinforced_;
+};
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <obstacle_detection/obstacle_kernel.h>
+
+namespace obstacle_detection {
+
+struct SegmenterConfig {
+    float max_range;        // beams at or beyond are not clustered [m]
+    float distance;         // fixed part of the break distance between neighbours [m]
+    float lambda;           // worst incidence angle of a surface kept in one piece [deg]
+    int   min_points;       // smaller clusters are dropped as noise
+    int   max_missing;      // invalid beams tolerated inside a cluster
+    float association;      // largest centroid motion between two scans [m]
+    float smoothing;        // weight of the newest closing speed, 1 is unfiltered
+
+    SegmenterConfig()
+        : max_range(5.0f), distance(0.1f), lambda(10.0f), min_points(3), max_missing(2),
+          association(0.5f), smoothing(0.5f) {}
+};
+
+/** A run of neighbouring beams, points in base_link */
+struct Cluster {
+    uint32_t id;            // kept while the cluster is associated from scan to scan
+    uint32_t first, last;   // beam indices, last < first when the cluster wraps around the scan
+    uint32_t points;
+    uint32_t age;           // scans it was associated over
+    Point2D nearest;        // point closest to base_link
+    float distance;         // |nearest|
+    Point2D right, left;    // first and last point in beam order
+    Point2D centroid;
+    float closing_speed;    // [m/s] positive when getting closer
+};
+
+/**
+ * One pass over the ranges in beam order: a cluster breaks where the
+ * distance between two consecutive valid points exceeds the adaptive
+ * breakpoint (Borges & Aldon) r sin(dphi) / sin(lambda - dphi) + distance,
+ * or after more than max_missing invalid beams. No neighbour search, no
+ * point copies: each beam is visited once, each cluster keeps running sums.
+ *
+ * Clusters of consecutive scans are associated by their nearest centroids,
+ * the closing speed is the rate of change of their distance.
+ */
+class ScanSegmenter {
+public:
+    explicit ScanSegmenter(const SegmenterConfig &config = SegmenterConfig());
+
+    void setConfig(const SegmenterConfig &config);
+    void setGeometry(float angle_min, float angle_increment, size_t count);
+    void setTransform(const Affine2D &laser_to_base) { transform_ = laser_to_base; }
+
+    /** @param stamp  scan time [s] */
+    const std::vector<Cluster> &segment(const float *ranges, size_t count, float range_min, float range_max,
+                                        double stamp);
+
+    const std::vector<Cluster> &clusters() const { return clusters_; }
+
+private:
+    bool connected(float r0, float x0, float y0, float r1, float x1, float y1, size_t gap) const;
+    void add(Cluster &c, float lx, float ly, Point2D &sum) const;
+    void merge(Cluster &into, const Cluster &from, Point2D &sum, const Point2D &from_sum) const;
+    void associate(double stamp);
+
+    SegmenterConfig config_;
+    Affine2D transform_;
+    float angle_increment_;
+    bool full_circle_;
+    std::vector<float> cos_, sin_;
+    std::vector<float> break_factor_;   // sin(g dphi) / sin(lambda - g dphi) per gap of g beams
+    std::vector<Cluster> clusters_, previous_;
+    std::vector<Point2D> sums_;
+    std::vector<uint8_t> used_;
+    double last_stamp_;
+    uint32_t next_id_;
+};
+
+}
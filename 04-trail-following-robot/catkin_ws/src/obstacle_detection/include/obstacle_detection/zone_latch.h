@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <obstacle_detection/obstacle_kernel.h>
+
+namespace obstacle_detection {
+
+struct LatchConfig {
+    int    threshold;       // a zone turns on above this count
+    int    hysteresis;      // and off again at or below threshold - hysteresis
+    double min_on;          // [s] an active zone is held at least this long
+    double min_off;         // [s] a released zone stays off at least this long
+
+    LatchConfig() : threshold(30), hysteresis(1), min_on(0.3), min_off(0.2) {}
+};
+
+/**
+ * Per-zone on/off state from the vote (or grid cell) counts of successive
+ * scans. Hysteresis and the minimum on/off times keep a count hovering
+ * around the threshold from toggling the wristbands scan by scan.
+ */
+class ZoneLatch {
+public:
+    explicit ZoneLatch(const LatchConfig &config = LatchConfig());
+
+    void setConfig(const LatchConfig &config) { config_ = config; }
+    const LatchConfig &config() const { return config_; }
+
+    /**
+     * @param counts  NUM_FIELDS counters, DONT_CARE is ignored
+     * @param now     [s]
+     * @return the active zones, bit 1 << field
+     */
+    unsigned update(const uint16_t *counts, double now);
+
+    unsigned active() const { return active_; }
+
+private:
+    LatchConfig config_;
+    unsigned active_;
+    double changed_[DONT_CARE];     // time of the last switch per zone
+};
+
+}
@@ -2,36 +2,41 @@
 #include <iostream>
 #include <math.h>
 #include <stdlib.h>
+#include <atomic>
+#include <boost/thread/mutex.hpp>
 #include <ros/ros.h>
 #include <ros/console.h>
+#include <nodelet/nodelet.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <sensor_msgs/LaserScan.h>
 #include <sensor_msgs/Range.h>
 #include <pcl_ros/point_cloud.h>
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
-#include <pcl/filters/conditional_removal.h>
 #include <pcl_conversions/pcl_conversions.h>
-#include <pcl_ros/transforms.h> 
-#include <laser_geometry/laser_geometry.h>
 #include <tf/transform_listener.h>
-#include <tf/message_filter.h>
-#include <message_filters/subscriber.h>
+#include <tf2_msgs/TFMessage.h>
+#include <dynamic_reconfigure/server.h>
+#include <obstacle_detection/ObstacleDetectionConfig.h>
 #include <haptic_msgs/Wristband.h>
 #include <haptic_msgs/VibrationArray.h>
 #include <haptic_msgs/Vibration.h>
 #include <std_msgs/Int32.h>
+#include <ydlidar/tracer.h>
+#include <obstacle_detection/obstacle_detector.h>
+#include <obstacle_detection/ObstacleArray.h>
+#include <obstacle_detection/obstacle_messages.h>
 
 #define PI 3.14159265f
-#define DEGREE_OF_VIEW 90.0f
-#define DEGREE_OF_CENTER 40.0f
-#define DANGER_DISTANCE 1
-#define UNSAFETY_DISTANCE 1.5
 #define NUM_MOTORS 3
+// rosserial frame around a message: sync, version, length + checksum, topic id, checksum
+#define ROSSERIAL_FRAME 8
 
 
 using namespace std;
 
+namespace obstacle_detection {
+
 typedef pcl::PointCloud<pcl::PointXYZ> PointCloudXYZ;
 
 class LaserObstacleDetection{
@@ -41,45 +46,91 @@ class LaserObstacleDetection{
     ros::Publisher pub_cloud_;
     ros::Publisher pub_range_;
     ros::Publisher pub_wristband_;
+    ros::Publisher pub_obstacles_;
     ros::Subscriber sub_laser_;
-    laser_geometry::LaserProjection projector_;
+    ros::Subscriber sub_tf_static_;
     tf::TransformListener listener_;
     sensor_msgs::Range detection_range;
     haptic_msgs::Wristband wmsg;
 
-    enum FILED{
-        DANGER_FRONT= 0,
-        DANGER_LEFT,
-        DANGER_RIGHT,
-        UNSAFETY_FRONT,
-        UNSAFETY_LEFT,
-        UNSAFETY_RIGHT,
-        DONT_CARE,
-    };
-
-    const std::string FILED_NAMES[7] = {"DANGER_FRONT",
-        "DANGER_LEFT",
-        "DANGER_RIGHT",
-        "UNSAFETY_FRONT",
-        "UNSAFETY_LEFT",
-        "UNSAFETY_RIGHT",
-        "DONT_CARE"
-    };
-    
+    // zone votes, occupancy grid, latch and clusters, ROS-free
+    boost::shared_ptr<ObstacleDetector> detector_;
+    bool has_mount_;
+    std::string mount_frame_;
+    Affine2D mount_;
+    // the mount is looked up again on every scan until then [ns], set when /tf_static changes
+    std::atomic<uint64_t> mount_refresh_until_;
+    // debug cloud, only filled while pub_cloud_ has subscribers
+    std::vector<Point2D> kept_;
+    PointCloudXYZ::Ptr cloud_;
+    // zones from dynamic_reconfigure, applied by the scan callback
+    boost::shared_ptr<dynamic_reconfigure::Server<ObstacleDetectionConfig> > dyn_srv_;
+    boost::mutex zones_mutex_;
+    ZoneConfig pending_zones_;
+    bool zones_pending_;
+    // the grid follows base_link in this frame
+    std::string odom_frame_;
+    // wristbands are only sent on a change of the pattern, plus a heartbeat
+    haptic_msgs::Wristband last_sent_;
+    ros::Time last_sent_time_;
+    double heartbeat_period_;
+    double stats_period_;
+    ros::Time stats_start_;
+    uint32_t stats_scans_, stats_changes_, stats_heartbeats_;
+    ObstacleArray obstacles_;
+
+    LaserObstacleDetection(ros::NodeHandle n, ros::NodeHandle pn): nh_(n), has_mount_(false), mount_refresh_until_(0),
+        cloud_(new PointCloudXYZ), zones_pending_(false), stats_scans_(0), stats_changes_(0), stats_heartbeats_(0){
+        DetectorConfig config;
+        GridConfig &grid = config.grid;
+        LatchConfig &latch = config.latch;
+        SegmenterConfig &segments = config.segments;
+        double value;
+        pn.param<bool>("use_grid", config.use_grid, config.use_grid);
+        pn.param<std::string>("odom_frame", odom_frame_, "odom");
+        pn.param<int>("grid_size_log2", grid.size_log2, grid.size_log2);
+        pn.param<double>("grid_resolution", value, grid.resolution);
+        grid.resolution = value;
+        pn.param<int>("grid_hit", grid.hit, grid.hit);
+        pn.param<int>("grid_miss", grid.miss, grid.miss);
+        pn.param<int>("grid_occupied", grid.occupied, grid.occupied);
+        pn.param<double>("grid_decay", value, grid.decay);
+        grid.decay = value;
+        pn.param<double>("grid_max_range", value, grid.max_range);
+        grid.max_range = value;
+        pn.param<int>("grid_min_cells", config.grid_min_cells, config.grid_min_cells);
+
+        pn.param<int>("zone_hysteresis", latch.hysteresis, latch.hysteresis);
+        pn.param<double>("min_on_time", latch.min_on, latch.min_on);
+        pn.param<double>("min_off_time", latch.min_off, latch.min_off);
+        pn.param<double>("heartbeat_period", heartbeat_period_, 1.0);
+        pn.param<double>("stats_period", stats_period_, 60.0);
+
+        pn.param<double>("cluster_max_range", value, segments.max_range);
+        segments.max_range = value;
+        pn.param<double>("cluster_distance", value, segments.distance);
+        segments.distance = value;
+        pn.param<double>("cluster_lambda", value, segments.lambda);
+        segments.lambda = value;
+        pn.param<int>("cluster_min_points", segments.min_points, segments.min_points);
+        pn.param<int>("cluster_max_missing", segments.max_missing, segments.max_missing);
+        pn.param<double>("cluster_association", value, segments.association);
+        segments.association = value;
+        pn.param<double>("cluster_smoothing", value, segments.smoothing);
+        segments.smoothing = value;
+        detector_.reset(new ObstacleDetector(config));
+        obstacles_.header.frame_id = "base_link";
 
-    LaserObstacleDetection(ros::NodeHandle n): nh_(n){
         // ROS subscriber
-        sub_laser_ = nh_.subscribe<sensor_msgs::LaserScan>("scan", 1, &LaserObstacleDetection::laserscan_cb, this);
+        sub_tf_static_ = nh_.subscribe<tf2_msgs::TFMessage>("/tf_static", 10, &LaserObstacleDetection::tf_static_cb, this);
         // ROS publisher
         pub_cloud_ = nh_.advertise<sensor_msgs::PointCloud2> ("cloud", 1);
         pub_range_ = nh_.advertise<sensor_msgs::Range> ("detection_field", 1);
         pub_wristband_ = nh_.advertise<haptic_msgs::Wristband> ("wristbands_vbmsg", 1);
+        pub_obstacles_ = nh_.advertise<ObstacleArray> ("obstacles", 1);
         detection_range.header.frame_id = "laser_frame";
         detection_range.radiation_type = sensor_msgs::Range::INFRARED;
-        detection_range.field_of_view = DEGREE_OF_VIEW * PI / 180.0;
         detection_range.min_range = 0.1;
-        detection_range.max_range = UNSAFETY_DISTANCE;
-        detection_range.range = UNSAFETY_DISTANCE;
 
         // Initialize Wristband message
         // solution ref: https://answers.ros.org/question/273480/publish-and-subscribe-array-of-vector-as-message/
@@ -88,174 +139,262 @@ class LaserObstacleDetection{
             wmsg.left.motors.push_back(v);
             wmsg.right.motors.push_back(v);
         }
+        last_sent_ = wmsg;
+
+        // the server calls configCallback once with the params (or cfg defaults) before returning
+        dyn_srv_.reset(new dynamic_reconfigure::Server<ObstacleDetectionConfig>(pn));
+        dyn_srv_->setCallback(boost::bind(&LaserObstacleDetection::configCallback, this, _1, _2));
+        apply_zones();
+        sub_laser_ = nh_.subscribe<sensor_msgs::LaserScan>("scan", 1, &LaserObstacleDetection::laserscan_cb, this);
     }
 
-    uint16_t point_to_field(float x, float y){
-        float d = sqrt(y*y + x*x);
-        float angle = atan2(y, x) * 180 / PI;
-        FILED label;
-        if(d < DANGER_DISTANCE){
-            if(abs(angle) <= DEGREE_OF_CENTER/2)
-                label = DANGER_FRONT; 
-            else if(angle > DEGREE_OF_CENTER/2 && angle < DEGREE_OF_VIEW/2)
-                label = DANGER_LEFT;
-            else if(angle < -DEGREE_OF_CENTER/2 && angle > -DEGREE_OF_VIEW/2)
-                label = DANGER_RIGHT;          
-        }
-        else if(d >= DANGER_DISTANCE && d < UNSAFETY_DISTANCE){
-            if(abs(angle) <= DEGREE_OF_CENTER/2)
-                label = UNSAFETY_FRONT; 
-            else if(angle > DEGREE_OF_CENTER/2 && angle < DEGREE_OF_VIEW/2)
-                label = UNSAFETY_LEFT;
-            else if(angle < -DEGREE_OF_CENTER/2 && angle > -DEGREE_OF_VIEW/2)
-                label = UNSAFETY_RIGHT;
+    void configCallback(ObstacleDetectionConfig &config, uint32_t level){
+        if(config.unsafety_distance < config.danger_distance)
+            config.unsafety_distance = config.danger_distance;
+        if(config.degree_of_view < config.degree_of_center)
+            config.degree_of_view = config.degree_of_center;
+        boost::mutex::scoped_lock lock(zones_mutex_);
+        pending_zones_.danger_distance = config.danger_distance;
+        pending_zones_.unsafety_distance = config.unsafety_distance;
+        pending_zones_.degree_of_view = config.degree_of_view;
+        pending_zones_.degree_of_center = config.degree_of_center;
+        pending_zones_.crop_x_min = config.crop_x_min;
+        pending_zones_.crop_x_max = config.crop_x_max;
+        pending_zones_.crop_y_min = config.crop_y_min;
+        pending_zones_.crop_y_max = config.crop_y_max;
+        zones_pending_ = true;
+    }
+
+    /** New zones rebuild the per-beam thresholds, done between two scans */
+    void apply_zones(){
+        ZoneConfig zones;
+        {
+            boost::mutex::scoped_lock lock(zones_mutex_);
+            if(!zones_pending_)
+                return;
+            zones = pending_zones_;
+            zones_pending_ = false;
         }
-        else
-            label = DONT_CARE;
+        detector_->setZones(zones);
+        detection_range.field_of_view = zones.degree_of_view * PI / 180.0;
+        detection_range.max_range = zones.unsafety_distance;
+        detection_range.range = zones.unsafety_distance;
+    }
 
-        return label;
+    /**
+     * A new static transform may move the laser. The listener_ buffer gets the
+     * same message on its own thread, so the mount is re-read for a second
+     * instead of once, never waiting inside the scan callback.
+     */
+    void tf_static_cb(const tf2_msgs::TFMessage::ConstPtr& msg){
+        mount_refresh_until_ = (ros::Time::now() + ros::Duration(1.0)).toNSec();
     }
 
-    void laserscan_cb(const sensor_msgs::LaserScan::ConstPtr& scan_in){
-        sensor_msgs::PointCloud2 cloud_in;
-        PointCloudXYZ::Ptr cloud(new PointCloudXYZ);
-        PointCloudXYZ::Ptr cloud_filtered(new PointCloudXYZ);
-        
-        // Convert laser scan data to pointcloud
-        projector_.projectLaser (*scan_in, cloud_in);
-        pcl::fromROSMsg(cloud_in, *cloud);
-
-        // Filter point cloud by specific 
-        pcl::ConditionAnd<pcl::PointXYZ>::Ptr range_cond (new pcl::ConditionAnd<pcl::PointXYZ> ());
-        range_cond->addComparison (pcl::FieldComparison<pcl::PointXYZ>::ConstPtr (new
-            pcl::FieldComparison<pcl::PointXYZ> ("x", pcl::ComparisonOps::GT, -1.5)));
-        range_cond->addComparison (pcl::FieldComparison<pcl::PointXYZ>::ConstPtr (new
-            pcl::FieldComparison<pcl::PointXYZ> ("x", pcl::ComparisonOps::LT, 0.0)));
-        range_cond->addComparison (pcl::FieldComparison<pcl::PointXYZ>::ConstPtr (new
-            pcl::FieldComparison<pcl::PointXYZ> ("y", pcl::ComparisonOps::GT, -0.8)));
-        range_cond->addComparison (pcl::FieldComparison<pcl::PointXYZ>::ConstPtr (new
-            pcl::FieldComparison<pcl::PointXYZ> ("y", pcl::ComparisonOps::LT, 0.8)));
-        // Build the filter
-        pcl::ConditionalRemoval<pcl::PointXYZ> condrem;
-        condrem.setCondition (range_cond);
-        condrem.setInputCloud (cloud);
-        condrem.setKeepOrganized(true);
-        // Apply filter
-        condrem.filter (*cloud_filtered);
-        
-
-        
-        // Transform pointcloud to base_link view
-        tf::TransformListener listener;
+    /** base_link <- laser_frame as a 2D affine, cached until /tf_static changes */
+    bool lookup_mount(const std::string &laser_frame){
+        bool refresh = ros::Time::now().toNSec() < mount_refresh_until_;
+        if(has_mount_ && mount_frame_ == laser_frame && !refresh)
+            return true;
         tf::StampedTransform tf1;
         try{
-            listener.waitForTransform("base_link", "laser_frame", ros::Time(0), ros::Duration(10.0) );
-            listener.lookupTransform("base_link", "laser_frame", ros::Time(0), tf1);
+            if(!listener_.canTransform("base_link", laser_frame, ros::Time(0))){
+                ROS_WARN_THROTTLE(5.0, "waiting for transform base_link -> %s", laser_frame.c_str());
+                // keep the last mount of this frame rather than dropping scans
+                return has_mount_ && mount_frame_ == laser_frame;
+            }
+            listener_.lookupTransform("base_link", laser_frame, ros::Time(0), tf1);
         }
-        catch (tf::TransformException ex){
-            ROS_ERROR("%s",ex.what());
-            ros::Duration(1.0).sleep();
-            return;
+        catch (const tf::TransformException& ex){
+            ROS_ERROR_THROTTLE(5.0, "%s", ex.what());
+            return has_mount_ && mount_frame_ == laser_frame;
         }
-        
-        pcl_ros::transformPointCloud (*cloud_filtered, *cloud_filtered, tf1);
-
+        Affine2D mount;
+        const tf::Matrix3x3 &r = tf1.getBasis();
+        mount.xx = r[0][0]; mount.xy = r[0][1];
+        mount.yx = r[1][0]; mount.yy = r[1][1];
+        mount.x = tf1.getOrigin().x();
+        mount.y = tf1.getOrigin().y();
+        if(!has_mount_ || mount_frame_ != laser_frame || memcmp(&mount, &mount_, sizeof(mount)) != 0){
+            ROS_INFO("laser mount base_link -> %s: x %.3f y %.3f yaw %.3f", laser_frame.c_str(),
+                mount.x, mount.y, tf::getYaw(tf1.getRotation()));
+            mount_ = mount;
+            mount_frame_ = laser_frame;
+            detector_->setMount(mount_);
+        }
+        has_mount_ = true;
+        return true;
+    }
 
-        uint16_t vote[7] = {0};
-        for (int i = 0; i < cloud_filtered->points.size(); i++){
-            int idx = point_to_field(cloud_filtered->points[i].x, cloud_filtered->points[i].y);
-            vote[idx]++;
+    /**
+     * base_link in the odom frame when an odometry (laser_odometry) publishes it,
+     * else the grid stays where it is and only a standing robot is tracked right.
+     */
+    Affine2D lookup_base(){
+        Affine2D base;
+        tf::StampedTransform tf1;
+        try{
+            if(!listener_.canTransform(odom_frame_, "base_link", ros::Time(0))){
+                ROS_WARN_THROTTLE(30.0, "no transform %s -> base_link, the obstacle grid does not follow the robot",
+                    odom_frame_.c_str());
+                return base;
+            }
+            listener_.lookupTransform(odom_frame_, "base_link", ros::Time(0), tf1);
         }
-        for(int i=0; i < 7; i++){
-            if(i==3) cout << "\n";
-            cout << "[" << FILED_NAMES[i] << "]:" << vote[i] << ",\t";
+        catch (const tf::TransformException& ex){
+            ROS_ERROR_THROTTLE(5.0, "%s", ex.what());
+            return base;
         }
-        cout << "\n======================" << endl;
+        const tf::Matrix3x3 &r = tf1.getBasis();
+        base.xx = r[0][0]; base.xy = r[0][1];
+        base.yx = r[1][0]; base.yy = r[1][1];
+        base.x = tf1.getOrigin().x();
+        base.y = tf1.getOrigin().y();
+        return base;
+    }
 
-        // wmsg.left = (haptic_msgs::VibrationArray*)malloc(NUM_MOTORS * sizeof(haptic_msgs::Vibration));
-        // wmsg.right = (haptic_msgs::VibrationArray*)malloc(NUM_MOTORS * sizeof(haptic_msgs::Vibration));
+    void laserscan_cb(const sensor_msgs::LaserScan::ConstPtr& scan_in){
+        YDLIDAR_TRACE_SCOPE(ydlidar::TRACE_OBSTACLE, "laserscan_cb");
+        apply_zones();
+        if(!lookup_mount(scan_in->header.frame_id))
+            return;
 
-        for(int i = 0; i < NUM_MOTORS; i++){
-            wmsg.left.motors[i].frequency = 0;
-            wmsg.left.motors[i].intensity = 0;
-            wmsg.right.motors[i].frequency = 0;
-            wmsg.right.motors[i].intensity = 0;
+        bool debug_cloud = pub_cloud_.getNumSubscribers() > 0;
+        ScanView scan;
+        scan.ranges = scan_in->ranges.empty() ? NULL : &scan_in->ranges[0];
+        scan.count = scan_in->ranges.size();
+        scan.angle_min = scan_in->angle_min;
+        scan.angle_increment = scan_in->angle_increment;
+        scan.range_min = scan_in->range_min;
+        scan.range_max = scan_in->range_max;
+        scan.stamp = scan_in->header.stamp.toSec();
+        const Detection &d = detector_->process(scan,
+            detector_->config().use_grid ? lookup_base() : Affine2D(), debug_cloud ? &kept_ : NULL);
+        const uint16_t *vote = d.votes;
+
+        // The vote table goes through the trace ring (or debug log), never a flushed stdout
+        if(ydlidar::Tracer::instance().enabled(ydlidar::TRACE_OBSTACLE)){
+            YDLIDAR_TRACE_LOG(ydlidar::TRACE_OBSTACLE,
+                "[%s]:%u,\t[%s]:%u,\t[%s]:%u,\t\n[%s]:%u,\t[%s]:%u,\t[%s]:%u,\t[%s]:%u,\t\n======================\n",
+                FIELD_NAMES[0], vote[0], FIELD_NAMES[1], vote[1], FIELD_NAMES[2], vote[2],
+                FIELD_NAMES[3], vote[3], FIELD_NAMES[4], vote[4], FIELD_NAMES[5], vote[5],
+                FIELD_NAMES[6], vote[6]);
+        }
+        else{
+            ROS_DEBUG("votes F/L/R danger %u/%u/%u unsafety %u/%u/%u dont care %u",
+                vote[0], vote[1], vote[2], vote[3], vote[4], vote[5], vote[6]);
+            if(detector_->config().use_grid)
+                ROS_DEBUG("grid cells F/L/R danger %u/%u/%u unsafety %u/%u/%u, %zu beams traced %zu reinforced",
+                    d.grid_votes[0], d.grid_votes[1], d.grid_votes[2], d.grid_votes[3], d.grid_votes[4],
+                    d.grid_votes[5], detector_->grid().traced(), detector_->grid().reinforced());
         }
-        for (int i = 0; i < 6; i++){
-            if(vote[i] > 30){
-                switch(i){
-                    case 0:
-                        for(int j = 0; j < 3; j++){
-                            wmsg.left.motors[j].frequency = 3;
-                            wmsg.left.motors[j].intensity = 5;
-                            wmsg.right.motors[j].frequency = 3;
-                            wmsg.right.motors[j].intensity = 5;
-                        }
-                        break;
-                    case 1:
-                        for(int j = 0; j < 3; j++){
-                            wmsg.left.motors[j].frequency = 5;
-                            wmsg.left.motors[j].intensity = 5;
-                        }
-                        break;
-                    case 2:
-                        for(int j = 0; j < 3; j++){
-                            wmsg.right.motors[j].frequency = 5;
-                            wmsg.right.motors[j].intensity = 5;
-                        }
-                        break;
-                    case 3:
-                        if(wmsg.left.motors[0].frequency != 0 && wmsg.right.motors[0].frequency != 0)
-                            break;
-                        else{
-                            for(int j = 0; j < 3; j++){
-                                wmsg.left.motors[j].frequency = 1;
-                                wmsg.left.motors[j].intensity = 3;
-                                wmsg.right.motors[j].frequency = 1;
-                                wmsg.right.motors[j].intensity = 3;
-                            }
-                        }
-                        break;
-                    case 4:
-                        if(wmsg.left.motors[0].frequency != 0)
-                            break;
-                        else{
-                            for(int j = 0; j < 3; j++){
-                                wmsg.left.motors[j].frequency = 3;
-                                wmsg.left.motors[j].intensity = 3;
-                            }
-                        }
-                        break;
-                    case 5:
-                        if(wmsg.right.motors[0].frequency != 0)
-                            break;
-                        else{
-                            for(int j = 0; j < 3; j++){
-                                wmsg.right.motors[j].frequency = 3;
-                                wmsg.right.motors[j].intensity = 3;
-                            }
-                        }
-                        break;
-                    default: break;
-                }
-            }     
+
+        for(int i = 0; i < NUM_MOTORS; i++){
+            wmsg.left.motors[i].frequency = d.left.frequency;
+            wmsg.left.motors[i].intensity = d.left.intensity;
+            wmsg.right.motors[i].frequency = d.right.frequency;
+            wmsg.right.motors[i].intensity = d.right.intensity;
         }
 
         // Publish the data
-        pub_cloud_.publish(*cloud_filtered);
+        if(debug_cloud){
+            cloud_->points.resize(kept_.size());
+            for(size_t i = 0; i < kept_.size(); i++){
+                cloud_->points[i].x = kept_[i].x;
+                cloud_->points[i].y = kept_[i].y;
+                cloud_->points[i].z = 0;
+            }
+            cloud_->width = kept_.size();
+            cloud_->height = 1;
+            cloud_->header.frame_id = "base_link";
+            pcl_conversions::toPCL(scan_in->header.stamp, cloud_->header.stamp);
+            pub_cloud_.publish(*cloud_);
+        }
+
+        if(pub_obstacles_.getNumSubscribers() > 0)
+            publish_obstacles(scan_in->header.stamp);
 
         detection_range.header.stamp = ros::Time::now();
         pub_range_.publish(detection_range);
-        pub_wristband_.publish(wmsg);
+        {
+            YDLIDAR_TRACE_SCOPE(ydlidar::TRACE_OBSTACLE, "publish");
+            publish_wristbands(scan_in->header.stamp);
+        }
+    }
+
+    void publish_obstacles(const ros::Time &stamp){
+        obstacles_.header.stamp = stamp;
+        fillObstacles(detector_->segmenter().clusters(), obstacles_);
+        pub_obstacles_.publish(obstacles_);
+    }
+
+    static bool same_motors(const haptic_msgs::VibrationArray &a, const haptic_msgs::VibrationArray &b){
+        if(a.motors.size() != b.motors.size())
+            return false;
+        for(size_t i = 0; i < a.motors.size(); i++){
+            if(a.motors[i].frequency != b.motors[i].frequency || a.motors[i].intensity != b.motors[i].intensity)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * Both NodeMCUs get every message over rosserial TCP, so wmsg is only sent
+     * when the pattern changed, and again after heartbeat_period to resync a
+     * wristband that reconnected and to keep its command timeout from expiring.
+     */
+    void publish_wristbands(const ros::Time &stamp){
+        bool changed = !same_motors(wmsg.left, last_sent_.left) || !same_motors(wmsg.right, last_sent_.right);
+        bool heartbeat = last_sent_time_.isZero() || stamp < last_sent_time_ ||
+            (stamp - last_sent_time_).toSec() >= heartbeat_period_;
+        if(changed || heartbeat){
+            pub_wristband_.publish(wmsg);
+            last_sent_ = wmsg;
+            last_sent_time_ = stamp;
+            if(changed)
+                stats_changes_++;
+            else
+                stats_heartbeats_++;
+        }
+
+        stats_scans_++;
+        if(stats_start_.isZero() || stamp < stats_start_)
+            stats_start_ = stamp;
+        if(stats_period_ > 0 && (stamp - stats_start_).toSec() >= stats_period_){
+            uint32_t sent = stats_changes_ + stats_heartbeats_;
+            uint32_t frame = ros::serialization::serializationLength(wmsg) + ROSSERIAL_FRAME;
+            ROS_INFO("wristbands_vbmsg: %u of %u scans sent (%u changes, %u heartbeats), "
+                "%.1f of %.1f kB per wristband, %.0f%% less airtime",
+                sent, stats_scans_, stats_changes_, stats_heartbeats_,
+                sent * frame / 1024.0, stats_scans_ * frame / 1024.0,
+                100.0 * (stats_scans_ - sent) / stats_scans_);
+            stats_start_ = stamp;
+            stats_scans_ = stats_changes_ = stats_heartbeats_ = 0;
+        }
+    }
+};
+
+
+/**
+ * Nodelet wrapper: loaded into the same manager as the lidar driver the
+ * scan arrives as a shared pointer, without serialization.
+ */
+class LaserObstacleDetectionNodelet: public nodelet::Nodelet {
+    boost::shared_ptr<LaserObstacleDetection> detector_;
+
+    virtual void onInit(){
+        ros::NodeHandle &nh_private = getPrivateNodeHandle();
+        int trace_mask;
+        std::string trace_file;
+        nh_private.param<int>("trace_mask", trace_mask, 0);
+        nh_private.param<std::string>("trace_file", trace_file, "");
+        if(trace_mask != 0 && !ydlidar::Tracer::instance().enable(trace_mask, trace_file.c_str())){
+            NODELET_ERROR_STREAM("cannot open trace file " << trace_file);
+        }
+        detector_.reset(new LaserObstacleDetection(getNodeHandle(), nh_private));
     }
 };
 
+} // namespace
 
-int main(int argc, char** argv)
-{
-    ros::init(argc, argv, "sub_pcl");
-    ros::NodeHandle nh;
-    LaserObstacleDetection obj(nh);
-    ros::spin();
-    return 0;
-}
\ No newline at end of file
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(obstacle_detection::LaserObstacleDetectionNodelet, nodelet::Nodelet)
@@ -0,0 +1,101 @@
+#include <obstacle_detection/obstacle_detector.h>
+#include <math.h>
+#include <string.h>
+
+namespace obstacle_detection {
+
+ObstacleDetector::ObstacleDetector(const DetectorConfig &config)
+    : config_(config), grid_(config.grid), segmenter_(config.segments) {
+    // counts are grid cells or, without the grid, votes of the last scan
+    config_.latch.threshold = config_.use_grid ? config_.grid_min_cells - 1 : 30;
+    latch_.setConfig(config_.latch);
+    memset(&detection_, 0, sizeof(detection_));
+}
+
+void ObstacleDetector::setMount(const Affine2D &laser_to_base) {
+    mount_ = laser_to_base;
+    kernel_.setTransform(mount_);
+    segmenter_.setTransform(mount_);
+}
+
+const Detection &ObstacleDetector::process(const ScanView &scan, const Affine2D &base_to_odom,
+                                           std::vector<Point2D> *kept) {
+    vote(scan, kept);
+    if (config_.use_grid) {
+        updateGrid(scan, base_to_odom);
+    }
+    decide(scan.stamp);
+    segment(scan);
+    return detection_;
+}
+
+void ObstacleDetector::vote(const ScanView &scan, std::vector<Point2D> *kept) {
+    kernel_.setGeometry(scan.angle_min, scan.angle_increment, scan.count);
+    kernel_.vote(scan.ranges, scan.count, scan.range_min, scan.range_max, detection_.votes, kept);
+}
+
+void ObstacleDetector::updateGrid(const ScanView &scan, const Affine2D &base_to_odom) {
+    Affine2D laser_to_odom = compose(base_to_odom, mount_);
+    grid_.setGeometry(scan.angle_min, scan.angle_increment, scan.count);
+    grid_.update(scan.ranges, scan.count, scan.range_min, scan.range_max, laser_to_odom, scan.stamp);
+    float radius = kernel_.zones().unsafety_distance + hypotf(mount_.x, mount_.y) + grid_.resolution();
+    grid_.vote(kernel_, laser_to_odom, radius, detection_.grid_votes);
+}
+
+void ObstacleDetector::decide(double stamp) {
+    // the haptic zones follow the grid cells, a single noisy scan neither starts nor stops them
+    detection_.active = latch_.update(config_.use_grid ? detection_.grid_votes : detection_.votes, stamp);
+    pattern(detection_.active, detection_.left, detection_.right);
+}
+
+void ObstacleDetector::segment(const ScanView &scan) {
+    segmenter_.setGeometry(scan.angle_min, scan.angle_increment, scan.count);
+    segmenter_.segment(scan.ranges, scan.count, scan.range_min, scan.range_max, scan.stamp);
+}
+
+/** The zones in field order, a later zone only fills a side the earlier ones left still */
+void ObstacleDetector::pattern(unsigned active, WristbandCommand &left, WristbandCommand &right) {
+    const WristbandCommand off = {0, 0};
+    left = right = off;
+    for (int i = 0; i < DONT_CARE; i++) {
+        if (!(active & (1u << i))) {
+            continue;
+        }
+        switch (i) {
+        case DANGER_FRONT:
+            left.frequency = right.frequency = 3;
+            left.intensity = right.intensity = 5;
+            break;
+        case DANGER_LEFT:
+            left.frequency = 5;
+            left.intensity = 5;
+            break;
+        case DANGER_RIGHT:
+            right.frequency = 5;
+            right.intensity = 5;
+            break;
+        case UNSAFETY_FRONT:
+            if (left.frequency == 0 || right.frequency == 0) {
+                left.frequency = right.frequency = 1;
+                left.intensity = right.intensity = 3;
+            }
+            break;
+        case UNSAFETY_LEFT:
+            if (left.frequency == 0) {
+                left.frequency = 3;
+                left.intensity = 3;
+            }
+            break;
+        case UNSAFETY_RIGHT:
+            if (right.frequency == 0) {
+                right.frequency = 3;
+                right.intensity = 3;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+}
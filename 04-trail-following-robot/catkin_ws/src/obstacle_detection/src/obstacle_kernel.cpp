@@ -0,0 +1,201 @@
+#include <obstacle_detection/obstacle_kernel.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+namespace obstacle_detection {
+
+const char *const FIELD_NAMES[NUM_FIELDS] = {
+    "DANGER_FRONT",
+    "DANGER_LEFT",
+    "DANGER_RIGHT",
+    "UNSAFETY_FRONT",
+    "UNSAFETY_LEFT",
+    "UNSAFETY_RIGHT",
+    "DONT_CARE"
+};
+
+namespace {
+
+/** Ranges this close to a threshold are classified exactly, float rounding may put them on either side */
+const float GUARD = 1e-4f;
+
+inline void addBreak(std::vector<double> &breaks, double r) {
+    if (r > 0 && r < 1e6) {
+        breaks.push_back(r);
+    }
+}
+
+}
+
+ObstacleKernel::ObstacleKernel() : angle_min_(0), angle_increment_(0) {
+    setZones(ZoneConfig());
+}
+
+void ObstacleKernel::setZones(const ZoneConfig &zones) {
+    zones_ = zones;
+    danger2_ = zones.danger_distance * zones.danger_distance;
+    unsafety2_ = zones.unsafety_distance * zones.unsafety_distance;
+    // the sectors are in front of the robot, half openings below 90 degrees
+    tan_center_ = tan(zones.degree_of_center / 2 * M_PI / 180.0);
+    tan_view_ = tan(zones.degree_of_view / 2 * M_PI / 180.0);
+    rebuild();
+}
+
+void ObstacleKernel::setTransform(const Affine2D &laser_to_base) {
+    transform_ = laser_to_base;
+    rebuild();
+}
+
+void ObstacleKernel::setGeometry(float angle_min, float angle_increment, size_t count) {
+    if (angle_min == angle_min_ && angle_increment == angle_increment_ && count == cos_.size()) {
+        return;
+    }
+    angle_min_ = angle_min;
+    angle_increment_ = angle_increment;
+    cos_.resize(count);
+    sin_.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        // same beam directions as laser_geometry::LaserProjection
+        double angle = angle_min + (double)i * angle_increment;
+        cos_[i] = cos(angle);
+        sin_[i] = sin(angle);
+    }
+    rebuild();
+}
+
+void ObstacleKernel::rebuild() {
+    const ZoneConfig &z = zones_;
+    const Affine2D &t = transform_;
+    double sector[] = {0.0, z.degree_of_center / 2, -z.degree_of_center / 2,
+                       z.degree_of_view / 2, -z.degree_of_view / 2, 90.0};
+    std::vector<double> breaks;
+    first_.resize(cos_.size() + 1);
+    segments_.clear();
+
+    for (size_t i = 0; i < cos_.size(); i++) {
+        first_[i] = segments_.size();
+        double c = cos_[i], s = sin_[i];
+        breaks.clear();
+        // crop box in the laser frame
+        if (c != 0) {
+            addBreak(breaks, z.crop_x_min / c);
+            addBreak(breaks, z.crop_x_max / c);
+        }
+        if (s != 0) {
+            addBreak(breaks, z.crop_y_min / s);
+            addBreak(breaks, z.crop_y_max / s);
+        }
+        // the beam in base_link is the line t + r u
+        double ux = t.xx * c + t.xy * s, uy = t.yx * c + t.yy * s;
+        double a = ux * ux + uy * uy, b = t.x * ux + t.y * uy, tt = t.x * t.x + t.y * t.y;
+        double radius[] = {z.danger_distance, z.unsafety_distance};
+        for (int k = 0; k < 2; k++) {
+            double disc = b * b - a * (tt - radius[k] * radius[k]);
+            if (disc >= 0) {
+                addBreak(breaks, (-b - sqrt(disc)) / a);
+                addBreak(breaks, (-b + sqrt(disc)) / a);
+            }
+        }
+        for (size_t k = 0; k < sizeof(sector) / sizeof(sector[0]); k++) {
+            double sp = sin(sector[k] * M_PI / 180.0), cp = cos(sector[k] * M_PI / 180.0);
+            double den = ux * sp - uy * cp;
+            if (den != 0) {
+                addBreak(breaks, -(t.x * sp - t.y * cp) / den);
+            }
+        }
+        std::sort(breaks.begin(), breaks.end());
+
+        // the field is constant between two breaks, take it in the middle
+        double start = 0;
+        for (size_t k = 0; k <= breaks.size(); k++) {
+            double end = k < breaks.size() ? breaks[k] : INFINITY;
+            if (end <= start) {
+                continue;
+            }
+            float mid = (float)(k < breaks.size() ? (start + end) / 2 : start + 1.0);
+            uint8_t field = classify((float)((double)mid * c), (float)((double)mid * s));
+            if (segments_.size() > first_[i] && segments_.back().field == field) {
+                segments_.back().end = end;
+            } else {
+                Segment seg = {(float)end, field};
+                segments_.push_back(seg);
+            }
+            start = end;
+        }
+    }
+    first_[cos_.size()] = segments_.size();
+}
+
+/** point_to_field without sqrt/atan2: squared distances and sector slopes */
+inline int ObstacleKernel::classifyBase(float x, float y) const {
+    float d2 = x * x + y * y;
+    int base;
+    if (d2 < danger2_) {
+        base = DANGER_FRONT;
+    } else if (d2 < unsafety2_) {
+        base = UNSAFETY_FRONT;
+    } else {
+        return DONT_CARE;
+    }
+    float ay = fabsf(y);
+    if (x >= 0 && ay <= x * tan_center_) {
+        return base;
+    }
+    if (x > 0 && ay < x * tan_view_) {
+        return base + (y > 0 ? DANGER_LEFT : DANGER_RIGHT);
+    }
+    return DONT_CARE;
+}
+
+int ObstacleKernel::classify(float lx, float ly) const {
+    const ZoneConfig &z = zones_;
+    if (!(lx > z.crop_x_min && lx < z.crop_x_max && ly > z.crop_y_min && ly < z.crop_y_max)) {
+        return DONT_CARE;
+    }
+    const Affine2D &t = transform_;
+    return classifyBase(t.xx * lx + t.xy * ly + t.x, t.yx * lx + t.yy * ly + t.y) | INSIDE_CROP;
+}
+
+void ObstacleKernel::vote(const float *ranges, size_t count, float range_min, float range_max,
+                          uint16_t *votes, std::vector<Point2D> *kept) const {
+    memset(votes, 0, NUM_FIELDS * sizeof(uint16_t));
+    if (kept) {
+        kept->clear();
+    }
+    if (count > cos_.size()) {
+        count = cos_.size();
+    }
+    const Affine2D &t = transform_;
+    for (size_t i = 0; i < count; i++) {
+        float r = ranges[i];
+        // projectLaser keeps range_min <= r < range_max, NaN fails both
+        if (!(r < range_max && r >= range_min)) {
+            continue;
+        }
+        const Segment *begin = &segments_[first_[i]];
+        const Segment *seg = begin;
+        while (r >= seg->end) {
+            seg++;
+        }
+        int field = seg->field;
+        float lx = 0, ly = 0;
+        bool near = seg->end - r < GUARD || (seg != begin && r - seg[-1].end < GUARD);
+        if (near || kept) {
+            lx = (float)((double)r * cos_[i]);
+            ly = (float)((double)r * sin_[i]);
+            if (near) {
+                field = classify(lx, ly);
+            }
+        }
+        votes[field & ~INSIDE_CROP]++;
+        if (kept && (field & INSIDE_CROP)) {
+            Point2D p;
+            p.x = t.xx * lx + t.xy * ly + t.x;
+            p.y = t.yx * lx + t.yy * ly + t.y;
+            kept->push_back(p);
+        }
+    }
+}
+
+}
@@ -0,0 +1,198 @@
+#include <obstacle_detection/rolling_grid.h>
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+
+namespace obstacle_detection {
+
+namespace {
+
+const int LOG_ODDS_MAX = 100;
+
+inline int cellOf(float v, float inv_res) {
+    return (int)floorf(v * inv_res);
+}
+
+}
+
+RollingGrid::RollingGrid(const GridConfig &config)
+    : config_(config), origin_x_(0), origin_y_(0), last_stamp_(-1), decay_carry_(0),
+      traced_(0), reinforced_(0) {
+    config_.size_log2 = std::max(4, std::min(config_.size_log2, 11));
+    size_ = 1 << config_.size_log2;
+    mask_ = size_ - 1;
+    data_.assign((size_t)size_ * size_, 0);
+    origin_x_ = origin_y_ = -size_ / 2;
+}
+
+void RollingGrid::setGeometry(float angle_min, float angle_increment, size_t count) {
+    if (count == cos_.size() && count && cos_[0] == cosf(angle_min) &&
+        sin_[count - 1] == sinf(angle_min + (count - 1) * angle_increment)) {
+        return;
+    }
+    cos_.resize(count);
+    sin_.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        cos_[i] = cosf(angle_min + i * angle_increment);
+        sin_[i] = sinf(angle_min + i * angle_increment);
+    }
+    // everything is traced again
+    last_range_.assign(count, 0.0f);
+}
+
+inline void RollingGrid::add(int x, int y, int delta) {
+    int8_t &c = at(x, y);
+    int v = c + delta;
+    c = (int8_t)std::max(-LOG_ODDS_MAX, std::min(LOG_ODDS_MAX, v));
+}
+
+void RollingGrid::scroll(int origin_x, int origin_y) {
+    int dx = origin_x - origin_x_, dy = origin_y - origin_y_;
+    if (abs(dx) >= size_ || abs(dy) >= size_) {
+        std::fill(data_.begin(), data_.end(), 0);
+    } else {
+        // columns and rows entering the window still hold the cells that left it
+        int x_begin = dx > 0 ? origin_x_ + size_ : origin_x;
+        for (int x = x_begin; x < x_begin + abs(dx); x++) {
+            for (int y = 0; y < size_; y++) {
+                data_[(y << config_.size_log2) + (x & mask_)] = 0;
+            }
+        }
+        int y_begin = dy > 0 ? origin_y_ + size_ : origin_y;
+        for (int y = y_begin; y < y_begin + abs(dy); y++) {
+            memset(&data_[(y & mask_) << config_.size_log2], 0, size_);
+        }
+    }
+    origin_x_ = origin_x;
+    origin_y_ = origin_y;
+}
+
+void RollingGrid::decay(double stamp) {
+    if (last_stamp_ < 0 || stamp <= last_stamp_) {
+        last_stamp_ = std::max(last_stamp_, stamp);
+        return;
+    }
+    decay_carry_ += (float)(stamp - last_stamp_) * config_.decay;
+    last_stamp_ = stamp;
+    int step = (int)decay_carry_;
+    if (step <= 0) {
+        return;
+    }
+    decay_carry_ -= step;
+    step = std::min(step, LOG_ODDS_MAX);
+    // one branch-free pass over the window, vectorized by the compiler
+    int8_t *p = &data_[0];
+    size_t n = data_.size();
+    for (size_t i = 0; i < n; i++) {
+        int v = p[i];
+        int down = std::max(v - step, 0);
+        int up = std::min(v + step, 0);
+        p[i] = (int8_t)(v > 0 ? down : up);
+    }
+}
+
+/** Free space from (x0, y0) to (x1, y1), the end cell marked occupied if hit */
+void RollingGrid::trace(float x0, float y0, float x1, float y1, bool hit) {
+    float inv_res = 1.0f / config_.resolution;
+    int cx = cellOf(x0, inv_res), cy = cellOf(y0, inv_res);
+    int ex = cellOf(x1, inv_res), ey = cellOf(y1, inv_res);
+    // Bresenham over the cells, the end cell excluded
+    int dx = abs(ex - cx), dy = -abs(ey - cy);
+    int sx = cx < ex ? 1 : -1, sy = cy < ey ? 1 : -1;
+    int err = dx + dy;
+    while (cx != ex || cy != ey) {
+        if (inside(cx, cy)) {
+            add(cx, cy, config_.miss);
+        }
+        int e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            cx += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            cy += sy;
+        }
+    }
+    if (hit && inside(ex, ey)) {
+        add(ex, ey, config_.hit);
+    }
+}
+
+void RollingGrid::update(const float *ranges, size_t count, float range_min, float range_max,
+                         const Affine2D &laser_to_odom, double stamp) {
+    traced_ = reinforced_ = 0;
+    decay(stamp);
+
+    const Affine2D &t = laser_to_odom;
+    float inv_res = 1.0f / config_.resolution;
+    scroll(cellOf(t.x, inv_res) - size_ / 2, cellOf(t.y, inv_res) - size_ / 2);
+
+    if (count > cos_.size()) {
+        count = cos_.size();
+    }
+    // after a motion of half a cell (at max range for rotations) all beams are traced again
+    float half_cell = config_.resolution / 2;
+    float rotation = (fabsf(t.xx - last_pose_.xx) + fabsf(t.xy - last_pose_.xy)) * config_.max_range;
+    bool moved = fabsf(t.x - last_pose_.x) > half_cell || fabsf(t.y - last_pose_.y) > half_cell ||
+                 rotation > half_cell;
+    if (moved) {
+        last_pose_ = t;
+    }
+    const Affine2D &p = last_pose_;
+
+    for (size_t i = 0; i < count; i++) {
+        float r = ranges[i];
+        if (!(r < range_max && r >= range_min)) {
+            continue;
+        }
+        bool hit = r < config_.max_range;
+        if (!hit) {
+            r = config_.max_range;
+        }
+        float lx = r * cos_[i], ly = r * sin_[i];
+        float x1 = p.xx * lx + p.xy * ly + p.x;
+        float y1 = p.yx * lx + p.yy * ly + p.y;
+        if (!moved && fabsf(r - last_range_[i]) <= config_.change) {
+            // the free space along it is still cleared, only the end needs evidence
+            if (hit) {
+                int ex = cellOf(x1, inv_res), ey = cellOf(y1, inv_res);
+                if (inside(ex, ey)) {
+                    add(ex, ey, config_.hit);
+                }
+            }
+            reinforced_++;
+            continue;
+        }
+        trace(p.x, p.y, x1, y1, hit);
+        last_range_[i] = r;
+        traced_++;
+    }
+}
+
+void RollingGrid::vote(const ObstacleKernel &kernel, const Affine2D &laser_to_odom, float radius,
+                       uint16_t *votes) const {
+    memset(votes, 0, NUM_FIELDS * sizeof(uint16_t));
+    Affine2D to_laser = inverse(laser_to_odom);
+    float res = config_.resolution;
+    float inv_res = 1.0f / res;
+    int x0 = std::max(origin_x_, cellOf(laser_to_odom.x - radius, inv_res));
+    int x1 = std::min(origin_x_ + size_ - 1, cellOf(laser_to_odom.x + radius, inv_res));
+    int y0 = std::max(origin_y_, cellOf(laser_to_odom.y - radius, inv_res));
+    int y1 = std::min(origin_y_ + size_ - 1, cellOf(laser_to_odom.y + radius, inv_res));
+    for (int y = y0; y <= y1; y++) {
+        float wy = (y + 0.5f) * res;
+        for (int x = x0; x <= x1; x++) {
+            if (cell(x, y) < config_.occupied) {
+                continue;
+            }
+            float wx = (x + 0.5f) * res;
+            float lx = to_laser.xx * wx + to_laser.xy * wy + to_laser.x;
+            float ly = to_laser.yx * wx + to_laser.yy * wy + to_laser.y;
+            votes[kernel.classify(lx, ly) & ~ObstacleKernel::INSIDE_CROP]++;
+        }
+    }
+}
+
+}
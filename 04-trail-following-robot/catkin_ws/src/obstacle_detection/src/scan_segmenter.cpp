@@ -0,0 +1,181 @@
+#include <obstacle_detection/scan_segmenter.h>
+#include <math.h>
+#include <algorithm>
+
+namespace obstacle_detection {
+
+ScanSegmenter::ScanSegmenter(const SegmenterConfig &config)
+    : angle_increment_(0), full_circle_(false), last_stamp_(-1), next_id_(0) {
+    setConfig(config);
+}
+
+void ScanSegmenter::setConfig(const SegmenterConfig &config) {
+    config_ = config;
+    config_.max_missing = std::max(0, config_.max_missing);
+    // breakpoint factors for a step of 1 .. max_missing + 1 beams
+    break_factor_.resize(config_.max_missing + 2);
+    double lambda = config_.lambda * M_PI / 180.0;
+    for (size_t g = 0; g < break_factor_.size(); g++) {
+        double dphi = g * fabs(angle_increment_);
+        // beyond lambda no surface is assumed, only the fixed distance joins
+        break_factor_[g] = dphi < lambda ? (float)(sin(dphi) / sin(lambda - dphi)) : 0.0f;
+    }
+}
+
+void ScanSegmenter::setGeometry(float angle_min, float angle_increment, size_t count) {
+    if (count == cos_.size() && angle_increment == angle_increment_ && count && cos_[0] == cosf(angle_min)) {
+        return;
+    }
+    angle_increment_ = angle_increment;
+    cos_.resize(count);
+    sin_.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        cos_[i] = cosf(angle_min + i * angle_increment);
+        sin_[i] = sinf(angle_min + i * angle_increment);
+    }
+    // the last beam is next to the first one
+    full_circle_ = fabs(count * angle_increment) >= 2 * M_PI - 1.5 * fabs(angle_increment);
+    setConfig(config_);
+}
+
+inline bool ScanSegmenter::connected(float r0, float x0, float y0, float r1, float x1, float y1,
+                                     size_t gap) const {
+    if (gap >= break_factor_.size()) {
+        return false;
+    }
+    float dx = x1 - x0, dy = y1 - y0;
+    float limit = std::min(r0, r1) * break_factor_[gap] + config_.distance;
+    return dx * dx + dy * dy <= limit * limit;
+}
+
+inline void ScanSegmenter::add(Cluster &c, float lx, float ly, Point2D &sum) const {
+    const Affine2D &t = transform_;
+    Point2D p;
+    p.x = t.xx * lx + t.xy * ly + t.x;
+    p.y = t.yx * lx + t.yy * ly + t.y;
+    if (c.points == 0) {
+        c.right = p;
+    }
+    c.left = p;
+    c.points++;
+    sum.x += p.x;
+    sum.y += p.y;
+    // squared until the cluster is complete
+    float d2 = p.x * p.x + p.y * p.y;
+    if (d2 < c.distance) {
+        c.distance = d2;
+        c.nearest = p;
+    }
+}
+
+void ScanSegmenter::merge(Cluster &into, const Cluster &from, Point2D &sum, const Point2D &from_sum) const {
+    into.last = from.last;
+    into.left = from.left;
+    into.points += from.points;
+    sum.x += from_sum.x;
+    sum.y += from_sum.y;
+    if (from.distance < into.distance) {
+        into.distance = from.distance;
+        into.nearest = from.nearest;
+    }
+}
+
+const std::vector<Cluster> &ScanSegmenter::segment(const float *ranges, size_t count, float range_min,
+                                                   float range_max, double stamp) {
+    clusters_.clear();
+    sums_.clear();
+    if (count > cos_.size()) {
+        count = cos_.size();
+    }
+    float prev_r = 0, prev_x = 0, prev_y = 0;
+    size_t prev_i = 0;
+    bool open = false;
+    for (size_t i = 0; i < count; i++) {
+        float r = ranges[i];
+        if (!(r < range_max && r >= range_min && r < config_.max_range)) {
+            continue;
+        }
+        float lx = r * cos_[i], ly = r * sin_[i];
+        if (!open || !connected(prev_r, prev_x, prev_y, r, lx, ly, i - prev_i)) {
+            Cluster c;
+            c.id = 0;
+            c.first = c.last = i;
+            c.points = c.age = 0;
+            c.distance = INFINITY;
+            c.closing_speed = 0;
+            clusters_.push_back(c);
+            Point2D zero = {0, 0};
+            sums_.push_back(zero);
+            open = true;
+        }
+        add(clusters_.back(), lx, ly, sums_.back());
+        clusters_.back().last = i;
+        prev_r = r;
+        prev_x = lx;
+        prev_y = ly;
+        prev_i = i;
+    }
+
+    // over the seam of a 360 degree scan the last cluster goes on in the first one
+    if (full_circle_ && clusters_.size() >= 2) {
+        Cluster &head = clusters_.front(), &tail = clusters_.back();
+        float r0 = ranges[tail.last], r1 = ranges[head.first];
+        if (connected(r0, r0 * cos_[tail.last], r0 * sin_[tail.last], r1, r1 * cos_[head.first],
+                      r1 * sin_[head.first], head.first + count - tail.last)) {
+            merge(tail, head, sums_.back(), sums_.front());
+            clusters_.erase(clusters_.begin());
+            sums_.erase(sums_.begin());
+        }
+    }
+
+    size_t n = 0;
+    for (size_t k = 0; k < clusters_.size(); k++) {
+        Cluster &c = clusters_[k];
+        if ((int)c.points < config_.min_points) {
+            continue;
+        }
+        c.centroid.x = sums_[k].x / c.points;
+        c.centroid.y = sums_[k].y / c.points;
+        c.distance = sqrtf(c.distance);
+        clusters_[n++] = c;
+    }
+    clusters_.resize(n);
+    associate(stamp);
+    return clusters_;
+}
+
+void ScanSegmenter::associate(double stamp) {
+    double dt = last_stamp_ >= 0 ? stamp - last_stamp_ : 0;
+    float gate = config_.association * config_.association;
+    used_.assign(previous_.size(), 0);
+    for (size_t k = 0; k < clusters_.size(); k++) {
+        Cluster &c = clusters_[k];
+        int best = -1;
+        float best_d2 = gate;
+        for (size_t j = 0; j < previous_.size(); j++) {
+            float dx = c.centroid.x - previous_[j].centroid.x, dy = c.centroid.y - previous_[j].centroid.y;
+            float d2 = dx * dx + dy * dy;
+            if (!used_[j] && d2 < best_d2) {
+                best_d2 = d2;
+                best = j;
+            }
+        }
+        if (best < 0) {
+            c.id = next_id_++;
+            continue;
+        }
+        used_[best] = 1;
+        const Cluster &p = previous_[best];
+        c.id = p.id;
+        c.age = p.age + 1;
+        c.closing_speed = p.closing_speed;
+        if (dt > 0) {
+            float speed = (float)((p.distance - c.distance) / dt);
+            c.closing_speed = p.age == 0 ? speed : p.closing_speed + config_.smoothing * (speed - p.closing_speed);
+        }
+    }
+    previous_ = clusters_;
+    last_stamp_ = stamp;
+}
+
+}
@@ -0,0 +1,26 @@
+#include <obstacle_detection/zone_latch.h>
+
+namespace obstacle_detection {
+
+ZoneLatch::ZoneLatch(const LatchConfig &config) : config_(config), active_(0) {
+    for (int f = 0; f < DONT_CARE; f++) {
+        // the first switch of a zone is never held back
+        changed_[f] = -1e9;
+    }
+}
+
+unsigned ZoneLatch::update(const uint16_t *counts, double now) {
+    for (int f = 0; f < DONT_CARE; f++) {
+        unsigned bit = 1u << f;
+        bool on = (active_ & bit) != 0;
+        bool want = on ? counts[f] > config_.threshold - config_.hysteresis : counts[f] > config_.threshold;
+        if (want == on || now - changed_[f] < (on ? config_.min_on : config_.min_off)) {
+            continue;
+        }
+        active_ ^= bit;
+        changed_[f] = now;
+    }
+    return active_;
+}
+
+}
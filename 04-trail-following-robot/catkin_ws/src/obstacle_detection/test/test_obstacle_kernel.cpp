@@ -0,0 +1,380 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <string.h>
+#include <limits>
+#include <sensor_msgs/LaserScan.h>
+#include <obstacle_detection/obstacle_kernel.h>
+#include <obstacle_detection/rolling_grid.h>
+#include <obstacle_detection/zone_latch.h>
+#include <obstacle_detection/scan_segmenter.h>
+#include <obstacle_detection/obstacle_detector.h>
+#include <obstacle_detection/legacy_pipeline.h>
+
+using namespace obstacle_detection;
+
+namespace {
+
+/** Ranges between 0 and 3 m with dropouts, out of range and NaN beams */
+sensor_msgs::LaserScan makeScan(uint32_t seed, size_t count) {
+    sensor_msgs::LaserScan scan;
+    scan.header.frame_id = "laser_frame";
+    scan.angle_min = -M_PI;
+    scan.angle_max = M_PI;
+    scan.angle_increment = 2 * M_PI / count;
+    scan.range_min = 0.1;
+    scan.range_max = 16.0;
+    scan.ranges.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t r = seed >> 8;
+        if (r % 23 == 0) {
+            scan.ranges[i] = 0.0f;
+        } else if (r % 29 == 0) {
+            scan.ranges[i] = std::numeric_limits<float>::quiet_NaN();
+        } else if (r % 31 == 0) {
+            scan.ranges[i] = 20.0f;
+        } else {
+            scan.ranges[i] = 3.0f * (r & 0xffff) / 65536.0f;
+        }
+    }
+    return scan;
+}
+
+void kernelVotes(ObstacleKernel &kernel, const sensor_msgs::LaserScan &scan, uint16_t *votes,
+                 std::vector<Point2D> *kept = NULL) {
+    kernel.setGeometry(scan.angle_min, scan.angle_increment, scan.ranges.size());
+    kernel.vote(&scan.ranges[0], scan.ranges.size(), scan.range_min, scan.range_max, votes, kept);
+}
+
+}
+
+TEST(ObstacleKernel, SameVotesAsPclPipeline) {
+    ObstacleKernel kernel;
+    kernel.setTransform(toAffine(launchMount()));
+    const size_t counts[] = {505, 720, 1000};
+    for (size_t c = 0; c < 3; c++) {
+        for (uint32_t seed = 1; seed <= 50; seed++) {
+            sensor_msgs::LaserScan scan = makeScan(seed, counts[c]);
+            uint16_t expected[NUM_FIELDS], votes[NUM_FIELDS];
+            legacyVotes(scan, launchMount(), expected);
+            kernelVotes(kernel, scan, votes);
+            for (int f = 0; f < NUM_FIELDS; f++) {
+                EXPECT_EQ(expected[f], votes[f]) << FIELD_NAMES[f] << " seed " << seed << " beams " << counts[c];
+            }
+        }
+    }
+}
+
+TEST(ObstacleKernel, KeptPointsAreInsideCropBox) {
+    ObstacleKernel kernel;
+    kernel.setTransform(toAffine(launchMount()));
+    sensor_msgs::LaserScan scan = makeScan(7, 720);
+    uint16_t votes[NUM_FIELDS];
+    std::vector<Point2D> kept;
+    kernelVotes(kernel, scan, votes, &kept);
+    ASSERT_FALSE(kept.empty());
+    for (size_t i = 0; i < kept.size(); i++) {
+        // crop box of the laser frame seen from base_link
+        EXPECT_GT(kept[i].x, 0.01f);
+        EXPECT_LT(kept[i].x, 1.51f + 1e-5f);
+        EXPECT_LT(fabsf(kept[i].y), 0.8f + 1e-5f);
+    }
+}
+
+TEST(ObstacleKernel, SingleBeamFields) {
+    ObstacleKernel kernel;
+    kernel.setTransform(toAffine(launchMount()));
+    // beam 0 looks along -x of the laser, i.e. straight ahead of the robot
+    sensor_msgs::LaserScan scan = makeScan(1, 360);
+    uint16_t votes[NUM_FIELDS];
+    for (size_t i = 0; i < scan.ranges.size(); i++) {
+        scan.ranges[i] = 0.0f;
+    }
+    scan.ranges[0] = 0.5f;
+    kernelVotes(kernel, scan, votes);
+    EXPECT_EQ(1, votes[DANGER_FRONT]);
+    scan.ranges[0] = 1.2f;
+    kernelVotes(kernel, scan, votes);
+    EXPECT_EQ(1, votes[UNSAFETY_FRONT]);
+    scan.ranges[0] = 5.0f;
+    kernelVotes(kernel, scan, votes);
+    EXPECT_EQ(1, votes[DONT_CARE]);
+}
+
+TEST(ObstacleKernel, BeamThresholdsMatchExactClassification) {
+    // random mounts and zones, the per-beam thresholds must agree with classify() point by point
+    uint32_t seed = 11;
+    for (int trial = 0; trial < 100; trial++) {
+        seed = seed * 1664525u + 1013904223u;
+        double yaw = (seed >> 8) % 628 / 100.0;
+        Affine2D mount;
+        mount.xx = cos(yaw); mount.xy = -sin(yaw);
+        mount.yx = sin(yaw); mount.yy = cos(yaw);
+        mount.x = ((seed >> 4) % 30) / 100.0f - 0.15f;
+        mount.y = ((seed >> 12) % 30) / 100.0f - 0.15f;
+        ZoneConfig zones;
+        zones.danger_distance = 0.3f + (seed % 100) / 100.0f;
+        zones.unsafety_distance = zones.danger_distance + 0.5f;
+        zones.degree_of_center = 10.0f + (seed >> 16) % 40;
+        zones.degree_of_view = zones.degree_of_center + 10.0f + (seed >> 20) % 80;
+        zones.crop_x_max = trial % 2 ? 0.0f : 2.0f;
+
+        ObstacleKernel kernel;
+        kernel.setZones(zones);
+        kernel.setTransform(mount);
+        sensor_msgs::LaserScan scan = makeScan(seed, 300 + trial * 7);
+        uint16_t expected[NUM_FIELDS] = {0}, votes[NUM_FIELDS];
+        for (size_t i = 0; i < scan.ranges.size(); i++) {
+            float r = scan.ranges[i];
+            if (r < scan.range_max && r >= scan.range_min) {
+                double angle = scan.angle_min + (double)i * scan.angle_increment;
+                int field = kernel.classify((float)(r * cos(angle)), (float)(r * sin(angle)));
+                expected[field & ~ObstacleKernel::INSIDE_CROP]++;
+            }
+        }
+        kernelVotes(kernel, scan, votes);
+        for (int f = 0; f < NUM_FIELDS; f++) {
+            EXPECT_EQ(expected[f], votes[f]) << FIELD_NAMES[f] << " trial " << trial;
+        }
+    }
+}
+
+namespace {
+
+/** Nothing in range but one beam straight ahead of the robot */
+sensor_msgs::LaserScan postScan(float range) {
+    sensor_msgs::LaserScan scan = makeScan(1, 720);
+    for (size_t i = 0; i < scan.ranges.size(); i++) {
+        scan.ranges[i] = 10.0f;
+    }
+    scan.ranges[0] = range;
+    return scan;
+}
+
+void update(RollingGrid &grid, const sensor_msgs::LaserScan &scan, const Affine2D &laser, double stamp) {
+    grid.setGeometry(scan.angle_min, scan.angle_increment, scan.ranges.size());
+    grid.update(&scan.ranges[0], scan.ranges.size(), scan.range_min, scan.range_max, laser, stamp);
+}
+
+}
+
+TEST(RollingGrid, ObstacleNeedsScansAndDecays) {
+    ObstacleKernel kernel;
+    Affine2D laser = toAffine(launchMount());
+    kernel.setTransform(laser);
+    RollingGrid grid;
+    uint16_t votes[NUM_FIELDS];
+    sensor_msgs::LaserScan post = postScan(0.5f), empty = postScan(10.0f);
+    double stamp = 0;
+    // a single echo is below the occupied level
+    update(grid, post, laser, stamp);
+    EXPECT_EQ(720u, grid.traced());
+    grid.vote(kernel, laser, 2.0f, votes);
+    EXPECT_EQ(0, votes[DANGER_FRONT]);
+    for (int k = 0; k < 5; k++) {
+        update(grid, post, laser, stamp += 0.14);
+    }
+    // unchanged beams of a standing robot are not traced again
+    EXPECT_EQ(0u, grid.traced());
+    EXPECT_EQ(720u, grid.reinforced());
+    grid.vote(kernel, laser, 2.0f, votes);
+    EXPECT_EQ(1, votes[DANGER_FRONT]);
+    for (int f = 0; f < NUM_FIELDS - 1; f++) {
+        if (f != DANGER_FRONT) {
+            EXPECT_EQ(0, votes[f]) << FIELD_NAMES[f];
+        }
+    }
+    // a one scan dropout keeps it, it is gone within a second once the post is removed
+    update(grid, empty, laser, stamp += 0.14);
+    EXPECT_EQ(1u, grid.traced());
+    grid.vote(kernel, laser, 2.0f, votes);
+    EXPECT_EQ(1, votes[DANGER_FRONT]);
+    for (int k = 0; k < 6; k++) {
+        update(grid, empty, laser, stamp += 0.14);
+    }
+    grid.vote(kernel, laser, 2.0f, votes);
+    EXPECT_EQ(0, votes[DANGER_FRONT]);
+}
+
+TEST(RollingGrid, FollowsTheRobot) {
+    ObstacleKernel kernel;
+    Affine2D laser = toAffine(launchMount());
+    kernel.setTransform(laser);
+    RollingGrid grid;
+    sensor_msgs::LaserScan post = postScan(1.2f);
+    for (int k = 0; k < 5; k++) {
+        update(grid, post, laser, k * 0.14);
+    }
+    uint16_t votes[NUM_FIELDS];
+    grid.vote(kernel, laser, 2.0f, votes);
+    EXPECT_EQ(1, votes[UNSAFETY_FRONT]);
+    EXPECT_EQ(0, votes[DANGER_FRONT]);
+    // half a metre closer the same cell is in the danger zone, without a new scan
+    Affine2D base;
+    base.x = 0.5f;
+    Affine2D moved = compose(base, laser);
+    grid.vote(kernel, moved, 2.0f, votes);
+    EXPECT_EQ(1, votes[DANGER_FRONT]);
+    EXPECT_EQ(0, votes[UNSAFETY_FRONT]);
+    // after driving off the window the old cells are cleared, one scan of the new place is not enough
+    base.x = 20.0f;
+    moved = compose(base, laser);
+    update(grid, post, moved, 0.7);
+    grid.vote(kernel, moved, 2.0f, votes);
+    for (int f = 0; f < NUM_FIELDS; f++) {
+        EXPECT_EQ(0, votes[f]) << FIELD_NAMES[f];
+    }
+}
+
+TEST(ZoneLatch, HysteresisAndHoldTimes) {
+    LatchConfig config;
+    config.threshold = 2;
+    config.hysteresis = 1;
+    config.min_on = 0.375;
+    config.min_off = 0.25;
+    ZoneLatch latch(config);
+    uint16_t counts[NUM_FIELDS] = {0};
+    // scans every 1/8 s, exact in binary
+    double now = 0, scan = 0.125;
+    const unsigned FRONT = 1u << DANGER_FRONT;
+
+    counts[DANGER_FRONT] = 3;
+    EXPECT_EQ(FRONT, latch.update(counts, now));
+    // down to the threshold is still on, only below threshold - hysteresis releases
+    counts[DANGER_FRONT] = 2;
+    EXPECT_EQ(FRONT, latch.update(counts, now += 4 * scan));
+    counts[DANGER_FRONT] = 1;
+    EXPECT_EQ(0u, latch.update(counts, now += scan));
+    // held off for min_off, then on again and held for min_on
+    counts[DANGER_FRONT] = 5;
+    EXPECT_EQ(0u, latch.update(counts, now += scan));
+    EXPECT_EQ(FRONT, latch.update(counts, now += scan));
+    counts[DANGER_FRONT] = 0;
+    EXPECT_EQ(FRONT, latch.update(counts, now += scan));
+    EXPECT_EQ(FRONT, latch.update(counts, now += scan));
+    EXPECT_EQ(0u, latch.update(counts, now += scan));
+    // DONT_CARE never switches anything
+    counts[DONT_CARE] = 1000;
+    EXPECT_EQ(0u, latch.update(counts, now += 8 * scan));
+}
+
+TEST(ZoneLatch, CountAroundThresholdSwitchesOnce) {
+    LatchConfig config;
+    config.hysteresis = 3;
+    ZoneLatch latch(config);
+    uint16_t counts[NUM_FIELDS] = {0};
+    int switches = 0;
+    unsigned last = 0;
+    // a count hovering around the threshold of 30, scans at 7 Hz
+    for (int k = 0; k < 70; k++) {
+        counts[UNSAFETY_LEFT] = 29 + k % 3;
+        unsigned active = latch.update(counts, k / 7.0);
+        switches += active != last;
+        last = active;
+    }
+    EXPECT_EQ(1, switches);
+    EXPECT_EQ(1u << UNSAFETY_LEFT, last);
+}
+
+TEST(ScanSegmenter, ClustersInBeamOrder) {
+    ScanSegmenter segmenter;
+    segmenter.setTransform(toAffine(launchMount()));
+    sensor_msgs::LaserScan scan = postScan(10.0f);
+    for (size_t i = 100; i < 105; i++) scan.ranges[i] = 1.0f;      // post
+    for (size_t i = 200; i < 210; i++) scan.ranges[i] = 1.0f;      // two boxes, one behind the other
+    for (size_t i = 210; i < 220; i++) scan.ranges[i] = 1.5f;
+    scan.ranges[400] = 0.8f;                                        // speckle
+    for (size_t i = 0; i < 6; i++) scan.ranges[i] = 1.5f;           // wall across the seam
+    for (size_t i = 715; i < 720; i++) scan.ranges[i] = 1.5f;
+    segmenter.setGeometry(scan.angle_min, scan.angle_increment, scan.ranges.size());
+    const std::vector<Cluster> &clusters =
+        segmenter.segment(&scan.ranges[0], scan.ranges.size(), scan.range_min, scan.range_max, 0.0);
+    ASSERT_EQ(4u, clusters.size());
+    EXPECT_EQ(100u, clusters[0].first);
+    EXPECT_EQ(104u, clusters[0].last);
+    EXPECT_EQ(5u, clusters[0].points);
+    EXPECT_NEAR(1.0f, clusters[0].distance, 0.02f);
+    EXPECT_EQ(209u, clusters[1].last);
+    EXPECT_EQ(210u, clusters[2].first);
+    // the wall wraps: it starts at the end of the scan, straight ahead of the robot
+    EXPECT_EQ(715u, clusters[3].first);
+    EXPECT_EQ(5u, clusters[3].last);
+    EXPECT_EQ(11u, clusters[3].points);
+    EXPECT_NEAR(1.5f, clusters[3].distance, 0.02f);
+    EXPECT_GT(clusters[3].centroid.x, 1.4f);
+    EXPECT_NEAR(0.0f, clusters[3].centroid.y, 0.01f);
+    EXPECT_LT(clusters[3].right.y, 0.0f);
+    EXPECT_GT(clusters[3].left.y, 0.0f);
+}
+
+TEST(ScanSegmenter, ClosingSpeedOfTrackedCluster) {
+    ScanSegmenter segmenter;
+    segmenter.setTransform(toAffine(launchMount()));
+    sensor_msgs::LaserScan scan = postScan(10.0f);
+    segmenter.setGeometry(scan.angle_min, scan.angle_increment, scan.ranges.size());
+    uint32_t id = 0;
+    // a post coming closer at 0.8 m/s, a static one on the left
+    for (int k = 0; k < 10; k++) {
+        for (size_t i = 0; i < 3; i++) scan.ranges[i] = 2.0f - 0.1f * k;
+        for (size_t i = 360; i < 366; i++) scan.ranges[i] = 1.0f;
+        const std::vector<Cluster> &clusters =
+            segmenter.segment(&scan.ranges[0], scan.ranges.size(), scan.range_min, scan.range_max, k * 0.125);
+        ASSERT_EQ(2u, clusters.size());
+        const Cluster &post = clusters[0].first == 0 ? clusters[0] : clusters[1];
+        const Cluster &other = clusters[0].first == 0 ? clusters[1] : clusters[0];
+        if (k == 0) {
+            id = post.id;
+            EXPECT_EQ(0.0f, post.closing_speed);
+        } else {
+            EXPECT_EQ(id, post.id);
+            EXPECT_NEAR(0.8f, post.closing_speed, 0.01f);
+            EXPECT_NEAR(0.0f, other.closing_speed, 0.01f);
+        }
+    }
+}
+
+TEST(ObstacleDetector, WristbandPatterns) {
+    WristbandCommand left, right;
+    ObstacleDetector::pattern(0, left, right);
+    EXPECT_EQ(0, left.frequency);
+    EXPECT_EQ(0, right.intensity);
+    ObstacleDetector::pattern(1u << DANGER_FRONT | 1u << UNSAFETY_LEFT, left, right);
+    EXPECT_EQ(3, left.frequency);
+    EXPECT_EQ(5, left.intensity);
+    EXPECT_EQ(3, right.frequency);
+    ObstacleDetector::pattern(1u << DANGER_RIGHT | 1u << UNSAFETY_LEFT, left, right);
+    EXPECT_EQ(3, left.frequency);
+    EXPECT_EQ(3, left.intensity);
+    EXPECT_EQ(5, right.frequency);
+    // as in the original callback, a one sided danger is replaced by the front unsafety
+    ObstacleDetector::pattern(1u << DANGER_LEFT | 1u << UNSAFETY_FRONT, left, right);
+    EXPECT_EQ(1, left.frequency);
+    EXPECT_EQ(3, left.intensity);
+    EXPECT_EQ(1, right.frequency);
+}
+
+TEST(ObstacleDetector, LatchedOnGridCells) {
+    DetectorConfig config;
+    ObstacleDetector detector(config);
+    detector.setMount(toAffine(launchMount()));
+    // a box 15 cm wide half a metre ahead, about the 30 votes the original callback needed
+    sensor_msgs::LaserScan scan = postScan(0.5f);
+    for (size_t i = 0; i < 18; i++) scan.ranges[i] = scan.ranges[719 - i] = 0.5f;
+    ScanView view = {&scan.ranges[0], scan.ranges.size(), scan.angle_min, scan.angle_increment,
+                     scan.range_min, scan.range_max, 0.0};
+    for (int k = 0; k < 6; k++) {
+        view.stamp = k * 0.125;
+        detector.process(view, Affine2D(), NULL);
+    }
+    const Detection &d = detector.detection();
+    EXPECT_EQ(36, d.votes[DANGER_FRONT]);
+    EXPECT_GE(d.grid_votes[DANGER_FRONT], 3);
+    EXPECT_EQ(1u << DANGER_FRONT, d.active);
+    EXPECT_EQ(3, d.left.frequency);
+    EXPECT_EQ(1u, detector.segmenter().clusters().size());
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
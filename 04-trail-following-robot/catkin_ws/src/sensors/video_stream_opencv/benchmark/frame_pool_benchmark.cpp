@@ -0,0 +1,545 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/core/core.hpp>
+#include <video_stream_opencv/frame_pool.h>
+#include <video_stream_opencv/image_slot.h>
+#include <video_stream_opencv/latency_stats.h>
+
+using namespace video_stream_opencv;
+
+/**
+ * Runs the capture -> publish hand over of VideoStreamNodelet without a camera
+ * or a ROS master, once per mode:
+ *   queue  the former std::queue<cv::Mat> under a mutex, a clone per captured
+ *          frame and a new image message per published frame
+ *   pool     FramePool<cv::Mat>, decoding in place and copying into a kept
+ *            image message
+ *   message  ImagePool as used by the nodelet, decoding into pooled
+ *            sensor_msgs::Image that a subscriber holds until the next one
+ *   latest   message with latest_frame_only: a single frame replaced by every
+ *            capture, published as soon as it arrives (at most at --publish-fps)
+ * Frames are "decoded" by copying one of a few random images into the output
+ * Mat, the way the VideoCapture backends retrieve. Capture runs at --fps and
+ * publishing at --publish-fps (0 is as fast as possible). Allocations, bytes,
+ * per frame times, capture to publish latency, published and dropped frames
+ * are printed as JSON on stdout, the first frame (where the pool preallocates
+ * its slots) reported apart.
+ *
+ * usage: video_stream_benchmark [--frames N] [--fps 30] [--publish-fps F]
+ *                               [--queue 100] [--width 640] [--height 480]
+ *                               [--modes queue,pool,message,latest]
+ */
+
+static std::atomic<uint64_t> g_allocations(0);
+
+void *operator new(size_t size) {
+    g_allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+namespace {
+
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag AllocFlags;
+#else
+typedef int AllocFlags;
+#endif
+
+/** Counts the pixel buffers cv::Mat allocates, the buffers come from the default allocator */
+class CountingAllocator : public cv::MatAllocator {
+public:
+    explicit CountingAllocator(cv::MatAllocator *base) : base_(base), allocations(0), bytes(0) {}
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           AllocFlags flags, cv::UMatUsageFlags usage) const {
+        cv::UMatData *u = base_->allocate(dims, sizes, type, data, step, flags, usage);
+        if (u && !data) {
+            allocations++;
+            bytes += u->size;
+        }
+        return u;
+    }
+
+    bool allocate(cv::UMatData *data, AllocFlags flags, cv::UMatUsageFlags usage) const {
+        return base_->allocate(data, flags, usage);
+    }
+
+    void deallocate(cv::UMatData *data) const {
+        base_->deallocate(data);
+    }
+
+    cv::MatAllocator *base_;
+    mutable std::atomic<uint64_t> allocations, bytes;
+};
+
+CountingAllocator *g_mat_allocator = 0;
+
+inline uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Options {
+    int frames;
+    double fps;
+    double publish_fps;
+    int queue;
+    int width, height;
+    std::vector<std::string> modes;
+
+    Options() : frames(300), fps(30.0), publish_fps(-1.0), queue(100), width(640), height(480) {
+        modes.push_back("queue");
+        modes.push_back("pool");
+        modes.push_back("message");
+        modes.push_back("latest");
+    }
+};
+
+/** Stands in for VideoCapture::read, which copies the decoded frame into its output */
+class FakeCapture {
+public:
+    FakeCapture(int width, int height) : next_(0) {
+        for (int i = 0; i < 4; i++) {
+            images_.push_back(cv::Mat(height, width, CV_8UC3));
+            cv::randu(images_.back(), cv::Scalar::all(0), cv::Scalar::all(255));
+        }
+    }
+
+    bool read(cv::Mat &frame) {
+        images_[next_++ % images_.size()].copyTo(frame);
+        return true;
+    }
+
+private:
+    std::vector<cv::Mat> images_;
+    size_t next_;
+};
+
+/** What cv_bridge::toImageMsg fills */
+struct Image {
+    uint32_t height, width, step;
+    std::vector<uint8_t> data;
+};
+
+void toImage(const cv::Mat &frame, Image &image) {
+    image.height = frame.rows;
+    image.width = frame.cols;
+    image.step = frame.cols * frame.elemSize();
+    image.data.resize(image.step * image.height);
+    memcpy(&image.data[0], frame.data, image.data.size());
+}
+
+struct Stats {
+    std::string mode;
+    uint64_t captured, published, dropped;
+    uint64_t first_ns, capture_ns, publish_ns;
+    uint64_t first_mat_allocations, first_mat_bytes;
+    uint64_t mat_allocations, mat_bytes, allocations;
+    LatencyStats latency;
+    double seconds;
+
+    Stats() : captured(0), published(0), dropped(0), first_ns(0), capture_ns(0), publish_ns(0),
+              first_mat_allocations(0), first_mat_bytes(0), mat_allocations(0), mat_bytes(0),
+              allocations(0), seconds(0) {}
+};
+
+/** Capture -> publish hand over under test, add replacements to makeHandOver() */
+class HandOver {
+public:
+    virtual ~HandOver() {}
+    /** Capture thread: read one frame and queue it */
+    virtual void capture(FakeCapture &cap) = 0;
+    /** Publish timer: the next frame into a message and when it was captured, false if there was none */
+    virtual bool publish(uint64_t &captured_ns) = 0;
+    virtual uint64_t dropped() const = 0;
+    /** Published as frames arrive instead of by a timer */
+    virtual bool eventDriven() const { return false; }
+    /** Publish thread: block until a frame is there or a short timeout */
+    virtual void wait() {}
+};
+
+/** video_stream.cpp before the frame pool */
+class QueueHandOver : public HandOver {
+public:
+    explicit QueueHandOver(size_t max_queue_size) : max_queue_size_(max_queue_size), dropped_(0) {}
+
+    void capture(FakeCapture &cap) {
+        cap.read(frame_);
+        uint64_t captured = nowNs();
+        std::lock_guard<std::mutex> g(q_mutex_);
+        if (framesQueue_.size() < max_queue_size_) {
+            framesQueue_.push(std::make_pair(frame_.clone(), captured));
+        } else {
+            framesQueue_.pop();
+            framesQueue_.push(std::make_pair(frame_.clone(), captured));
+            dropped_++;
+        }
+    }
+
+    bool publish(uint64_t &captured_ns) {
+        cv::Mat frame;
+        {
+            std::lock_guard<std::mutex> g(q_mutex_);
+            if (framesQueue_.empty()) {
+                return false;
+            }
+            frame = framesQueue_.front().first;
+            captured_ns = framesQueue_.front().second;
+            framesQueue_.pop();
+        }
+        boost::shared_ptr<Image> msg(new Image);
+        toImage(frame, *msg);
+        return true;
+    }
+
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    size_t max_queue_size_;
+    std::mutex q_mutex_;
+    std::queue<std::pair<cv::Mat, uint64_t> > framesQueue_;
+    cv::Mat frame_;
+    uint64_t dropped_;
+};
+
+/** video_stream.cpp with the frame pool */
+class PoolHandOver : public HandOver {
+public:
+    explicit PoolHandOver(size_t max_queue_size)
+        : frames_(max_queue_size), captured_(frames_.slots()), slot_(frames_.acquire()), frame_slot_(-1),
+          preallocated_(false) {}
+
+    void capture(FakeCapture &cap) {
+        cv::Mat &frame = frames_.frame(slot_);
+        cap.read(frame);
+        captured_[slot_] = nowNs();
+        if (!preallocated_) {
+            for (size_t i = 0; i < frames_.slots(); i++) {
+                frames_.frame(i).create(frame.size(), frame.type());
+                frames_.frame(i).setTo(cv::Scalar::all(0));
+            }
+            preallocated_ = true;
+        }
+        frames_.push(slot_);
+        slot_ = frames_.acquire();
+    }
+
+    bool publish(uint64_t &captured_ns) {
+        int slot = frames_.pop();
+        if (slot < 0) {
+            return false;
+        }
+        captured_ns = captured_[slot];
+        if (frame_slot_ >= 0) {
+            frames_.release(frame_slot_);
+        }
+        frame_slot_ = slot;
+        toImage(frames_.frame(frame_slot_), image_);
+        return true;
+    }
+
+    uint64_t dropped() const { return frames_.dropped(); }
+
+private:
+    FramePool<cv::Mat> frames_;
+    std::vector<uint64_t> captured_;
+    int slot_, frame_slot_;
+    bool preallocated_;
+    Image image_;
+};
+
+/** video_stream.cpp publishing the pooled messages themselves, latest_frame_only with `latest` */
+class MessageHandOver : public HandOver {
+public:
+    MessageHandOver(size_t max_queue_size, bool latest)
+        : frames_(new ImagePool(latest ? 1 : max_queue_size, 4)), latest_(latest), slot_(frames_->acquire()),
+          preallocated_(false), exhausted_(0) {}
+
+    void capture(FakeCapture &cap) {
+        if (slot_ < 0) {
+            slot_ = frames_->acquire();
+        }
+        if (slot_ < 0) {
+            cap.read(scratch_);
+            exhausted_++;
+            return;
+        }
+        ImageSlot &image = frames_->frame(slot_);
+        cap.read(image.mat);
+        image.captured = std::chrono::steady_clock::now();
+        if (image.adopt() && !preallocated_) {
+            for (size_t i = 0; i < frames_->slots(); i++) {
+                if ((int)i != slot_) {
+                    frames_->frame(i).wrap(image.mat.rows, image.mat.cols, image.mat.type());
+                }
+            }
+            preallocated_ = true;
+        }
+        frames_->push(slot_);
+        slot_ = frames_->acquire();
+        if (latest_) {
+            { std::lock_guard<std::mutex> g(f_mutex_); }
+            frame_cv_.notify_one();
+        }
+    }
+
+    bool publish(uint64_t &captured_ns) {
+        int slot = frames_->pop();
+        if (slot < 0) {
+            return false;
+        }
+        ImageSlot &image = frames_->frame(slot);
+        captured_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          image.captured.time_since_epoch()).count();
+        image.msg.encoding = "bgr8";
+        image.info.header = image.msg.header;
+        last_ = share(frames_, slot);
+        return true;
+    }
+
+    uint64_t dropped() const { return frames_->dropped() + exhausted_; }
+
+    bool eventDriven() const { return latest_; }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(f_mutex_);
+        frame_cv_.wait_for(lock, std::chrono::milliseconds(10), [this]() { return frames_->size() > 0; });
+    }
+
+private:
+    boost::shared_ptr<ImagePool> frames_;
+    bool latest_;
+    std::mutex f_mutex_;
+    std::condition_variable frame_cv_;
+    int slot_;
+    bool preallocated_;
+    cv::Mat scratch_;
+    uint64_t exhausted_;
+    sensor_msgs::ImageConstPtr last_;  // what an intra-process subscriber holds
+};
+
+boost::shared_ptr<HandOver> makeHandOver(const std::string &mode, size_t queue) {
+    if (mode == "queue") {
+        return boost::shared_ptr<HandOver>(new QueueHandOver(queue));
+    }
+    if (mode == "pool") {
+        return boost::shared_ptr<HandOver>(new PoolHandOver(queue));
+    }
+    if (mode == "message") {
+        return boost::shared_ptr<HandOver>(new MessageHandOver(queue, false));
+    }
+    if (mode == "latest") {
+        return boost::shared_ptr<HandOver>(new MessageHandOver(queue, true));
+    }
+    return boost::shared_ptr<HandOver>();
+}
+
+/** Sleeps until the next period, unthrottled when period is 0 */
+class Pacer {
+public:
+    explicit Pacer(double rate) : period_ns_(rate > 0 ? (uint64_t)(1e9 / rate) : 0), next_(nowNs()) {}
+
+    void sleep() {
+        if (!period_ns_) {
+            return;
+        }
+        next_ += period_ns_;
+        uint64_t now = nowNs();
+        if (next_ > now) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(next_ - now));
+        }
+    }
+
+private:
+    uint64_t period_ns_;
+    uint64_t next_;
+};
+
+Stats run(const std::string &mode, const Options &opt) {
+    Stats stats;
+    stats.mode = mode;
+    FakeCapture cap(opt.width, opt.height);
+    boost::shared_ptr<HandOver> hand_over = makeHandOver(mode, opt.queue);
+
+    uint64_t mat_allocations = g_mat_allocator->allocations, mat_bytes = g_mat_allocator->bytes;
+    uint64_t allocations = g_allocations;
+    uint64_t start = nowNs();
+    std::atomic<bool> capturing(true);
+
+    std::thread capture_thread([&]() {
+        Pacer pacer(opt.fps);
+        for (int i = 0; i < opt.frames; i++) {
+            uint64_t t = nowNs();
+            hand_over->capture(cap);
+            if (i == 0) {
+                // nothing was published yet, all allocations so far are the first frame's
+                stats.first_ns = nowNs() - t;
+                stats.first_mat_allocations = g_mat_allocator->allocations - mat_allocations;
+                stats.first_mat_bytes = g_mat_allocator->bytes - mat_bytes;
+                mat_allocations = g_mat_allocator->allocations;
+                mat_bytes = g_mat_allocator->bytes;
+                allocations = g_allocations;
+            } else {
+                stats.capture_ns += nowNs() - t;
+                stats.captured++;
+            }
+            pacer.sleep();
+        }
+        capturing = false;
+    });
+
+    Pacer pacer(opt.publish_fps);
+    uint64_t period_ns = opt.publish_fps > 0 ? (uint64_t)(1e9 / opt.publish_fps) : 0, allowed = 0;
+    for (;;) {
+        bool last = !capturing;
+        if (hand_over->eventDriven()) {
+            // as do_publish_latest: wait for a frame, then for the rate limit
+            hand_over->wait();
+            uint64_t now = nowNs();
+            if (allowed > now) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(allowed - now));
+            }
+            allowed = std::max(allowed, now > period_ns ? now - period_ns : 0) + period_ns;
+        }
+        uint64_t t = nowNs(), captured_ns = 0;
+        if (hand_over->publish(captured_ns)) {
+            uint64_t now = nowNs();
+            stats.publish_ns += now - t;
+            stats.published++;
+            stats.latency.add((now - captured_ns) * 1e-9);
+        } else if (last) {
+            break;
+        }
+        if (hand_over->eventDriven()) {
+            continue;
+        }
+        if (opt.publish_fps > 0) {
+            pacer.sleep();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    capture_thread.join();
+    stats.captured++;
+
+    stats.seconds = (nowNs() - start) * 1e-9;
+    stats.dropped = hand_over->dropped();
+    stats.mat_allocations = g_mat_allocator->allocations - mat_allocations;
+    stats.mat_bytes = g_mat_allocator->bytes - mat_bytes;
+    stats.allocations = g_allocations - allocations;
+    return stats;
+}
+
+std::vector<std::string> split(const std::string &s) {
+    std::vector<std::string> out;
+    size_t begin = 0;
+    while (begin <= s.size()) {
+        size_t end = s.find(',', begin);
+        if (end == std::string::npos) {
+            end = s.size();
+        }
+        if (end > begin) {
+            out.push_back(s.substr(begin, end - begin));
+        }
+        begin = end + 1;
+    }
+    return out;
+}
+
+void usage() {
+    fprintf(stderr, "usage: video_stream_benchmark [--frames N] [--fps 30] [--publish-fps F]\n"
+                    "                              [--queue 100] [--width 640] [--height 480]\n"
+                    "                              [--modes queue,pool,message,latest]\n");
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        if (arg == "--frames") {
+            opt.frames = atoi(argv[++i]);
+        } else if (arg == "--fps") {
+            opt.fps = atof(argv[++i]);
+        } else if (arg == "--publish-fps") {
+            opt.publish_fps = atof(argv[++i]);
+        } else if (arg == "--queue") {
+            opt.queue = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--width") {
+            opt.width = atoi(argv[++i]);
+        } else if (arg == "--height") {
+            opt.height = atoi(argv[++i]);
+        } else if (arg == "--modes") {
+            opt.modes = split(argv[++i]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (opt.publish_fps < 0) {
+        opt.publish_fps = opt.fps;
+    }
+
+    g_mat_allocator = new CountingAllocator(cv::Mat::getDefaultAllocator());
+    cv::Mat::setDefaultAllocator(g_mat_allocator);
+
+    printf("{\n  \"frames\": %d, \"fps\": %.1f, \"publish_fps\": %.1f, \"queue\": %d, \"size\": [%d, %d],\n"
+           "  \"modes\": [\n", opt.frames, opt.fps, opt.publish_fps, opt.queue, opt.width, opt.height);
+    for (size_t m = 0; m < opt.modes.size(); m++) {
+        if (!makeHandOver(opt.modes[m], 1)) {
+            fprintf(stderr, "unknown mode %s\n", opt.modes[m].c_str());
+            return 1;
+        }
+        Stats s = run(opt.modes[m], opt);
+        // per frame figures are over the frames after the first
+        double n = s.captured > 1 ? s.captured - 1 : 1;
+        printf("    {\"mode\": \"%s\", \"captured\": %lu, \"published\": %lu, \"dropped\": %lu,\n"
+               "     \"first_frame\": {\"capture_us\": %.1f, \"mat_allocations\": %lu, \"mat_mb\": %.1f},\n"
+               "     \"capture_us_per_frame\": %.1f, \"publish_us_per_frame\": %.1f,\n"
+               "     \"mat_allocations_per_frame\": %.3f, \"mat_mb\": %.1f, \"allocations_per_frame\": %.3f,\n"
+               "     \"latency_ms\": {\"mean\": %.2f, \"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f},\n"
+               "     \"seconds\": %.2f}%s\n",
+               s.mode.c_str(), (unsigned long)s.captured, (unsigned long)s.published, (unsigned long)s.dropped,
+               s.first_ns * 1e-3, (unsigned long)s.first_mat_allocations, s.first_mat_bytes / 1048576.0,
+               s.capture_ns * 1e-3 / n, s.published ? s.publish_ns * 1e-3 / s.published : 0.0,
+               s.mat_allocations / n, s.mat_bytes / 1048576.0, s.allocations / n,
+               s.latency.mean() * 1e3, s.latency.percentile(0.5) * 1e3, s.latency.percentile(0.99) * 1e3,
+               s.latency.max() * 1e3, s.seconds,
+               m + 1 < opt.modes.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef VIDEO_STREAM_OPENCV_CAPTURE_CLOCK_H
+#define VIDEO_STREAM_OPENCV_CAPTURE_CLOCK_H
+
+#include <math.h>
+#include <algorithm>
+
+namespace video_stream_opencv {
+
+/**
+ * Maps the timestamp a VideoCapture backend gives for the last frame
+ * (CAP_PROP_POS_MSEC) to the monotonic clock the reads are timed with.
+ *
+ * V4L2 reports the driver's buffer time, already on the monotonic clock, and
+ * is used as is. GStreamer reports the buffer PTS in pipeline running time
+ * and video files their position: for those the offset to the read times is
+ * the smallest read - timestamp seen, so the least delayed frame defines the
+ * clock. The offset may grow by `drift` seconds per second to follow a
+ * source clock slower than ours. Whatever constant latency that frame had is
+ * not observable and ends up in the offset. Without a usable timestamp the
+ * read time is the capture time.
+ */
+class CaptureClock {
+public:
+  enum Source { READ_TIME, MONOTONIC, RELATIVE };
+
+  explicit CaptureClock(double drift = 1e-3)
+    : drift_(drift), source_(READ_TIME), offset_(0), last_stamp_(-1), last_read_(0) {}
+
+  /**
+   * @param pos_msec  CAP_PROP_POS_MSEC right after the read
+   * @param read      monotonic time the read returned [s]
+   * @return          monotonic time the frame was captured [s], never after read
+   */
+  double capture(double pos_msec, double read) {
+    if (!(pos_msec > 0.0) || isinf(pos_msec)) {
+      source_ = READ_TIME;
+      last_stamp_ = -1;
+      return read;
+    }
+    double stamp = pos_msec * 1e-3;
+    if (fabs(read - stamp) < MONOTONIC_WINDOW) {
+      source_ = MONOTONIC;
+      return std::min(stamp, read);
+    }
+    source_ = RELATIVE;
+    if (last_stamp_ < 0 || stamp < last_stamp_ || stamp - last_stamp_ > RESET_GAP) {
+      // first frame, a reopened stream or a looped file
+      offset_ = read - stamp;
+    } else {
+      offset_ = std::min(offset_ + drift_ * (read - last_read_), read - stamp);
+    }
+    last_stamp_ = stamp;
+    last_read_ = read;
+    return stamp + offset_;
+  }
+
+  /** Where the last capture time came from */
+  Source source() const { return source_; }
+
+  static const char* name(Source source) {
+    return source == MONOTONIC ? "monotonic" : source == RELATIVE ? "relative" : "read_time";
+  }
+
+private:
+  // backend timestamps this close to the read time are on the monotonic clock [s]
+  static constexpr double MONOTONIC_WINDOW = 5.0;
+  // a jump forward this large restarts the mapping [s]
+  static constexpr double RESET_GAP = 10.0;
+
+  double drift_;
+  Source source_;
+  double offset_;
+  double last_stamp_, last_read_;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef VIDEO_STREAM_OPENCV_FRAME_POOL_H
+#define VIDEO_STREAM_OPENCV_FRAME_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include <boost/scoped_array.hpp>
+
+namespace video_stream_opencv {
+
+/**
+ * Fixed set of frame buffers handed between the capture thread (producer)
+ * and the publisher (consumer) without locks or copies.
+ *
+ * Slots are indices into the preallocated frames. The producer acquire()s a
+ * slot, decodes into it and push()es it; when `capacity` frames are already
+ * queued the oldest one is dropped and becomes the next slot to write. The
+ * consumer pop()s the oldest queued slot, any thread release()s it once it is
+ * no longer used.
+ *
+ * There are capacity + 1 + `held` slots: the queued ones, the one being
+ * written and those popped but not released yet. As long as no more than
+ * `held` are out acquire() always finds a slot.
+ */
+template <typename Frame>
+class FramePool {
+public:
+  explicit FramePool(size_t capacity, size_t held = 2)
+    : capacity_(capacity ? capacity : 1), frames_(capacity_ + 1 + held),
+      queue_(new std::atomic<int>[capacity_]), head_(0), tail_(0),
+      free_(new FreeCell[frames_.size()]), free_head_(0), free_tail_(frames_.size()),
+      spare_(-1), dropped_(0) {
+    for (size_t i = 0; i < frames_.size(); i++) {
+      free_[i].slot = (int)i;
+      free_[i].seq.store(i + 1, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  Frame &frame(int slot) { return frames_[slot]; }
+  size_t slots() const { return frames_.size(); }
+  size_t capacity() const { return capacity_; }
+
+  /** Frames waiting for the consumer */
+  size_t size() const {
+    return (size_t)(tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire));
+  }
+
+  /** Frames dropped because the queue was full, producer side */
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  /** Producer: a slot to write the next frame into, -1 if all are held */
+  int acquire() {
+    int slot;
+    if (spare_ >= 0) {
+      slot = spare_;
+      spare_ = -1;
+      return slot;
+    }
+    FreeCell &cell = free_[free_head_ % frames_.size()];
+    if (cell.seq.load(std::memory_order_acquire) == free_head_ + 1) {
+      slot = cell.slot;
+      cell.seq.store(free_head_ + frames_.size(), std::memory_order_release);
+      free_head_++;
+      return slot;
+    }
+    // everything else is queued or held, reuse the oldest queued frame
+    if (take(slot)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return slot;
+    }
+    return -1;
+  }
+
+  /** Producer: queue a written slot, dropping the oldest frame when full */
+  void push(int slot) {
+    uint64_t t = tail_.load(std::memory_order_relaxed);
+    while (t - head_.load(std::memory_order_acquire) >= capacity_) {
+      int oldest;
+      if (take(oldest)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        spare_ = oldest;
+      }
+    }
+    queue_[t % capacity_].store(slot, std::memory_order_relaxed);
+    tail_.store(t + 1, std::memory_order_release);
+  }
+
+  /** Consumer: the oldest queued slot, -1 if there is none */
+  int pop() {
+    int slot;
+    return take(slot) ? slot : -1;
+  }
+
+  /** Any thread: give a popped slot back to the producer */
+  void release(int slot) {
+    // bounded multi producer queue with a sequence per cell, it never fills up
+    // as every slot is in it at most once
+    uint64_t t = free_tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      FreeCell &cell = free_[t % frames_.size()];
+      if (cell.seq.load(std::memory_order_acquire) == t &&
+          free_tail_.compare_exchange_weak(t, t + 1, std::memory_order_relaxed)) {
+        cell.slot = slot;
+        cell.seq.store(t + 1, std::memory_order_release);
+        return;
+      }
+      t = free_tail_.load(std::memory_order_relaxed);
+    }
+  }
+
+private:
+  // both sides advance head_, a stale read of the ring fails the exchange
+  bool take(int &slot) {
+    uint64_t h = head_.load(std::memory_order_acquire);
+    do {
+      if (h == tail_.load(std::memory_order_acquire)) {
+        return false;
+      }
+      slot = queue_[h % capacity_].load(std::memory_order_relaxed);
+    } while (!head_.compare_exchange_weak(h, h + 1, std::memory_order_acq_rel,
+                                          std::memory_order_acquire));
+    return true;
+  }
+
+  const size_t capacity_;
+  std::vector<Frame> frames_;
+
+  // queued slots, oldest at head_
+  boost::scoped_array<std::atomic<int> > queue_;
+  std::atomic<uint64_t> head_, tail_;
+
+  // released slots, cell i holds the free slot at position p when seq == p + 1
+  struct FreeCell {
+    std::atomic<uint64_t> seq;
+    int slot;
+  };
+  boost::scoped_array<FreeCell> free_;
+  uint64_t free_head_;  // producer only
+  std::atomic<uint64_t> free_tail_;
+
+  int spare_;  // dropped by push(), producer only
+  std::atomic<uint64_t> dropped_;
+};
+
+} // namespace
+
+#endif
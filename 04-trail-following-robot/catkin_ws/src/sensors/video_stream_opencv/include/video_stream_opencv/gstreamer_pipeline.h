@@ -0,0 +1,88 @@
+#ifndef VIDEO_STREAM_OPENCV_GSTREAMER_PIPELINE_H
+#define VIDEO_STREAM_OPENCV_GSTREAMER_PIPELINE_H
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace video_stream_opencv {
+
+/** What the GStreamer pipeline of a numeric video_stream_provider does */
+struct GstPipelineConfig {
+  std::string source;     // nvarguscamerasrc, v4l2src or videotestsrc
+  int device;             // sensor-id, /dev/video<device>
+  int capture_width;      // asked from the source
+  int capture_height;
+  int framerate;
+  int width;              // published size, 0 keeps the capture size
+  int height;
+  bool flip_horizontal;
+  bool flip_vertical;
+  std::string encoding;   // bgr8, rgb8 or mono8
+
+  GstPipelineConfig()
+    : source("nvarguscamerasrc"), device(0), capture_width(1920), capture_height(1080), framerate(30),
+      width(640), height(480), flip_horizontal(false), flip_vertical(false), encoding("bgr8") {}
+};
+
+/**
+ * The pipeline for cv::VideoCapture::open(pipeline, cv::CAP_GSTREAMER): the
+ * source at the capture size, then scaling, flipping and conversion to the
+ * published encoding in GStreamer (nvvidconv on the Jetson), so the frames
+ * reach the appsink as they are published. OpenCV only takes BGR and GRAY8
+ * from an appsink, rgb8 frames are relabelled BGR with capssetter and
+ * published with their real encoding.
+ *
+ * Throws std::invalid_argument for an unknown source or encoding.
+ */
+inline std::string gstreamer_pipeline(const GstPipelineConfig& c) {
+  if (c.encoding != "bgr8" && c.encoding != "rgb8" && c.encoding != "mono8")
+    throw std::invalid_argument("unsupported encoding '" + c.encoding + "', use bgr8, rgb8 or mono8");
+  int width = c.width > 0 ? c.width : c.capture_width;
+  int height = c.height > 0 ? c.height : c.capture_height;
+  const char* format = c.encoding == "mono8" ? "GRAY8" : c.encoding == "rgb8" ? "RGB" : "BGR";
+
+  std::ostringstream p;
+  if (c.source == "nvarguscamerasrc") {
+    // nvvidconv scales and flips in hardware, flip-method 2 rotates by 180, 4 and 6 flip
+    int flip_method = c.flip_horizontal && c.flip_vertical ? 2 : c.flip_horizontal ? 4 : c.flip_vertical ? 6 : 0;
+    p << "nvarguscamerasrc sensor-id=" << c.device << " ! video/x-raw(memory:NVMM), width=(int)" << c.capture_width
+      << ", height=(int)" << c.capture_height << ", format=(string)NV12, framerate=(fraction)" << c.framerate
+      << "/1 ! nvvidconv flip-method=" << flip_method << " ! video/x-raw, width=(int)" << width
+      << ", height=(int)" << height;
+    // nvvidconv gives gray directly, the 3 channel formats only with a 4th channel
+    if (c.encoding == "mono8")
+      p << ", format=(string)GRAY8";
+    else
+      p << ", format=(string)" << (c.encoding == "rgb8" ? "RGBA" : "BGRx") << " ! videoconvert";
+  }
+  else if (c.source == "v4l2src" || c.source == "videotestsrc") {
+    if (c.source == "v4l2src")
+      p << "v4l2src device=/dev/video" << c.device;
+    else
+      p << "videotestsrc is-live=true";
+    p << " ! video/x-raw, width=(int)" << c.capture_width << ", height=(int)" << c.capture_height
+      << ", framerate=(fraction)" << c.framerate << "/1";
+    if (width != c.capture_width || height != c.capture_height)
+      p << " ! videoscale ! video/x-raw, width=(int)" << width << ", height=(int)" << height;
+    // flipped after scaling, on the smaller frame
+    if (c.flip_horizontal || c.flip_vertical)
+      p << " ! videoflip method=" << (c.flip_horizontal && c.flip_vertical ? "rotate-180" :
+                                      c.flip_horizontal ? "horizontal-flip" : "vertical-flip");
+    p << " ! videoconvert";
+  }
+  else {
+    throw std::invalid_argument("unsupported GStreamer source '" + c.source +
+                                "', use nvarguscamerasrc, v4l2src or videotestsrc");
+  }
+  if (c.encoding != "mono8" || c.source != "nvarguscamerasrc")
+    p << " ! video/x-raw, format=(string)" << format;
+  if (c.encoding == "rgb8")
+    p << " ! capssetter caps=\"video/x-raw, format=(string)BGR\"";
+  p << " ! appsink";
+  return p.str();
+}
+
+} // namespace
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef VIDEO_STREAM_OPENCV_IMAGE_SLOT_H
+#define VIDEO_STREAM_OPENCV_IMAGE_SLOT_H
+
+#include <chrono>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/core/core.hpp>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <video_stream_opencv/capture_clock.h>
+#include <video_stream_opencv/frame_pool.h>
+
+namespace video_stream_opencv {
+
+/**
+ * A published frame: the capture thread decodes into `mat`, a header over
+ * `msg.data`, and the message itself is what subscribers receive.
+ */
+struct ImageSlot {
+  sensor_msgs::Image msg;
+  sensor_msgs::CameraInfo info;
+  cv::Mat mat;
+  std::chrono::steady_clock::time_point captured;  // when read returned
+  ros::Time capture;                                // frame taken, the header stamp
+  ros::Time read;                                   // when read returned
+  uint64_t sequence;                                // frames read before this one
+  CaptureClock::Source clock;                       // where capture comes from
+
+  /** True while mat still points into msg.data */
+  bool wrapsMessage() const {
+    return !msg.data.empty() && mat.data == &msg.data[0];
+  }
+
+  /** Size msg.data for rows x cols of type and point mat at it */
+  void wrap(int rows, int cols, int type) {
+    size_t step = cols * CV_ELEM_SIZE(type);
+    msg.height = rows;
+    msg.width = cols;
+    msg.step = step;
+    msg.is_bigendian = false;
+    msg.data.resize(step * rows);
+    mat = cv::Mat(rows, cols, type, &msg.data[0], step);
+  }
+
+  /**
+   * After a VideoCapture::read that had to allocate (first frame or a new
+   * size) the frame lives in a Mat of its own: move it into the message.
+   * Returns false if nothing had to be done.
+   */
+  bool adopt() {
+    if (mat.empty() || wrapsMessage())
+      return false;
+    cv::Mat decoded = mat;
+    wrap(decoded.rows, decoded.cols, decoded.type());
+    decoded.copyTo(mat);
+    return true;
+  }
+};
+
+typedef FramePool<ImageSlot> ImagePool;
+
+/** shared_ptr deleter giving the slot back once the last subscriber let go of the message */
+class SlotRecycler {
+public:
+  SlotRecycler(const boost::shared_ptr<ImagePool>& pool, int slot) : pool_(pool), slot_(slot) {}
+
+  void operator()(sensor_msgs::Image*) {
+    pool_->release(slot_);
+  }
+
+private:
+  boost::shared_ptr<ImagePool> pool_;
+  int slot_;
+};
+
+/** The slot's message as subscribers get it, the pool stays alive as long as it is referenced */
+inline sensor_msgs::ImagePtr share(const boost::shared_ptr<ImagePool>& pool, int slot) {
+  return sensor_msgs::ImagePtr(&pool->frame(slot).msg, SlotRecycler(pool, slot));
+}
+
+/** The slot's camera info, sharing the message's reference count */
+inline sensor_msgs::CameraInfoPtr shareInfo(const sensor_msgs::ImagePtr& image, ImageSlot& slot) {
+  return sensor_msgs::CameraInfoPtr(image, &slot.info);
+}
+
+} // namespace
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef VIDEO_STREAM_OPENCV_JPEG_ENCODER_POOL_H
+#define VIDEO_STREAM_OPENCV_JPEG_ENCODER_POOL_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/function.hpp>
+#include <turbojpeg.h>
+#include <ros/console.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CompressedImage.h>
+
+namespace video_stream_opencv {
+
+/**
+ * JPEG encoding of published frames with libjpeg-turbo on a few worker
+ * threads, each with its own compressor and output buffer.
+ *
+ * submit() only queues the message, it never waits for an encoder: frames
+ * are skipped when every worker is busy, when the frame skip says so or while
+ * the encoded bytes are over max_bandwidth (a token bucket holding half a
+ * second). Workers hold the message until it is encoded, at most one per
+ * worker. Results are published in capture order, a frame that finishes
+ * after a newer one is dropped.
+ */
+class JpegEncoderPool {
+public:
+  typedef boost::function<void(const sensor_msgs::CompressedImagePtr&)> Publish;
+
+  JpegEncoderPool(size_t workers, const Publish& publish)
+    : publish_(publish), quality_(80), skip_(0), max_bandwidth_(0), frames_(0), busy_(0), stop_(false),
+      tokens_(0), encoded_(0), dropped_(0), failed_(0), last_sequence_(0), published_(false) {
+    for (size_t i = 0; i < std::max<size_t>(workers, 1); i++)
+      workers_.push_back(std::thread(&JpegEncoderPool::work, this));
+  }
+
+  ~JpegEncoderPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    ready_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++)
+      workers_[i].join();
+  }
+
+  size_t workers() const { return workers_.size(); }
+
+  /**
+   * @param quality        1 - 100
+   * @param skip           frames skipped after each encoded one
+   * @param max_bandwidth  encoded bytes per second, 0 for no limit
+   */
+  void configure(int quality, int skip, double max_bandwidth) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quality_ = std::min(std::max(quality, 1), 100);
+    skip_ = std::max(skip, 0);
+    max_bandwidth = std::max(max_bandwidth, 0.0);
+    if (max_bandwidth != max_bandwidth_) {
+      // a new limit starts with a full bucket
+      max_bandwidth_ = max_bandwidth;
+      tokens_ = max_bandwidth_ * BURST;
+      refilled_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  /** Publisher thread: queue image for encoding, false if it is skipped */
+  bool submit(const sensor_msgs::ImageConstPtr& image, uint64_t sequence) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (frames_++ % (skip_ + 1) != 0)
+      return false;
+    if (max_bandwidth_ > 0) {
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      double elapsed = std::chrono::duration<double>(now - refilled_).count();
+      tokens_ = std::min(max_bandwidth_ * BURST, tokens_ + max_bandwidth_ * elapsed);
+      refilled_ = now;
+      if (tokens_ <= 0) {
+        dropped_++;
+        return false;
+      }
+    }
+    if (jobs_.size() + busy_ >= workers_.size()) {
+      dropped_++;
+      return false;
+    }
+    Job job = { image, sequence };
+    jobs_.push_back(job);
+    ready_.notify_one();
+    return true;
+  }
+
+  uint64_t encoded() const { std::lock_guard<std::mutex> lock(mutex_); return encoded_; }
+  /** Frames not encoded for lack of a worker or bandwidth, or finished out of order */
+  uint64_t dropped() const { std::lock_guard<std::mutex> lock(mutex_); return dropped_; }
+  uint64_t failed() const { std::lock_guard<std::mutex> lock(mutex_); return failed_; }
+
+private:
+  // the bucket holds this many seconds of max_bandwidth
+  static constexpr double BURST = 0.5;
+
+  struct Job {
+    sensor_msgs::ImageConstPtr image;
+    uint64_t sequence;
+  };
+
+  void work() {
+    tjhandle compressor = tjInitCompress();
+    unsigned char* buffer = NULL;
+    unsigned long capacity = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      ready_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+      if (stop_)
+        break;
+      Job job = jobs_.front();
+      jobs_.pop_front();
+      int quality = quality_;
+      busy_++;
+      lock.unlock();
+      sensor_msgs::CompressedImagePtr msg = encode(compressor, buffer, capacity, *job.image, quality);
+      // the frame goes back to the capture pool before publishing
+      job.image.reset();
+      lock.lock();
+      busy_--;
+      if (!msg) {
+        failed_++;
+        continue;
+      }
+      if (max_bandwidth_ > 0)
+        tokens_ -= msg->data.size();
+      lock.unlock();
+      bool in_order = publish(msg, job.sequence);
+      lock.lock();
+      if (in_order)
+        encoded_++;
+      else
+        dropped_++;
+    }
+    lock.unlock();
+    tjFree(buffer);
+    tjDestroy(compressor);
+  }
+
+  sensor_msgs::CompressedImagePtr encode(tjhandle compressor, unsigned char*& buffer, unsigned long& capacity,
+                                         const sensor_msgs::Image& image, int quality) {
+    int format = image.encoding == "bgr8" ? TJPF_BGR : image.encoding == "rgb8" ? TJPF_RGB :
+                 image.encoding == "mono8" ? TJPF_GRAY : -1;
+    if (format < 0 || image.data.empty()) {
+      ROS_ERROR_STREAM_THROTTLE(10.0, "Can't encode " << image.encoding << " images to JPEG");
+      return sensor_msgs::CompressedImagePtr();
+    }
+    int subsampling = format == TJPF_GRAY ? TJSAMP_GRAY : TJSAMP_420;
+    // the worker's buffer grows to the largest frame and is reused from then on
+    unsigned long bound = tjBufSize(image.width, image.height, subsampling);
+    if (bound > capacity) {
+      tjFree(buffer);
+      buffer = tjAlloc(bound);
+      capacity = buffer ? bound : 0;
+    }
+    unsigned long size = capacity;
+    if (!compressor || !buffer ||
+        tjCompress2(compressor, const_cast<unsigned char*>(&image.data[0]), image.width, image.step, image.height,
+                    format, &buffer, &size, subsampling, quality, TJFLAG_NOREALLOC | TJFLAG_FASTDCT) != 0) {
+      ROS_ERROR_STREAM_THROTTLE(10.0, "JPEG encoding failed: " << tjGetErrorStr());
+      return sensor_msgs::CompressedImagePtr();
+    }
+    sensor_msgs::CompressedImagePtr msg(new sensor_msgs::CompressedImage);
+    msg->header = image.header;
+    // what compressed_image_transport decodes
+    msg->format = image.encoding + "; jpeg compressed " + (format == TJPF_GRAY ? "mono8" : "bgr8");
+    msg->data.assign(buffer, buffer + size);
+    return msg;
+  }
+
+  bool publish(const sensor_msgs::CompressedImagePtr& msg, uint64_t sequence) {
+    std::lock_guard<std::mutex> lock(publish_mutex_);
+    if (published_ && sequence <= last_sequence_)
+      return false;
+    published_ = true;
+    last_sequence_ = sequence;
+    publish_(msg);
+    return true;
+  }
+
+  Publish publish_;
+  std::vector<std::thread> workers_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<Job> jobs_;
+  int quality_, skip_;
+  double max_bandwidth_;
+  uint64_t frames_;
+  size_t busy_;
+  bool stop_;
+  // encoded bytes that may still go out, refilled at max_bandwidth
+  double tokens_;
+  std::chrono::steady_clock::time_point refilled_;
+  uint64_t encoded_, dropped_, failed_;
+
+  // workers finish out of order, only newer frames are published
+  std::mutex publish_mutex_;
+  uint64_t last_sequence_;
+  bool published_;
+};
+
+} // namespace
+
+#endif
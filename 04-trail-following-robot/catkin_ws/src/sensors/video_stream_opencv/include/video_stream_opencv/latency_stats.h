@@ -0,0 +1,49 @@
+#ifndef VIDEO_STREAM_OPENCV_LATENCY_STATS_H
+#define VIDEO_STREAM_OPENCV_LATENCY_STATS_H
+
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+
+namespace video_stream_opencv {
+
+/** Capture to publish latencies over a reporting period, in seconds */
+class LatencyStats {
+public:
+  explicit LatencyStats(size_t expected = 1024) : sum_(0), max_(0) {
+    samples_.reserve(expected);
+  }
+
+  void add(double latency) {
+    samples_.push_back(latency);
+    sum_ += latency;
+    max_ = std::max(max_, latency);
+  }
+
+  size_t count() const { return samples_.size(); }
+  double mean() const { return samples_.empty() ? 0.0 : sum_ / samples_.size(); }
+  double max() const { return max_; }
+
+  /** q in [0, 1], sorts the samples */
+  double percentile(double q) {
+    if (samples_.empty())
+      return 0.0;
+    size_t k = std::min(samples_.size() - 1, (size_t)(q * (samples_.size() - 1) + 0.5));
+    std::nth_element(samples_.begin(), samples_.begin() + k, samples_.end());
+    return samples_[k];
+  }
+
+  /** Start a new period, the sample buffer is kept */
+  void clear() {
+    samples_.clear();
+    sum_ = max_ = 0;
+  }
+
+private:
+  std::vector<double> samples_;
+  double sum_, max_;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef VIDEO_STREAM_OPENCV_RESIZED_OUTPUT_H
+#define VIDEO_STREAM_OPENCV_RESIZED_OUTPUT_H
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <sensor_msgs/Image.h>
+
+namespace video_stream_opencv {
+
+/** An extra topic with a downscaled copy of the published frames */
+struct OutputSpec {
+  std::string topic;
+  int width;
+  int height;
+  cv::Rect crop;   // of the published frame, empty for the whole frame
+  bool tensor;     // planar 32FC1 of (pixel / 255 - mean) / std instead of an image
+  double mean;
+  double std;
+
+  OutputSpec() : width(0), height(0), tensor(false), mean(0.5), std(1.0) {}
+};
+
+/**
+ * Renders one output from the published frame. The area resize runs on the
+ * 8 bit frame (cv::resize INTER_AREA, vectorized by OpenCV), only the small
+ * result is converted to float. Images are resized straight into the
+ * message; tensors are NCHW with the channels in RGB order, published as a
+ * 32FC1 image of channels * height rows: reshape the data to
+ * (1, channels, height, width).
+ */
+class ResizedOutput {
+public:
+  explicit ResizedOutput(const OutputSpec& spec) : spec_(spec) {}
+
+  const OutputSpec& spec() const { return spec_; }
+
+  /** frame is the published frame in `encoding`, msg gets everything but the header */
+  void render(const cv::Mat& frame, const std::string& encoding, sensor_msgs::Image& msg) {
+    cv::Rect roi(0, 0, frame.cols, frame.rows);
+    if (spec_.crop.area() > 0 && (spec_.crop & roi).area() > 0)
+      roi &= spec_.crop;
+    cv::Size size(spec_.width, spec_.height);
+    int channels = frame.channels();
+    msg.is_bigendian = false;
+    if (!spec_.tensor) {
+      msg.encoding = encoding;
+      msg.height = size.height;
+      msg.width = size.width;
+      msg.step = size.width * frame.elemSize();
+      msg.data.resize(msg.step * msg.height);
+      cv::Mat dst(size, frame.type(), &msg.data[0], msg.step);
+      cv::resize(frame(roi), dst, size, 0, 0, cv::INTER_AREA);
+      return;
+    }
+    cv::resize(frame(roi), resized_, size, 0, 0, cv::INTER_AREA);
+    resized_.convertTo(normalized_, CV_32F, 1.0 / (255.0 * spec_.std), -spec_.mean / spec_.std);
+    size_t plane = (size_t)size.area() * sizeof(float);
+    msg.encoding = "32FC1";
+    msg.height = channels * size.height;
+    msg.width = size.width;
+    msg.step = size.width * sizeof(float);
+    msg.data.resize(plane * channels);
+    // split writes each channel into its plane of the message, bgr8 planes in reverse
+    planes_.resize(channels);
+    for (int c = 0; c < channels; c++) {
+      int p = encoding == "bgr8" ? channels - 1 - c : c;
+      planes_[c] = cv::Mat(size, CV_32F, &msg.data[p * plane]);
+    }
+    cv::split(normalized_, &planes_[0]);
+  }
+
+private:
+  OutputSpec spec_;
+  // reused between frames
+  cv::Mat resized_, normalized_;
+  std::vector<cv::Mat> planes_;
+};
+
+} // namespace
+
+#endif
@@ -42,14 +42,24 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <cv_bridge/cv_bridge.h>
+#include <algorithm>
+#include <atomic>
 #include <sstream>
 #include <stdexcept>
 #include <boost/filesystem.hpp>
 #include <boost/assign/list_of.hpp>
 #include <boost/thread/thread.hpp>
-#include <queue>
+#include <condition_variable>
 #include <mutex>
 #include <video_stream_opencv/VideoStreamConfig.h>
+#include <video_stream_opencv/FrameStats.h>
+#include <video_stream_opencv/gstreamer_pipeline.h>
+#include <video_stream_opencv/image_slot.h>
+#ifdef VIDEO_STREAM_OPENCV_TURBOJPEG
+#include <video_stream_opencv/jpeg_encoder_pool.h>
+#endif
+#include <video_stream_opencv/latency_stats.h>
+#include <video_stream_opencv/resized_output.h>
 
 namespace fs = boost::filesystem;
 
@@ -59,10 +69,39 @@ class VideoStreamNodelet: public nodelet::Nodelet {
 protected:
 boost::shared_ptr<ros::NodeHandle> nh, pnh;
 image_transport::CameraPublisher pub;
+ros::Publisher stats_pub;
+// downscaled copies of the published frames, rendered only while subscribed
+struct Output {
+  ResizedOutput resized;
+  image_transport::Publisher image_pub;
+  ros::Publisher tensor_pub;
+  explicit Output(const OutputSpec& spec) : resized(spec) {}
+  uint32_t subscribers() const {
+    return resized.spec().tensor ? tensor_pub.getNumSubscribers() : image_pub.getNumSubscribers();
+  }
+};
+std::vector<boost::shared_ptr<Output> > outputs;
+// <jpeg_topic>/compressed encoded off the publish thread, for remote viewers
+bool jpeg_output;
+int jpeg_threads;
+std::string jpeg_topic;
+ros::Publisher jpeg_pub;
+#ifdef VIDEO_STREAM_OPENCV_TURBOJPEG
+boost::shared_ptr<JpegEncoderPool> jpeg;
+#endif
+int jpeg_quality;
+int jpeg_skip;
+double jpeg_max_bandwidth;
 boost::shared_ptr<dynamic_reconfigure::Server<VideoStreamConfig> > dyn_srv;
-std::mutex q_mutex, s_mutex;
-std::queue<cv::Mat> framesQueue;
-cv::Mat frame;
+std::mutex s_mutex;
+// captured frames, decoded straight into the messages that get published
+// the first ones are allocated up front, the others when the queue first needs them
+static const size_t PREALLOCATED_FRAMES = 8;
+boost::shared_ptr<ImagePool> frames;
+int held_frames;
+// latest_frame_only: the capture thread wakes the publish thread for each frame
+std::mutex f_mutex;
+std::condition_variable frame_cv;
 boost::shared_ptr<cv::VideoCapture> cap;
 std::string video_stream_provider;
 std::string video_stream_provider_type;
@@ -78,37 +117,57 @@ int width_target;
 int height_target;
 bool flip_horizontal;
 bool flip_vertical;
+// numeric providers: GStreamer source, its capture size and the published encoding
+std::string gst_source;
+int capture_width;
+int capture_height;
+std::string encoding;
+// what the opened stream delivers, set on subscribe
+bool flip_in_pipeline;
+std::string published_encoding;
+bool latest_frame_only;
 bool capture_thread_running;
+bool publish_thread_running;
 bool reopen_on_read_failure;
 boost::thread capture_thread;
+boost::thread publish_thread;
 ros::Timer publish_timer;
+// published frames, skipped ones and latencies since the last report
+double stats_period;
+ros::WallTime stats_start;
+uint64_t published_frames;
+uint64_t skipped_frames;
+LatencyStats pipeline_latency, queue_latency;
+// since the stream was opened, for frame_stats
+std::atomic<uint64_t> read_failures;
+std::atomic<uint64_t> exhausted_frames;
 sensor_msgs::CameraInfo cam_info_msg;
 
 // Based on the ros tutorial on transforming opencv images to Image messages
 
-virtual sensor_msgs::CameraInfo get_default_camera_info_from_image(sensor_msgs::ImagePtr img){
+virtual sensor_msgs::CameraInfo get_default_camera_info_from_image(const sensor_msgs::Image& img){
     sensor_msgs::CameraInfo cam_info_msg;
-    cam_info_msg.header.frame_id = img->header.frame_id;
+    cam_info_msg.header.frame_id = img.header.frame_id;
     // Fill image size
-    cam_info_msg.height = img->height;
-    cam_info_msg.width = img->width;
-    NODELET_INFO_STREAM("The image width is: " << img->width);
-    NODELET_INFO_STREAM("The image height is: " << img->height);
+    cam_info_msg.height = img.height;
+    cam_info_msg.width = img.width;
+    NODELET_INFO_STREAM("The image width is: " << img.width);
+    NODELET_INFO_STREAM("The image height is: " << img.height);
     // Add the most common distortion model as sensor_msgs/CameraInfo says
     cam_info_msg.distortion_model = "plumb_bob";
     // Don't let distorsion matrix be empty
     cam_info_msg.D.resize(5, 0.0);
     // Give a reasonable default intrinsic camera matrix
-    cam_info_msg.K = boost::assign::list_of(1.0) (0.0) (img->width/2.0)
-            (0.0) (1.0) (img->height/2.0)
+    cam_info_msg.K = boost::assign::list_of(1.0) (0.0) (img.width/2.0)
+            (0.0) (1.0) (img.height/2.0)
             (0.0) (0.0) (1.0);
     // Give a reasonable default rectification matrix
     cam_info_msg.R = boost::assign::list_of (1.0) (0.0) (0.0)
             (0.0) (1.0) (0.0)
             (0.0) (0.0) (1.0);
     // Give a reasonable default projection matrix
-    cam_info_msg.P = boost::assign::list_of (1.0) (0.0) (img->width/2.0) (0.0)
-            (0.0) (1.0) (img->height/2.0) (0.0)
+    cam_info_msg.P = boost::assign::list_of (1.0) (0.0) (img.width/2.0) (0.0)
+            (0.0) (1.0) (img.height/2.0) (0.0)
             (0.0) (0.0) (1.0) (0.0);
     return cam_info_msg;
 }
@@ -116,10 +175,17 @@ virtual sensor_msgs::CameraInfo get_default_camera_info_from_image(sensor_msgs::
 
 virtual void do_capture() {
     NODELET_DEBUG("Capture thread started");
-    cv::Mat frame;
     ros::Rate camera_fps_rate(set_camera_fps);
 
     int frame_counter = 0;
+    bool preallocated = false;
+    uint64_t captured = 0, reallocated = 0;
+    CaptureClock capture_clock;
+    // subscribe() replaces the pool, this thread keeps the one it started with
+    boost::shared_ptr<ImagePool> frames = this->frames;
+    int slot = frames->acquire();
+    // frames are read here and dropped while subscribers hold every slot
+    cv::Mat scratch;
     // Read frames as fast as possible
     capture_thread_running = true;
     while (nh->ok() && capture_thread_running && subscriber_num > 0) {
@@ -128,7 +194,24 @@ virtual void do_capture() {
           cv::waitKey(100);
           continue;
         }
-        if (!cap->read(frame)) {
+        if (slot < 0)
+            slot = frames->acquire();
+        // VideoCapture::read writes into the message when size and type match
+        cv::Mat& frame = slot >= 0 ? frames->frame(slot).mat : scratch;
+        bool read = cap->read(frame);
+        if (read && slot >= 0) {
+            // stamped before anything else can delay us
+            ImageSlot& image = frames->frame(slot);
+            image.captured = std::chrono::steady_clock::now();
+            image.read = ros::Time::now();
+            double read_time = std::chrono::duration<double>(image.captured.time_since_epoch()).count();
+            double capture_time = capture_clock.capture(cap->get(CV_CAP_PROP_POS_MSEC), read_time);
+            image.capture = image.read - ros::Duration(read_time - capture_time);
+            image.clock = capture_clock.source();
+            image.sequence = captured;
+        }
+        if (!read) {
+          read_failures++;
           NODELET_ERROR("Could not capture frame");
           if (reopen_on_read_failure) {
             NODELET_WARN("trying to reopen the device");
@@ -157,91 +240,235 @@ virtual void do_capture() {
         }
 
         if(!frame.empty()) {
-            std::lock_guard<std::mutex> g(q_mutex);
-            // accumulate only until max_queue_size
-            if (framesQueue.size() < max_queue_size) {
-                framesQueue.push(frame.clone());
+            if (slot < 0) {
+                exhausted_frames++;
+                NODELET_WARN_STREAM_THROTTLE(10.0, "Subscribers hold all " << frames->slots()
+                                             << " frames, dropped " << exhausted_frames << " captured ones (held_frames)");
+                continue;
             }
-            // once reached, drop the oldest frame
-            else {
-                framesQueue.pop();
-                framesQueue.push(frame.clone());
+            // a slot that never held a frame is sized on first use, that is no reallocation
+            bool first_use = frames->frame(slot).msg.data.empty();
+            if (frames->frame(slot).adopt()) {
+                if (!preallocated) {
+                    // nothing was queued yet, all the slots belong to this thread;
+                    // the first ones acquire() hands out are sized (and their pages touched) now,
+                    // a deep buffer_queue_size only allocates the rest when the queue grows into it
+                    size_t eager = frames->slots() < PREALLOCATED_FRAMES ? frames->slots() : PREALLOCATED_FRAMES;
+                    for (size_t i = 0; i < eager; i++) {
+                        if ((int)i != slot)
+                            frames->frame(i).wrap(frame.rows, frame.cols, frame.type());
+                    }
+                    preallocated = true;
+                }
+                else if (!first_use) {
+                    reallocated++;
+                }
             }
+            captured++;
+            // accumulate only until max_queue_size, once reached the oldest frame is dropped
+            frames->push(slot);
+            slot = frames->acquire();
+            if (latest_frame_only) {
+                // taking the lock orders the push before the publish thread's check
+                { std::lock_guard<std::mutex> g(f_mutex); }
+                frame_cv.notify_one();
+            }
+            NODELET_DEBUG_STREAM_THROTTLE(10.0, "Captured " << captured << " frames, dropped "
+                                          << frames->dropped() << ", buffers reallocated " << reallocated);
         }
     }
     NODELET_DEBUG("Capture thread finished");
 }
 
 virtual void do_publish(const ros::TimerEvent& event) {
-    bool is_new_image = false;
-    sensor_msgs::ImagePtr msg;
-    std_msgs::Header header;
-    header.frame_id = frame_id;
-    {
-        std::lock_guard<std::mutex> g(q_mutex);
-        if (!framesQueue.empty()){
-            frame = framesQueue.front();
-            framesQueue.pop();
-            is_new_image = true;
+    publish_frame(frames);
+}
+
+// latest_frame_only: publish each frame as it arrives, at most at fps
+virtual void do_publish_latest() {
+    NODELET_DEBUG("Publish thread started");
+    boost::shared_ptr<ImagePool> frames = this->frames;
+    ros::WallDuration period(fps > 0.0 ? 1.0 / fps : 0.0);
+    // fps on average, a frame that arrives a bit early goes out right away
+    // as long as the one before was not early too
+    ros::WallTime allowed;
+    while (nh->ok() && publish_thread_running) {
+        {
+            std::unique_lock<std::mutex> lock(f_mutex);
+            frame_cv.wait_for(lock, std::chrono::milliseconds(100),
+                [&]() { return frames->size() > 0 || !publish_thread_running; });
         }
+        if (frames->size() == 0)
+            continue;
+        // throttled: the mailbox keeps taking newer frames while we wait
+        ros::WallTime now = ros::WallTime::now();
+        if (allowed > now)
+            (allowed - now).sleep();
+        allowed = std::max(allowed, now - period) + period;
+        publish_frame(frames);
     }
+    NODELET_DEBUG("Publish thread finished");
+}
 
-    // Check if grabbed frame is actually filled with some content
-    if(!frame.empty()) {
-        // From http://docs.opencv.org/modules/core/doc/operations_on_arrays.html#void flip(InputArray src, OutputArray dst, int flipCode)
-        // FLIP_HORIZONTAL == 1, FLIP_VERTICAL == 0 or FLIP_BOTH == -1
-        // Flip the image if necessary
-        if (is_new_image){
-          if (flip_horizontal && flip_vertical)
-            cv::flip(frame, frame, -1);
-          else if (flip_horizontal)
-            cv::flip(frame, frame, 1);
-          else if (flip_vertical)
-            cv::flip(frame, frame, 0);
-        }
-        msg = cv_bridge::CvImage(header, "bgr8", frame).toImageMsg();
-        // Create a default camera info if we didn't get a stored one on initialization
-        if (cam_info_msg.distortion_model == ""){
-            NODELET_WARN_STREAM("No calibration file given, publishing a reasonable default camera info.");
-            cam_info_msg = get_default_camera_info_from_image(msg);
-            // cam_info_manager.setCameraInfo(cam_info_msg);
-        }
-        // The timestamps are in sync thanks to this publisher
-        pub.publish(*msg, cam_info_msg, ros::Time::now());
+virtual void publish_frame(const boost::shared_ptr<ImagePool>& frames) {
+    // only new frames are published, a message can't change once it is out
+    int slot = frames->pop();
+    if (slot < 0)
+        return;
+    ImageSlot& image = frames->frame(slot);
+    cv::Mat& frame = image.mat;
+
+    // From http://docs.opencv.org/modules/core/doc/operations_on_arrays.html#void flip(InputArray src, OutputArray dst, int flipCode)
+    // FLIP_HORIZONTAL == 1, FLIP_VERTICAL == 0 or FLIP_BOTH == -1
+    // Flip the image if necessary, in place in the message, unless the pipeline did
+    if (!flip_in_pipeline) {
+      if (flip_horizontal && flip_vertical)
+        cv::flip(frame, frame, -1);
+      else if (flip_horizontal)
+        cv::flip(frame, frame, 1);
+      else if (flip_vertical)
+        cv::flip(frame, frame, 0);
     }
+
+    image.msg.header.frame_id = frame_id;
+    image.msg.header.stamp = image.capture;
+    image.msg.encoding = published_encoding;
+    // Create a default camera info if we didn't get a stored one on initialization
+    if (cam_info_msg.distortion_model == ""){
+        NODELET_WARN_STREAM("No calibration file given, publishing a reasonable default camera info.");
+        cam_info_msg = get_default_camera_info_from_image(image.msg);
+        // cam_info_manager.setCameraInfo(cam_info_msg);
+    }
+    // The timestamps are in sync thanks to this publisher
+    image.info = cam_info_msg;
+    image.info.header = image.msg.header;
+    // nodelet subscribers get this very message, the slot is recycled once they all release it
+    sensor_msgs::ImagePtr msg = share(frames, slot);
+    pub.publish(msg, shareInfo(msg, image));
+    // msg keeps the slot from being recycled while the outputs read it
+    publish_outputs(image);
+#ifdef VIDEO_STREAM_OPENCV_TURBOJPEG
+    if (jpeg && jpeg_pub.getNumSubscribers() > 0)
+        jpeg->submit(msg, image.sequence);
+#endif
+    record_publish(frames, image);
 }
 
-std::string gstreamer_pipeline (int capture_width, int capture_height, int display_width, int display_height, int framerate, int flip_method) {
-    return "nvarguscamerasrc ! video/x-raw(memory:NVMM), width=(int)" + std::to_string(capture_width) + ", height=(int)" +
-           std::to_string(capture_height) + ", format=(string)NV12, framerate=(fraction)" + std::to_string(framerate) +
-           "/1 ! nvvidconv flip-method=" + std::to_string(flip_method) + " ! video/x-raw, width=(int)" + std::to_string(display_width) + ", height=(int)" +
-           std::to_string(display_height) + ", format=(string)BGRx ! videoconvert ! video/x-raw, format=(string)BGR ! appsink";
+virtual void publish_outputs(const ImageSlot& image) {
+    for (size_t i = 0; i < outputs.size(); i++) {
+        Output& output = *outputs[i];
+        if (output.subscribers() == 0)
+            continue;
+        sensor_msgs::ImagePtr msg(new sensor_msgs::Image);
+        msg->header = image.msg.header;
+        output.resized.render(image.mat, image.msg.encoding, *msg);
+        if (output.resized.spec().tensor)
+            output.tensor_pub.publish(msg);
+        else
+            output.image_pub.publish(msg);
+    }
 }
 
-virtual void subscribe() {
-  int capture_width = 1920 ;
-  int capture_height = 1080 ;
-  int display_width = 640 ;
-  int display_height = 480 ;
-  int framerate = 30 ;
-  int flip_method = 0 ;
-
-  std::string pipeline = gstreamer_pipeline(capture_width,
-                                              capture_height,
-                                              display_width,
-                                              display_height,
-                                              framerate,
-                                              flip_method);
-  std::cout << "Using pipeline: \n\t" << pipeline << "\n";
+// image_raw, camera_info and the outputs
+virtual uint32_t subscribers() {
+    uint32_t n = pub.getNumSubscribers() + jpeg_pub.getNumSubscribers();
+    for (size_t i = 0; i < outputs.size(); i++)
+        n += outputs[i]->subscribers();
+    return n;
+}
 
+virtual void record_publish(const boost::shared_ptr<ImagePool>& frames, const ImageSlot& image) {
+    ros::Time publish_time = ros::Time::now();
+    double pipeline = (image.read - image.capture).toSec();
+    double queue = std::chrono::duration<double>(std::chrono::steady_clock::now() - image.captured).count();
+    pipeline_latency.add(pipeline);
+    queue_latency.add(queue);
+    published_frames++;
+    if (stats_pub.getNumSubscribers() > 0) {
+        FrameStatsPtr stats(new FrameStats);
+        stats->header = image.msg.header;
+        stats->frame = image.sequence;
+        stats->clock = CaptureClock::name(image.clock);
+        stats->capture = image.capture;
+        stats->read = image.read;
+        stats->publish = publish_time;
+        stats->pipeline_latency = pipeline;
+        stats->queue_latency = queue;
+        stats->total_latency = pipeline + queue;
+        stats->dropped = frames->dropped();
+        stats->exhausted = exhausted_frames;
+        stats->read_failures = read_failures;
+        stats_pub.publish(stats);
+    }
+    if (stats_period <= 0.0)
+        return;
+    ros::WallTime now = ros::WallTime::now();
+    double elapsed = (now - stats_start).toSec();
+    if (stats_start.isZero() || elapsed < stats_period) {
+        if (stats_start.isZero())
+            stats_start = now;
+        return;
+    }
+    // frames dropped by the pool were overwritten before anyone published them
+    uint64_t dropped = frames->dropped();
+    NODELET_INFO_STREAM((latest_frame_only ? "Latest frame" : "Queued frames") << ": published "
+                        << published_frames << " (" << published_frames / elapsed << " fps), skipped "
+                        << dropped - skipped_frames << ", latency [ms] capture to read (" << CaptureClock::name(image.clock)
+                        << ") mean " << pipeline_latency.mean() * 1e3 << " p99 " << pipeline_latency.percentile(0.99) * 1e3
+                        << ", read to publish mean " << queue_latency.mean() * 1e3
+                        << " p50 " << queue_latency.percentile(0.5) * 1e3
+                        << " p99 " << queue_latency.percentile(0.99) * 1e3 << " max " << queue_latency.max() * 1e3);
+#ifdef VIDEO_STREAM_OPENCV_TURBOJPEG
+    if (jpeg)
+        NODELET_INFO_STREAM("JPEG output since start: encoded " << jpeg->encoded() << ", dropped "
+                            << jpeg->dropped() << ", failed " << jpeg->failed());
+#endif
+    stats_start = now;
+    published_frames = 0;
+    skipped_frames = dropped;
+    pipeline_latency.clear();
+    queue_latency.clear();
+}
 
+virtual void subscribe() {
   ROS_DEBUG("Subscribe");
   cap.reset(new cv::VideoCapture);
+  // other providers deliver bgr8 frames, flipped here
+  flip_in_pipeline = false;
+  published_encoding = "bgr8";
+  bool is_device = true;
+  int device_num = 0;
   try {
-    int device_num = std::stoi(video_stream_provider);
-    NODELET_INFO_STREAM("Opening VideoCapture with provider: /dev/video" << device_num);
-    cap->open(pipeline, cv::CAP_GSTREAMER);
+    device_num = std::stoi(video_stream_provider);
   } catch (std::invalid_argument &ex) {
+    is_device = false;
+  }
+  if (is_device) {
+    // scaled, flipped and converted in GStreamer, frames come out as they are published
+    GstPipelineConfig gst;
+    gst.source = gst_source;
+    gst.device = device_num;
+    gst.capture_width = capture_width;
+    gst.capture_height = capture_height;
+    gst.framerate = std::max(1, (int)(set_camera_fps + 0.5));
+    gst.width = width_target;
+    gst.height = height_target;
+    gst.flip_horizontal = flip_horizontal;
+    gst.flip_vertical = flip_vertical;
+    gst.encoding = encoding;
+    std::string pipeline;
+    try {
+      pipeline = gstreamer_pipeline(gst);
+    } catch (std::invalid_argument &ex) {
+      NODELET_FATAL_STREAM("Invalid GStreamer configuration: " << ex.what());
+      return;
+    }
+    NODELET_INFO_STREAM("Opening VideoCapture with provider: " << gst_source << " " << device_num
+                        << ", pipeline:\n\t" << pipeline);
+    cap->open(pipeline, cv::CAP_GSTREAMER);
+    flip_in_pipeline = true;
+    published_encoding = encoding;
+  } else {
     NODELET_INFO_STREAM("Opening VideoCapture with provider: " << video_stream_provider);
     cap->open(video_stream_provider);
     if (!cap->isOpened()) {
@@ -272,11 +499,33 @@ virtual void subscribe() {
     cap->set(CV_CAP_PROP_FRAME_HEIGHT, height_target);
   }*/
 
+  // the capture thread is stopped, the pool can be replaced;
+  // the latest frame mode keeps a single frame, a newer capture replaces it
+  // the jpeg workers hold one frame each while encoding
+  size_t held = held_frames;
+#ifdef VIDEO_STREAM_OPENCV_TURBOJPEG
+  if (jpeg)
+    held += jpeg->workers();
+#endif
+  frames.reset(new ImagePool(latest_frame_only ? 1 : max_queue_size, held));
+  stats_start = ros::WallTime();
+  published_frames = skipped_frames = 0;
+  pipeline_latency.clear();
+  queue_latency.clear();
+  read_failures = exhausted_frames = 0;
+
   try {
     capture_thread = boost::thread(
       boost::bind(&VideoStreamNodelet::do_capture, this));
-    publish_timer = nh->createTimer(
-      ros::Duration(1.0 / fps), &VideoStreamNodelet::do_publish, this);
+    if (latest_frame_only) {
+      publish_thread_running = true;
+      publish_thread = boost::thread(
+        boost::bind(&VideoStreamNodelet::do_publish_latest, this));
+    }
+    else {
+      publish_timer = nh->createTimer(
+        ros::Duration(1.0 / fps), &VideoStreamNodelet::do_publish, this);
+    }
   } catch (std::exception& e) {
     NODELET_ERROR_STREAM("Failed to start capture thread: " << e.what());
   }
@@ -285,6 +534,13 @@ virtual void subscribe() {
 virtual void unsubscribe() {
   ROS_DEBUG("Unsubscribe");
   publish_timer.stop();
+  {
+    std::lock_guard<std::mutex> g(f_mutex);
+    publish_thread_running = false;
+  }
+  frame_cv.notify_one();
+  if (publish_thread.joinable())
+    publish_thread.join();
   capture_thread_running = false;
   capture_thread.join();
   cap.reset();
@@ -305,6 +561,10 @@ virtual void disconnectionCallbackImpl() {
   if (video_stream_provider == "videofile" || always_subscribe) {
     return;
   }
+  // capture goes on while any topic is still subscribed
+  if (subscriber_num == 0 || subscribers() > 0) {
+    return;
+  }
 
   subscriber_num--;
   if (subscriber_num == 0) {
@@ -362,9 +622,18 @@ virtual void configCallback(VideoStreamConfig& config, uint32_t level) {
       need_resubscribe = true;
     }
 
+    if (latest_frame_only != config.latest_frame_only) {
+      latest_frame_only = config.latest_frame_only;
+      NODELET_INFO_STREAM("Publishing " << (latest_frame_only ? "only the latest frame as it arrives" :
+                                            "queued frames at fps"));
+      need_resubscribe = true;
+    }
+
     if (max_queue_size != config.buffer_queue_size) {
       max_queue_size = config.buffer_queue_size;
       NODELET_INFO_STREAM("Setting buffer size for capturing frames to: " << max_queue_size);
+      // the frame pool is sized on subscribe
+      need_resubscribe = true;
     }
 
     if (flip_horizontal != config.flip_horizontal ||
@@ -373,6 +642,21 @@ virtual void configCallback(VideoStreamConfig& config, uint32_t level) {
       flip_vertical = config.flip_vertical;
       NODELET_INFO_STREAM("Flip horizontal image is: " << ((flip_horizontal)?"true":"false"));
       NODELET_INFO_STREAM("Flip vertical image is: " << ((flip_vertical)?"true":"false"));
+      // GStreamer pipelines flip, they have to be rebuilt
+      need_resubscribe = true;
+    }
+
+    if (gst_source != config.gst_source ||
+        capture_width != config.capture_width ||
+        capture_height != config.capture_height ||
+        encoding != config.encoding) {
+      gst_source = config.gst_source;
+      capture_width = config.capture_width;
+      capture_height = config.capture_height;
+      encoding = config.encoding;
+      NODELET_INFO_STREAM("GStreamer source: " << gst_source << " at " << capture_width << "x" << capture_height
+                          << ", publishing " << encoding);
+      need_resubscribe = true;
     }
 
     if (width_target != config.width ||
@@ -400,6 +684,21 @@ virtual void configCallback(VideoStreamConfig& config, uint32_t level) {
       }
     }*/
 
+    if (jpeg_quality != config.jpeg_quality ||
+        jpeg_skip != config.jpeg_skip ||
+        jpeg_max_bandwidth != config.jpeg_max_bandwidth) {
+      jpeg_quality = config.jpeg_quality;
+      jpeg_skip = config.jpeg_skip;
+      jpeg_max_bandwidth = config.jpeg_max_bandwidth;
+#ifdef VIDEO_STREAM_OPENCV_TURBOJPEG
+      if (jpeg) {
+        NODELET_INFO_STREAM("JPEG output: quality " << jpeg_quality << ", skipping " << jpeg_skip
+                            << " frames after each, limited to " << jpeg_max_bandwidth << " kB/s (0 is no limit)");
+        jpeg->configure(jpeg_quality, jpeg_skip, jpeg_max_bandwidth * 1e3);
+      }
+#endif
+    }
+
     loop_videofile = config.loop_videofile;
     reopen_on_read_failure = config.reopen_on_read_failure;
 
@@ -409,6 +708,51 @@ virtual void configCallback(VideoStreamConfig& config, uint32_t level) {
     }
 }
 
+// ~outputs: a list of {topic, width, height, crop: [x, y, width, height], tensor, mean, std}
+virtual void load_outputs(XmlRpc::XmlRpcValue& params) {
+    if (params.getType() != XmlRpc::XmlRpcValue::TypeArray) {
+      NODELET_ERROR("'outputs' has to be a list, no output is published");
+      return;
+    }
+    for (int i = 0; i < params.size(); i++) {
+      XmlRpc::XmlRpcValue& p = params[i];
+      OutputSpec spec;
+      try {
+        spec.topic = static_cast<std::string>(p["topic"]);
+        spec.width = p["width"];
+        spec.height = p["height"];
+        if (p.hasMember("crop")) {
+          XmlRpc::XmlRpcValue& crop = p["crop"];
+          if (crop.getType() != XmlRpc::XmlRpcValue::TypeArray || crop.size() != 4)
+            throw XmlRpc::XmlRpcException("crop has to be [x, y, width, height]");
+          spec.crop = cv::Rect(crop[0], crop[1], crop[2], crop[3]);
+        }
+        if (p.hasMember("tensor"))
+          spec.tensor = p["tensor"];
+        if (p.hasMember("mean"))
+          spec.mean = xmlrpc_number(p["mean"]);
+        if (p.hasMember("std"))
+          spec.std = xmlrpc_number(p["std"]);
+      } catch (XmlRpc::XmlRpcException& ex) {
+        NODELET_ERROR_STREAM("Ignoring output " << i << ": " << ex.getMessage());
+        continue;
+      }
+      if (spec.width <= 0 || spec.height <= 0 || spec.std == 0.0) {
+        NODELET_ERROR_STREAM("Ignoring output " << spec.topic << ": needs a positive width and height and a non zero std");
+        continue;
+      }
+      NODELET_INFO_STREAM("Output " << spec.topic << ": " << spec.width << "x" << spec.height
+                          << (spec.tensor ? " normalized NCHW tensor" : " image"));
+      outputs.push_back(boost::make_shared<Output>(spec));
+    }
+}
+
+static double xmlrpc_number(XmlRpc::XmlRpcValue& value) {
+    if (value.getType() == XmlRpc::XmlRpcValue::TypeInt)
+      return static_cast<int>(value);
+    return value;
+}
+
 virtual void onInit() {
     nh.reset(new ros::NodeHandle(getNodeHandle()));
     pnh.reset(new ros::NodeHandle(getPrivateNodeHandle()));
@@ -416,6 +760,23 @@ virtual void onInit() {
 
     // provider can be an url (e.g.: rtsp://10.0.0.1:554) or a number of device, (e.g.: 0 would be /dev/video0)
     pnh->param<std::string>("video_stream_provider", video_stream_provider, "0");
+    // published frames subscribers may hold at once before capture has to drop new ones
+    pnh->param("held_frames", held_frames, 4);
+    held_frames = std::max(held_frames, 1);
+    // period of the published / skipped / latency report, 0 disables it
+    pnh->param("stats_period", stats_period, 60.0);
+    pnh->param("jpeg_output", jpeg_output, false);
+    pnh->param("jpeg_threads", jpeg_threads, 2);
+    pnh->param<std::string>("jpeg_topic", jpeg_topic, "image_jpeg");
+    jpeg_quality = jpeg_skip = -1;
+    jpeg_max_bandwidth = -1;
+    XmlRpc::XmlRpcValue output_params;
+    if (pnh->getParam("outputs", output_params))
+      load_outputs(output_params);
+    latest_frame_only = false;
+    publish_thread_running = false;
+    flip_in_pipeline = false;
+    published_encoding = "bgr8";
     // check file type
     try {
       int device_num = std::stoi(video_stream_provider);
@@ -463,12 +824,40 @@ virtual void onInit() {
       connect_cb, connect_cb,
       info_connect_cb, info_connect_cb,
       ros::VoidPtr(), false);
+    for (size_t i = 0; i < outputs.size(); i++) {
+      Output& output = *outputs[i];
+      if (output.resized.spec().tensor)
+        output.tensor_pub = nh->advertise<sensor_msgs::Image>(
+          output.resized.spec().topic, 1, info_connect_cb, info_disconnect_cb);
+      else
+        output.image_pub = image_transport::ImageTransport(*nh).advertise(
+          output.resized.spec().topic, 1, connect_cb, disconnect_cb);
+    }
+    if (jpeg_output) {
+#ifdef VIDEO_STREAM_OPENCV_TURBOJPEG
+      // ready before a subscriber can start the capture, the pool is sized for its workers
+      jpeg.reset(new JpegEncoderPool(std::max(jpeg_threads, 1),
+        [this](const sensor_msgs::CompressedImagePtr& msg) { jpeg_pub.publish(msg); }));
+      jpeg->configure(jpeg_quality, jpeg_skip, jpeg_max_bandwidth * 1e3);
+      // sensor_msgs/CompressedImage as the compressed image_transport plugin names it
+      jpeg_pub = nh->advertise<sensor_msgs::CompressedImage>(
+        jpeg_topic + "/compressed", 1, info_connect_cb, info_disconnect_cb);
+#else
+      NODELET_ERROR("jpeg_output is set but video_stream_opencv was built without libturbojpeg, no JPEG output");
+#endif
+    }
+    // per frame capture / read / publish times and drop counters
+    stats_pub = nh->advertise<FrameStats>("frame_stats", 10);
 }
 
 virtual ~VideoStreamNodelet() {
   if (subscriber_num > 0)
     subscriber_num = 0;
     unsubscribe();
+#ifdef VIDEO_STREAM_OPENCV_TURBOJPEG
+  // the workers publish on jpeg_pub
+  jpeg.reset();
+#endif
 }
 };
 } // namespace
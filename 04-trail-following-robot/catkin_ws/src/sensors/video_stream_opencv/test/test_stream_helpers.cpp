@@ -0,0 +1,498 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <sensor_msgs/Image.h>
+#include <video_stream_opencv/capture_clock.h>
+#include <video_stream_opencv/frame_pool.h>
+#include <video_stream_opencv/gstreamer_pipeline.h>
+#ifdef VIDEO_STREAM_OPENCV_TURBOJPEG
+#include <video_stream_opencv/jpeg_encoder_pool.h>
+#endif
+#include <video_stream_opencv/latency_stats.h>
+#include <video_stream_opencv/resized_output.h>
+
+using namespace video_stream_opencv;
+
+namespace {
+
+typedef FramePool<int> IntPool;
+
+/** Every slot of the pool, each acquired once */
+std::vector<int> acquireAll(IntPool &pool) {
+    std::vector<int> slots;
+    for (int slot = pool.acquire(); slot >= 0; slot = pool.acquire()) {
+        slots.push_back(slot);
+        if (slots.size() > pool.slots())
+            break;
+    }
+    return slots;
+}
+
+/** bgr8 frame of 2x2 blocks, block (bx, by) is (b, g, r) = (10 + bx, 20 + by, 30 + bx + by) * 4 */
+cv::Mat blockFrame(int blocks_x, int blocks_y) {
+    cv::Mat frame(blocks_y * 2, blocks_x * 2, CV_8UC3);
+    for (int y = 0; y < frame.rows; y++) {
+        for (int x = 0; x < frame.cols; x++) {
+            uint8_t *p = frame.ptr<uint8_t>(y) + 3 * x;
+            int bx = x / 2, by = y / 2;
+            p[0] = (10 + bx) * 4;
+            p[1] = (20 + by) * 4;
+            p[2] = (30 + bx + by) * 4;
+        }
+    }
+    return frame;
+}
+
+float tensorAt(const sensor_msgs::Image &msg, int plane, int height, int x, int y) {
+    float v;
+    memcpy(&v, &msg.data[((size_t)plane * height + y) * msg.step + x * sizeof(float)], sizeof(float));
+    return v;
+}
+
+#ifdef VIDEO_STREAM_OPENCV_TURBOJPEG
+sensor_msgs::ImagePtr frameMessage(int width, int height, const std::string &encoding, uint32_t seq) {
+    sensor_msgs::ImagePtr image(new sensor_msgs::Image);
+    int channels = encoding == "mono8" ? 1 : 3;
+    image->header.seq = seq;
+    image->header.frame_id = "camera";
+    image->width = width;
+    image->height = height;
+    image->step = width * channels;
+    image->encoding = encoding;
+    image->data.resize(image->step * height);
+    for (size_t i = 0; i < image->data.size(); i++)
+        image->data[i] = (uint8_t)((i * 7) % 251);
+    return image;
+}
+
+/** Waits until the pool has finished `n` frames, encoded or failed */
+bool waitFinished(const JpegEncoderPool &pool, uint64_t n) {
+    for (int i = 0; i < 2000; i++) {
+        if (pool.encoded() + pool.failed() + pool.dropped() >= n)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+#endif
+
+} // namespace
+
+TEST(FramePool, QueuesInOrderAndDropsTheOldest) {
+    IntPool pool(2, 1);
+    ASSERT_EQ(4u, pool.slots());
+    int a = pool.acquire(), b = pool.acquire(), c = pool.acquire();
+    pool.push(a);
+    pool.push(b);
+    EXPECT_EQ(2u, pool.size());
+    // full: a is dropped and becomes the next slot to write
+    pool.push(c);
+    EXPECT_EQ(1u, pool.dropped());
+    EXPECT_EQ(a, pool.acquire());
+    EXPECT_EQ(b, pool.pop());
+    EXPECT_EQ(c, pool.pop());
+    EXPECT_EQ(-1, pool.pop());
+}
+
+TEST(FramePool, AcquireFailsWhileEverySlotIsHeld) {
+    IntPool pool(1, 2);
+    std::vector<int> held;
+    for (size_t i = 0; i < pool.slots(); i++) {
+        int slot = pool.acquire();
+        ASSERT_GE(slot, 0);
+        pool.push(slot);
+        held.push_back(pool.pop());
+        ASSERT_EQ(slot, held.back());
+    }
+    // nothing free and nothing queued to reuse
+    EXPECT_EQ(-1, pool.acquire());
+    EXPECT_EQ(0u, pool.dropped());
+    pool.release(held[1]);
+    EXPECT_EQ(held[1], pool.acquire());
+    EXPECT_EQ(-1, pool.acquire());
+}
+
+TEST(FramePool, ConcurrentReleaseReturnsEverySlotOnce) {
+    const int THREADS = 4;
+    IntPool pool(4, 60);
+    for (int round = 0; round < 200; round++) {
+        std::vector<int> slots = acquireAll(pool);
+        ASSERT_EQ(pool.slots(), slots.size());
+        for (size_t i = 0; i < slots.size(); i++) {
+            pool.push(slots[i]);
+            ASSERT_EQ(slots[i], pool.pop());
+        }
+        // subscriber threads let go of their messages at the same time
+        std::atomic<bool> go(false);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; t++) {
+            threads.push_back(std::thread([&, t]() {
+                while (!go) {}
+                for (size_t i = t; i < slots.size(); i += THREADS)
+                    pool.release(slots[i]);
+            }));
+        }
+        go = true;
+        for (size_t t = 0; t < threads.size(); t++)
+            threads[t].join();
+        std::vector<int> released = acquireAll(pool);
+        std::sort(released.begin(), released.end());
+        ASSERT_EQ(pool.slots(), released.size());
+        for (size_t i = 0; i < released.size(); i++)
+            ASSERT_EQ((int)i, released[i]);
+        for (size_t i = 0; i < released.size(); i++)
+            pool.release(released[i]);
+    }
+}
+
+TEST(FramePool, ProducerConsumerAndReleasersKeepEverySlot) {
+    IntPool pool(2, 6);
+    const int FRAMES = 20000;
+    // produced stops the consumer, handed_out then the releasers: the consumer
+    // may still be handing out its last slot when production stops
+    std::atomic<bool> produced(false), handed_out(false);
+    std::atomic<int> popped(0);
+    std::vector<std::atomic<int> > handed(4);
+    for (size_t i = 0; i < handed.size(); i++)
+        handed[i] = -1;
+    // releasers take popped slots from their mailbox and give them back
+    std::vector<std::thread> releasers;
+    for (size_t r = 0; r < handed.size(); r++) {
+        releasers.push_back(std::thread([&, r]() {
+            while (!handed_out || handed[r] >= 0) {
+                int slot = handed[r].exchange(-1);
+                if (slot >= 0)
+                    pool.release(slot);
+            }
+        }));
+    }
+    std::thread consumer([&]() {
+        size_t next = 0;
+        while (!produced) {
+            int slot = pool.pop();
+            if (slot < 0)
+                continue;
+            popped++;
+            // the next releaser with an empty mailbox
+            for (int expected = -1;; next = (next + 1) % handed.size(), expected = -1) {
+                if (handed[next].compare_exchange_strong(expected, slot))
+                    break;
+            }
+        }
+    });
+    int exhausted = 0;
+    for (int i = 0; i < FRAMES; i++) {
+        int slot = pool.acquire();
+        if (slot < 0) {
+            exhausted++;
+            std::this_thread::yield();
+            continue;
+        }
+        pool.frame(slot) = i;
+        pool.push(slot);
+    }
+    while (pool.size() > 0)
+        std::this_thread::yield();
+    produced = true;
+    consumer.join();
+    handed_out = true;
+    for (size_t r = 0; r < releasers.size(); r++)
+        releasers[r].join();
+    EXPECT_EQ((uint64_t)(FRAMES - exhausted), popped + pool.dropped());
+    // everything is free again
+    EXPECT_EQ(pool.slots(), acquireAll(pool).size());
+}
+
+TEST(LatencyStats, MeanMaxPercentilesAndClear) {
+    LatencyStats stats(4);
+    EXPECT_EQ(0.0, stats.mean());
+    EXPECT_EQ(0.0, stats.percentile(0.5));
+    for (int i = 100; i >= 1; i--)
+        stats.add(i * 1e-3);
+    EXPECT_EQ(100u, stats.count());
+    EXPECT_NEAR(50.5e-3, stats.mean(), 1e-12);
+    EXPECT_DOUBLE_EQ(100e-3, stats.max());
+    EXPECT_DOUBLE_EQ(1e-3, stats.percentile(0.0));
+    EXPECT_DOUBLE_EQ(51e-3, stats.percentile(0.5));
+    EXPECT_DOUBLE_EQ(99e-3, stats.percentile(0.99));
+    EXPECT_DOUBLE_EQ(100e-3, stats.percentile(1.0));
+    stats.clear();
+    EXPECT_EQ(0u, stats.count());
+    EXPECT_EQ(0.0, stats.max());
+    stats.add(2e-3);
+    EXPECT_DOUBLE_EQ(2e-3, stats.mean());
+}
+
+TEST(CaptureClock, WithoutTimestampTheReadTimeIsUsed) {
+    CaptureClock clock;
+    EXPECT_DOUBLE_EQ(100.0, clock.capture(0.0, 100.0));
+    EXPECT_EQ(CaptureClock::READ_TIME, clock.source());
+    EXPECT_DOUBLE_EQ(100.1, clock.capture(-1.0, 100.1));
+    EXPECT_DOUBLE_EQ(100.2, clock.capture(std::numeric_limits<double>::quiet_NaN(), 100.2));
+    EXPECT_DOUBLE_EQ(100.3, clock.capture(std::numeric_limits<double>::infinity(), 100.3));
+    EXPECT_STREQ("read_time", CaptureClock::name(clock.source()));
+}
+
+TEST(CaptureClock, MonotonicTimestampsAreUsedAsIs) {
+    CaptureClock clock;
+    EXPECT_NEAR(99.95, clock.capture(99950.0, 100.0), 1e-9);
+    EXPECT_EQ(CaptureClock::MONOTONIC, clock.source());
+    // never after the read
+    EXPECT_DOUBLE_EQ(100.0, clock.capture(100020.0, 100.0));
+}
+
+TEST(CaptureClock, RelativeTimestampsFollowTheLeastDelayedFrame) {
+    CaptureClock clock(0.0);
+    // pipeline running time from 0, read 1000 s later with a varying delay
+    double delays[] = { 0.05, 0.02, 0.08, 0.03 };
+    double offset = 0.0;
+    for (int i = 0; i < 4; i++) {
+        double stamp = 1.0 + i / 30.0;
+        double capture = clock.capture(stamp * 1e3, 1000.0 + stamp + delays[i]);
+        EXPECT_EQ(CaptureClock::RELATIVE, clock.source());
+        offset = capture - stamp;
+    }
+    // the 0.02 frame defines the mapping from then on
+    EXPECT_NEAR(1000.02, offset, 1e-9);
+}
+
+TEST(CaptureClock, DriftLetsTheOffsetGrow) {
+    CaptureClock follows(1e-3), fixed(0.0);
+    // a source clock 0.05% slow: read - stamp grows, the offset follows at up to drift
+    double read = 0.0, f = 0.0, x = 0.0;
+    for (int i = 0; i <= 10; i++) {
+        double stamp = 1.0 + i;
+        read = 1000.0 + i * 1.0005;
+        f = follows.capture(stamp * 1e3, read);
+        x = fixed.capture(stamp * 1e3, read);
+    }
+    EXPECT_NEAR(read, f, 1e-9);
+    EXPECT_NEAR(read - 10 * 0.0005, x, 1e-9);
+}
+
+TEST(CaptureClock, BackwardJumpRestartsTheMapping) {
+    CaptureClock clock(0.0);
+    clock.capture(20.0 * 1e3, 1000.0);
+    clock.capture(20.1 * 1e3, 1000.15);
+    EXPECT_NEAR(1000.2, clock.capture(20.2 * 1e3, 1000.3), 1e-9);
+    // a looped file starts over at 0: that frame is taken as read
+    EXPECT_DOUBLE_EQ(1000.4, clock.capture(0.001 * 1e3, 1000.4));
+    EXPECT_EQ(CaptureClock::RELATIVE, clock.source());
+    // and the mapping continues from there
+    EXPECT_NEAR(1000.433, clock.capture(0.034 * 1e3, 1000.5), 1e-9);
+}
+
+TEST(CaptureClock, ForwardGapRestartsTheMapping) {
+    CaptureClock clock(0.0);
+    clock.capture(20.0 * 1e3, 1000.0);
+    EXPECT_NEAR(1000.1, clock.capture(20.1 * 1e3, 1000.3), 1e-9);
+    // a reopened stream 30 s further on
+    EXPECT_DOUBLE_EQ(1001.0, clock.capture(50.1 * 1e3, 1001.0));
+    // and a timestamp that is on the monotonic clock again
+    EXPECT_NEAR(1001.95, clock.capture(1001950.0, 1002.0), 1e-9);
+    EXPECT_EQ(CaptureClock::MONOTONIC, clock.source());
+}
+
+TEST(GstreamerPipeline, NvargusScalesFlipsAndConvertsInHardware) {
+    GstPipelineConfig c;
+    EXPECT_EQ("nvarguscamerasrc sensor-id=0 ! video/x-raw(memory:NVMM), width=(int)1920, height=(int)1080, "
+              "format=(string)NV12, framerate=(fraction)30/1 ! nvvidconv flip-method=0 ! "
+              "video/x-raw, width=(int)640, height=(int)480, format=(string)BGRx ! videoconvert ! "
+              "video/x-raw, format=(string)BGR ! appsink", gstreamer_pipeline(c));
+    c.device = 1;
+    c.flip_horizontal = c.flip_vertical = true;
+    c.encoding = "rgb8";
+    EXPECT_EQ("nvarguscamerasrc sensor-id=1 ! video/x-raw(memory:NVMM), width=(int)1920, height=(int)1080, "
+              "format=(string)NV12, framerate=(fraction)30/1 ! nvvidconv flip-method=2 ! "
+              "video/x-raw, width=(int)640, height=(int)480, format=(string)RGBA ! videoconvert ! "
+              "video/x-raw, format=(string)RGB ! capssetter caps=\"video/x-raw, format=(string)BGR\" ! appsink",
+              gstreamer_pipeline(c));
+    c.flip_vertical = false;
+    c.encoding = "mono8";
+    c.width = c.height = 0;
+    EXPECT_EQ("nvarguscamerasrc sensor-id=1 ! video/x-raw(memory:NVMM), width=(int)1920, height=(int)1080, "
+              "format=(string)NV12, framerate=(fraction)30/1 ! nvvidconv flip-method=4 ! "
+              "video/x-raw, width=(int)1920, height=(int)1080, format=(string)GRAY8 ! appsink",
+              gstreamer_pipeline(c));
+    c.flip_horizontal = false;
+    c.flip_vertical = true;
+    EXPECT_NE(std::string::npos, gstreamer_pipeline(c).find("flip-method=6"));
+}
+
+TEST(GstreamerPipeline, V4l2AndTestSourcesScaleAndFlipInSoftware) {
+    GstPipelineConfig c;
+    c.source = "v4l2src";
+    c.device = 2;
+    c.capture_width = 1280;
+    c.capture_height = 720;
+    c.framerate = 15;
+    c.flip_horizontal = true;
+    EXPECT_EQ("v4l2src device=/dev/video2 ! video/x-raw, width=(int)1280, height=(int)720, framerate=(fraction)15/1 ! "
+              "videoscale ! video/x-raw, width=(int)640, height=(int)480 ! videoflip method=horizontal-flip ! "
+              "videoconvert ! video/x-raw, format=(string)BGR ! appsink", gstreamer_pipeline(c));
+    c.source = "videotestsrc";
+    c.width = 1280;
+    c.height = 720;
+    c.flip_horizontal = false;
+    c.encoding = "mono8";
+    EXPECT_EQ("videotestsrc is-live=true ! video/x-raw, width=(int)1280, height=(int)720, framerate=(fraction)15/1 ! "
+              "videoconvert ! video/x-raw, format=(string)GRAY8 ! appsink", gstreamer_pipeline(c));
+    c.flip_horizontal = c.flip_vertical = true;
+    c.encoding = "rgb8";
+    EXPECT_EQ("videotestsrc is-live=true ! video/x-raw, width=(int)1280, height=(int)720, framerate=(fraction)15/1 ! "
+              "videoflip method=rotate-180 ! videoconvert ! video/x-raw, format=(string)RGB ! "
+              "capssetter caps=\"video/x-raw, format=(string)BGR\" ! appsink", gstreamer_pipeline(c));
+}
+
+TEST(GstreamerPipeline, UnknownSourceOrEncodingThrows) {
+    GstPipelineConfig c;
+    c.encoding = "bgra8";
+    EXPECT_THROW(gstreamer_pipeline(c), std::invalid_argument);
+    c.encoding = "bgr8";
+    c.source = "rtspsrc";
+    EXPECT_THROW(gstreamer_pipeline(c), std::invalid_argument);
+}
+
+TEST(ResizedOutput, TensorIsPlanarRgbAndNormalized) {
+    OutputSpec spec;
+    spec.width = 3;
+    spec.height = 2;
+    spec.tensor = true;
+    ResizedOutput output(spec);
+    sensor_msgs::Image msg;
+    output.render(blockFrame(3, 2), "bgr8", msg);
+    EXPECT_EQ("32FC1", msg.encoding);
+    EXPECT_EQ(6u, msg.height);
+    EXPECT_EQ(3u, msg.width);
+    EXPECT_EQ(3 * sizeof(float), msg.step);
+    ASSERT_EQ(3 * 2 * 3 * sizeof(float), msg.data.size());
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 3; x++) {
+            // NCHW in RGB order, (pixel / 255 - 0.5) / 1
+            EXPECT_NEAR((30 + x + y) * 4 / 255.0 - 0.5, tensorAt(msg, 0, 2, x, y), 1e-6);
+            EXPECT_NEAR((20 + y) * 4 / 255.0 - 0.5, tensorAt(msg, 1, 2, x, y), 1e-6);
+            EXPECT_NEAR((10 + x) * 4 / 255.0 - 0.5, tensorAt(msg, 2, 2, x, y), 1e-6);
+        }
+    }
+}
+
+TEST(ResizedOutput, TensorMeanStdAndChannelOrderOfRgbFrames) {
+    OutputSpec spec;
+    spec.width = 1;
+    spec.height = 1;
+    spec.tensor = true;
+    spec.mean = 0.25;
+    spec.std = 0.5;
+    spec.crop = cv::Rect(2, 2, 2, 2);
+    ResizedOutput output(spec);
+    sensor_msgs::Image msg;
+    // an rgb8 frame keeps its channel order, the crop picks block (1, 1)
+    output.render(blockFrame(2, 2), "rgb8", msg);
+    ASSERT_EQ(3u, msg.height);
+    EXPECT_NEAR(((11 * 4) / 255.0 - 0.25) / 0.5, tensorAt(msg, 0, 1, 0, 0), 1e-6);
+    EXPECT_NEAR(((21 * 4) / 255.0 - 0.25) / 0.5, tensorAt(msg, 1, 1, 0, 0), 1e-6);
+    EXPECT_NEAR(((32 * 4) / 255.0 - 0.25) / 0.5, tensorAt(msg, 2, 1, 0, 0), 1e-6);
+}
+
+TEST(ResizedOutput, ImageIsAreaAveragedIntoTheMessage) {
+    OutputSpec spec;
+    spec.width = 2;
+    spec.height = 1;
+    spec.crop = cv::Rect(0, 2, 100, 100);  // clipped to the frame: the bottom row of blocks
+    ResizedOutput output(spec);
+    sensor_msgs::Image msg;
+    output.render(blockFrame(2, 2), "bgr8", msg);
+    EXPECT_EQ("bgr8", msg.encoding);
+    EXPECT_EQ(1u, msg.height);
+    EXPECT_EQ(2u, msg.width);
+    EXPECT_EQ(6u, msg.step);
+    ASSERT_EQ(6u, msg.data.size());
+    uint8_t expected[] = { 40, 84, 124, 44, 84, 128 };
+    for (int i = 0; i < 6; i++)
+        EXPECT_EQ(expected[i], msg.data[i]) << "byte " << i;
+}
+
+#ifdef VIDEO_STREAM_OPENCV_TURBOJPEG
+TEST(JpegEncoderPool, EncodesWithTheTransportFormat) {
+    std::vector<sensor_msgs::CompressedImagePtr> published;
+    std::mutex m;
+    JpegEncoderPool pool(2, [&](const sensor_msgs::CompressedImagePtr &msg) {
+        std::lock_guard<std::mutex> lock(m);
+        published.push_back(msg);
+    });
+    ASSERT_TRUE(pool.submit(frameMessage(64, 48, "bgr8", 7), 1));
+    ASSERT_TRUE(waitFinished(pool, 1));
+    ASSERT_TRUE(pool.submit(frameMessage(64, 48, "mono8", 8), 2));
+    ASSERT_TRUE(waitFinished(pool, 2));
+    EXPECT_EQ(2u, pool.encoded());
+    std::lock_guard<std::mutex> lock(m);
+    ASSERT_EQ(2u, published.size());
+    EXPECT_EQ("bgr8; jpeg compressed bgr8", published[0]->format);
+    EXPECT_EQ("mono8; jpeg compressed mono8", published[1]->format);
+    EXPECT_EQ(7u, published[0]->header.seq);
+    EXPECT_EQ("camera", published[0]->header.frame_id);
+    for (size_t i = 0; i < published.size(); i++) {
+        const std::vector<uint8_t> &jpeg = published[i]->data;
+        ASSERT_GT(jpeg.size(), 4u);
+        // SOI ... EOI
+        EXPECT_EQ(0xFF, jpeg[0]);
+        EXPECT_EQ(0xD8, jpeg[1]);
+        EXPECT_EQ(0xFF, jpeg[jpeg.size() - 2]);
+        EXPECT_EQ(0xD9, jpeg[jpeg.size() - 1]);
+    }
+}
+
+TEST(JpegEncoderPool, SkipsFramesAndRejectsOtherEncodings) {
+    std::atomic<int> published(0);
+    JpegEncoderPool pool(1, [&](const sensor_msgs::CompressedImagePtr &) { published++; });
+    pool.configure(50, 2, 0);
+    int submitted = 0;
+    for (uint32_t i = 0; i < 9; i++) {
+        bool queued = pool.submit(frameMessage(32, 32, "bgr8", i), i);
+        // every third frame
+        EXPECT_EQ(i % 3 == 0, queued) << "frame " << i;
+        if (queued) {
+            ASSERT_TRUE(waitFinished(pool, ++submitted));
+        }
+    }
+    EXPECT_EQ(3, published);
+    pool.configure(50, 0, 0);
+    ASSERT_TRUE(pool.submit(frameMessage(32, 32, "32FC1", 10), 10));
+    ASSERT_TRUE(waitFinished(pool, submitted + 1));
+    EXPECT_EQ(1u, pool.failed());
+    EXPECT_EQ(3, published);
+}
+
+TEST(JpegEncoderPool, BandwidthLimitStartsFullAfterUnlimitedFrames) {
+    std::atomic<int> published(0);
+    JpegEncoderPool pool(1, [&](const sensor_msgs::CompressedImagePtr &) { published++; });
+    // unlimited for a while, that must not leave a debt once a limit is set
+    for (uint32_t i = 0; i < 20; i++) {
+        ASSERT_TRUE(pool.submit(frameMessage(64, 48, "bgr8", i), i));
+        ASSERT_TRUE(waitFinished(pool, i + 1));
+    }
+    pool.configure(80, 0, 10.0);
+    // a full bucket lets one frame through, its bytes then empty it for minutes
+    EXPECT_TRUE(pool.submit(frameMessage(64, 48, "bgr8", 20), 20));
+    ASSERT_TRUE(waitFinished(pool, 21));
+    EXPECT_FALSE(pool.submit(frameMessage(64, 48, "bgr8", 21), 21));
+    EXPECT_EQ(21, published);
+    EXPECT_EQ(1u, pool.dropped());
+}
+#endif
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,379 @@
+#ifndef _TRACER_H_
+#define _TRACER_H_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace ydlidar
+{
+  /**
+   * @brief Modules that can be enabled independently in the trace mask.
+   */
+  enum TraceModule {
+    TRACE_DRIVER    = 0x01, ///< serial decode thread of YDlidarDriver
+    TRACE_LIDAR     = 0x02, ///< CYdLidar post-processing
+    TRACE_NODE      = 0x04, ///< ROS driver node
+    TRACE_OBSTACLE  = 0x08, ///< obstacle detection
+    TRACE_CONSOLE   = 0x10, ///< ydlidar::console messages
+    TRACE_ALL       = 0xFF,
+  };
+
+  enum TraceType {
+    TRACE_LOG = 0,
+    TRACE_COMPLETE,
+    TRACE_INSTANT,
+    TRACE_COUNTER,
+  };
+
+  struct TraceRecord {
+    uint64_t    ts;         ///< start time [ns], steady clock
+    uint64_t    dur;        ///< duration [ns], complete events only
+    const char *name;       ///< event name, must be a string literal
+    int64_t     value;      ///< event argument or counter value
+    uint32_t    tid;        ///< producer thread
+    uint8_t     module;     ///< TraceModule
+    uint8_t     type;       ///< TraceType
+    char        text[218];  ///< log text, log records only
+  };
+
+  /**
+   * @brief Process wide log and trace ring.
+   * Producers push fixed size binary records into a bounded lock-free ring and
+   * never block: when the ring is full the record is dropped and counted.
+   * A background thread drains the ring, writes log records to stdout without
+   * flushing and trace events to a Chrome trace file (chrome://tracing).
+   */
+  class Tracer
+  {
+  public:
+    enum {
+      RING_SIZE = 2048, ///< must be a power of two
+    };
+
+    static Tracer &instance() {
+      static Tracer tracer;
+      return tracer;
+    }
+
+    ~Tracer() {
+      stop();
+    }
+
+    /**
+     * @brief start the drain thread
+     * @param[in] mask        enabled TraceModule bits
+     * @param[in] trace_file  Chrome trace JSON output, NULL or "" for logs only
+     * @return false if the trace file could not be opened
+     */
+    bool start(uint32_t mask, const char *trace_file = NULL) {
+      stop();
+      for (size_t i = 0; i < RING_SIZE; i++) {
+        cells[i].seq.store(i, std::memory_order_relaxed);
+      }
+      enqueue_pos.store(0, std::memory_order_relaxed);
+      dequeue_pos = 0;
+      drop_count.store(0, std::memory_order_relaxed);
+      first_event = true;
+
+      if (trace_file && trace_file[0] != '\0') {
+        trace_fp = fopen(trace_file, "w");
+        if (!trace_fp) {
+          return false;
+        }
+        fputs("[\n", trace_fp);
+      }
+      running = true;
+      drain_thread = std::thread(&Tracer::drain, this);
+      mask_bits.store(mask, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * @brief disable all modules, drain the remaining records and close the trace file
+     */
+    void stop() {
+      mask_bits.store(0, std::memory_order_release);
+      if (drain_thread.joinable()) {
+        running = false;
+        drain_thread.join();
+      }
+      if (trace_fp) {
+        fputs("\n]\n", trace_fp);
+        fclose(trace_fp);
+        trace_fp = NULL;
+      }
+      fflush(stdout);
+    }
+
+    /**
+     * @brief start the tracer, or add modules to it if it is already running
+     * Lets several nodelets in one process share the ring; only the first
+     * caller's trace file is used.
+     */
+    bool enable(uint32_t mask, const char *trace_file = NULL) {
+      if (!running) {
+        return start(mask, trace_file);
+      }
+      mask_bits.fetch_or(mask, std::memory_order_acq_rel);
+      return true;
+    }
+
+    void setMask(uint32_t mask) {
+      mask_bits.store(mask, std::memory_order_release);
+    }
+
+    uint32_t mask() const {
+      return mask_bits.load(std::memory_order_relaxed);
+    }
+
+    inline bool enabled(uint32_t module) const {
+      return (mask_bits.load(std::memory_order_relaxed) & module) != 0;
+    }
+
+    /** Records dropped because the ring was full */
+    uint64_t dropped() const {
+      return drop_count.load(std::memory_order_relaxed);
+    }
+
+    static inline uint64_t now() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /** Duration event from start to now */
+    inline void complete(uint32_t module, const char *name, uint64_t start, int64_t value = 0) {
+      if (!enabled(module)) {
+        return;
+      }
+      uint64_t end = now();
+      push(module, TRACE_COMPLETE, name, start, end - start, value, NULL, NULL);
+    }
+
+    inline void instant(uint32_t module, const char *name, int64_t value = 0) {
+      if (!enabled(module)) {
+        return;
+      }
+      push(module, TRACE_INSTANT, name, now(), 0, value, NULL, NULL);
+    }
+
+    inline void counter(uint32_t module, const char *name, int64_t value) {
+      if (!enabled(module)) {
+        return;
+      }
+      push(module, TRACE_COUNTER, name, now(), 0, value, NULL, NULL);
+    }
+
+    void log(uint32_t module, const char *fmt, ...) {
+      if (!enabled(module)) {
+        return;
+      }
+      va_list args;
+      va_start(args, fmt);
+      push(module, TRACE_LOG, "log", now(), 0, 0, fmt, &args);
+      va_end(args);
+    }
+
+    void vlog(uint32_t module, const char *fmt, va_list args) {
+      if (!enabled(module)) {
+        return;
+      }
+      va_list copy;
+      va_copy(copy, args);
+      push(module, TRACE_LOG, "log", now(), 0, 0, fmt, &copy);
+      va_end(copy);
+    }
+
+  private:
+    Tracer() : dequeue_pos(0), first_event(true), trace_fp(NULL), running(false) {
+      mask_bits.store(0, std::memory_order_relaxed);
+      enqueue_pos.store(0, std::memory_order_relaxed);
+      drop_count.store(0, std::memory_order_relaxed);
+      for (size_t i = 0; i < RING_SIZE; i++) {
+        cells[i].seq.store(i, std::memory_order_relaxed);
+      }
+    }
+    Tracer(const Tracer &);
+    Tracer &operator=(const Tracer &);
+
+    static inline uint32_t threadId() {
+      static thread_local uint32_t tid =
+        (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+      return tid;
+    }
+
+    void push(uint32_t module, uint8_t type, const char *name, uint64_t ts,
+              uint64_t dur, int64_t value, const char *fmt, va_list *args) {
+      Cell *cell;
+      size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+      for (;;) {
+        cell = &cells[pos & (RING_SIZE - 1)];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+          if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            break;
+          }
+        } else if (dif < 0) {
+          drop_count.fetch_add(1, std::memory_order_relaxed);
+          return;
+        } else {
+          pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+      }
+
+      TraceRecord &rec = cell->rec;
+      rec.ts = ts;
+      rec.dur = dur;
+      rec.name = name;
+      rec.value = value;
+      rec.tid = threadId();
+      rec.module = (uint8_t)module;
+      rec.type = type;
+      if (fmt) {
+        vsnprintf(rec.text, sizeof(rec.text), fmt, *args);
+      } else {
+        rec.text[0] = '\0';
+      }
+      cell->seq.store(pos + 1, std::memory_order_release);
+    }
+
+    bool pop(TraceRecord &rec) {
+      Cell *cell = &cells[dequeue_pos & (RING_SIZE - 1)];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      if (seq != dequeue_pos + 1) {
+        return false;
+      }
+      rec = cell->rec;
+      cell->seq.store(dequeue_pos + RING_SIZE, std::memory_order_release);
+      dequeue_pos++;
+      return true;
+    }
+
+    static const char *moduleName(uint8_t module) {
+      switch (module) {
+      case TRACE_DRIVER:
+        return "driver";
+      case TRACE_LIDAR:
+        return "lidar";
+      case TRACE_NODE:
+        return "node";
+      case TRACE_OBSTACLE:
+        return "obstacle";
+      case TRACE_CONSOLE:
+        return "console";
+      default:
+        return "other";
+      }
+    }
+
+    void write(const TraceRecord &rec) {
+      if (rec.type == TRACE_LOG) {
+        fputs(rec.text, stdout);
+        return;
+      }
+      if (!trace_fp) {
+        return;
+      }
+      fputs(first_event ? "" : ",\n", trace_fp);
+      first_event = false;
+      switch (rec.type) {
+      case TRACE_COMPLETE:
+        fprintf(trace_fp, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                "\"pid\":1,\"tid\":%u,\"args\":{\"value\":%lld}}",
+                rec.name, moduleName(rec.module), rec.ts / 1e3, rec.dur / 1e3,
+                rec.tid, (long long)rec.value);
+        break;
+      case TRACE_INSTANT:
+        fprintf(trace_fp, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+                "\"pid\":1,\"tid\":%u,\"args\":{\"value\":%lld}}",
+                rec.name, moduleName(rec.module), rec.ts / 1e3, rec.tid, (long long)rec.value);
+        break;
+      case TRACE_COUNTER:
+        fprintf(trace_fp, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,"
+                "\"pid\":1,\"args\":{\"value\":%lld}}",
+                rec.name, moduleName(rec.module), rec.ts / 1e3, (long long)rec.value);
+        break;
+      default:
+        break;
+      }
+    }
+
+    void drain() {
+      TraceRecord rec;
+      for (;;) {
+        bool idle = true;
+        while (pop(rec)) {
+          write(rec);
+          idle = false;
+        }
+        if (!running) {
+          break;
+        }
+        if (idle) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+      }
+      while (pop(rec)) {
+        write(rec);
+      }
+    }
+
+    struct Cell {
+      std::atomic<size_t> seq;
+      TraceRecord         rec;
+    };
+
+    Cell                  cells[RING_SIZE];
+    std::atomic<size_t>   enqueue_pos;
+    size_t                dequeue_pos;
+    std::atomic<uint32_t> mask_bits;
+    std::atomic<uint64_t> drop_count;
+    bool                  first_event;
+    FILE                 *trace_fp;
+    std::atomic<bool>     running;
+    std::thread           drain_thread;
+  };
+
+  /**
+   * @brief RAII helper emitting a complete event for the enclosing scope.
+   */
+  class TraceScope
+  {
+  public:
+    TraceScope(uint32_t module, const char *name, int64_t value = 0)
+      : m_module(module), m_name(name), m_value(value),
+        m_start(Tracer::instance().enabled(module) ? Tracer::now() : 0) {}
+
+    ~TraceScope() {
+      if (m_start) {
+        Tracer::instance().complete(m_module, m_name, m_start, m_value);
+      }
+    }
+
+    void setValue(int64_t value) {
+      m_value = value;
+    }
+
+  private:
+    uint32_t    m_module;
+    const char *m_name;
+    int64_t     m_value;
+    uint64_t    m_start;
+  };
+
+}
+
+#define YDLIDAR_TRACE_CONCAT_(a, b) a##b
+#define YDLIDAR_TRACE_CONCAT(a, b) YDLIDAR_TRACE_CONCAT_(a, b)
+#define YDLIDAR_TRACE_SCOPE(module, name) \
+  ydlidar::TraceScope YDLIDAR_TRACE_CONCAT(_trace_scope_, __LINE__)(module, name)
+#define YDLIDAR_TRACE_LOG(module, ...) \
+  ydlidar::Tracer::instance().log(module, __VA_ARGS__)
+
+#endif /* _TRACER_H_ */
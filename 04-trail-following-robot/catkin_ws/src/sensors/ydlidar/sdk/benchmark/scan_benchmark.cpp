@@ -0,0 +1,343 @@
+#include "CYdLidar.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace ydlidar;
+
+/**
+ * Micro-benchmark of the SDK scan path without a device:
+ *   decode   YDlidarDriver::waitPackage on an in-memory packet stream [ns/point]
+ *   ascend   YDlidarDriver::ascendScanData [ns/scan]
+ *   process  CYdLidar::processScan, angle compensation and LaserScan conversion [ns/scan]
+ * Results are printed as JSON on stdout.
+ *
+ * usage: ydlidar_benchmark [--scans N] [--capture FILE --format plain|intensity|g25]
+ */
+
+static std::atomic<uint64_t> g_allocations(0);
+
+void *operator new(size_t size) {
+    g_allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+namespace {
+
+struct StreamFormat {
+    const char *name;
+    bool        intensities;    ///< 3 byte samples
+    bool        multiple_rate;  ///< G25 distance scale
+    size_t      points;         ///< points per revolution of the synthetic stream
+    uint8_t     frequency;      ///< scan frequency * 10
+};
+
+const StreamFormat FORMATS[] = {
+    {"plain",     false, false, 720,  70},
+    {"intensity", true,  false, 720,  70},
+    {"g25",       false, true,  2000, 90},
+};
+
+/** YDlidarDriver reading its packets from memory instead of the serial port */
+class MemoryStreamDriver : public YDlidarDriver
+{
+public:
+    MemoryStreamDriver() : m_pos(0) {
+    }
+
+    void setStream(const std::vector<uint8_t> &stream) {
+        m_stream = stream;
+        m_pos = 0;
+    }
+
+    void rewind() {
+        m_pos = 0;
+    }
+
+    /** Decodes up to count nodes, stops at the end of the stream */
+    size_t decode(node_info *nodes, size_t count) {
+        size_t n = 0;
+        while (n < count && IS_OK(waitPackage(&nodes[n]))) {
+            n++;
+        }
+        return n;
+    }
+
+protected:
+    virtual result_t waitForData(size_t /*data_count*/, uint32_t /*timeout*/, size_t *returned_size) {
+        size_t avail = m_stream.size() - m_pos;
+        if (returned_size) {
+            *returned_size = avail;
+        }
+        return avail ? RESULT_OK : RESULT_TIMEOUT;
+    }
+
+    virtual result_t getData(uint8_t *data, size_t size) {
+        if (size > m_stream.size() - m_pos) {
+            return RESULT_FAIL;
+        }
+        memcpy(data, &m_stream[m_pos], size);
+        m_pos += size;
+        return RESULT_OK;
+    }
+
+private:
+    std::vector<uint8_t> m_stream;
+    size_t               m_pos;
+};
+
+class BenchmarkLidar : public CYdLidar
+{
+public:
+    bool process(node_info *nodes, size_t count, LaserScan &scan) {
+        return processScan(nodes, count, scan);
+    }
+};
+
+inline void put16(std::vector<uint8_t> &out, uint16_t value) {
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8);
+}
+
+/** One revolution of packets as sent by the device, 40 samples per packet */
+std::vector<uint8_t> makeStream(const StreamFormat &format) {
+    const size_t per_package = 40;
+    double inc = 360.0 / format.points;
+    std::vector<uint8_t> stream;
+    for (size_t start = 0; start < format.points; start += per_package) {
+        size_t n = std::min(per_package, format.points - start);
+        uint16_t first = (((uint16_t)(start * inc * 64)) << 1) | LIDAR_RESP_MEASUREMENT_CHECKBIT;
+        uint16_t last = (((uint16_t)((start + n - 1) * inc * 64)) << 1) | LIDAR_RESP_MEASUREMENT_CHECKBIT;
+        uint8_t ct = start == 0 ? (CT_RingStart | (format.frequency << 1)) : CT_Normal;
+        uint16_t check = PH ^ first ^ last ^ (uint16_t)(ct | (n << 8));
+
+        size_t head = stream.size();
+        put16(stream, PH);
+        stream.push_back(ct);
+        stream.push_back((uint8_t)n);
+        put16(stream, first);
+        put16(stream, last);
+        put16(stream, 0);
+        for (size_t i = start; i < start + n; i++) {
+            // a room: walls between 0.7 and 2.3 m, some dropouts
+            double angle = i * inc * M_PI / 180.0;
+            double range = (i % 17 == 0) ? 0.0 : 1.5 + 0.8 * sin(3 * angle);
+            uint16_t distance = (uint16_t)(range * (format.multiple_rate ? 2000 : 4000));
+            if (format.intensities) {
+                uint8_t quality = (uint8_t)(i * 7);
+                distance &= format.multiple_rate ? 0xfffe : 0xfffc;
+                stream.push_back(quality);
+                check ^= quality;
+            }
+            put16(stream, distance);
+            check ^= distance;
+        }
+        stream[head + 8] = check & 0xff;
+        stream[head + 9] = check >> 8;
+    }
+    return stream;
+}
+
+bool readCapture(const std::string &path, std::vector<uint8_t> &stream) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        stream.insert(stream.end(), buf, buf + n);
+    }
+    fclose(fp);
+    return !stream.empty();
+}
+
+inline uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct StageStats {
+    std::vector<uint64_t> samples;  ///< ns per scan
+    uint64_t total_ns;
+    uint64_t allocations;
+
+    StageStats() : total_ns(0), allocations(0) {
+    }
+
+    void add(uint64_t ns) {
+        samples.push_back(ns);
+        total_ns += ns;
+    }
+
+    uint64_t percentile(double q) {
+        if (samples.empty()) {
+            return 0;
+        }
+        std::sort(samples.begin(), samples.end());
+        return samples[(size_t)(q * (samples.size() - 1))];
+    }
+};
+
+void printStage(const char *name, StageStats &stats, size_t scans, size_t points, bool last) {
+    printf("        \"%s\": {\"ns_per_scan\": %.1f, \"ns_per_point\": %.2f, \"p50_ns\": %llu, "
+           "\"p99_ns\": %llu, \"allocations_per_scan\": %.2f}%s\n",
+           name, (double)stats.total_ns / scans, (double)stats.total_ns / points,
+           (unsigned long long)stats.percentile(0.5), (unsigned long long)stats.percentile(0.99),
+           (double)stats.allocations / scans, last ? "" : ",");
+}
+
+/** Runs all stages over the stream until scans revolutions were processed */
+bool runFormat(const StreamFormat &format, const std::vector<uint8_t> &stream, size_t scans, bool last) {
+    MemoryStreamDriver driver;
+    driver.setIntensities(format.intensities);
+    driver.setMultipleRate(format.multiple_rate);
+    driver.setStream(stream);
+
+    BenchmarkLidar lidar;
+    lidar.setMaxRange(16.0);
+    lidar.setMinRange(0.08);
+
+    // nodes of one pass over the stream, split into revolutions at the sync flags
+    std::vector<node_info> nodes(stream.size() / 2 + 1);
+    std::vector<node_info> revolution;
+    std::vector<size_t> starts;
+    StageStats decode, ascend, process;
+    size_t done = 0;
+    size_t points = 0;
+    LaserScan scan;
+
+    while (done < scans) {
+        driver.rewind();
+        uint64_t allocations = g_allocations;
+        uint64_t start = nowNs();
+        size_t count = driver.decode(&nodes[0], nodes.size());
+        uint64_t elapsed = nowNs() - start;
+        allocations = g_allocations - allocations;
+
+        // every node of the ring start package carries the sync flag, a revolution starts at the first
+        starts.clear();
+        for (size_t i = 0; i < count; i++) {
+            if ((nodes[i].sync_flag & LIDAR_RESP_MEASUREMENT_SYNCBIT) &&
+                (i == 0 || !(nodes[i - 1].sync_flag & LIDAR_RESP_MEASUREMENT_SYNCBIT))) {
+                starts.push_back(i);
+            }
+        }
+        if (starts.empty()) {
+            fprintf(stderr, "%s: no revolution in the stream\n", format.name);
+            return false;
+        }
+        // a synthetic stream is one revolution, the partial last revolution of a capture is dropped
+        if (starts.size() == 1) {
+            starts.push_back(count);
+        }
+        size_t revolutions = starts.size() - 1;
+        for (size_t r = 0; r < revolutions; r++) {
+            decode.add(elapsed / revolutions);
+        }
+        decode.allocations += allocations;
+
+        for (size_t r = 0; r < revolutions && done < scans; r++, done++) {
+            revolution.assign(nodes.begin() + starts[r], nodes.begin() + starts[r + 1]);
+            points += revolution.size();
+
+            allocations = g_allocations;
+            start = nowNs();
+            driver.ascendScanData(&revolution[0], revolution.size());
+            ascend.add(nowNs() - start);
+            ascend.allocations += g_allocations - allocations;
+
+            allocations = g_allocations;
+            start = nowNs();
+            lidar.process(&revolution[0], revolution.size(), scan);
+            process.add(nowNs() - start);
+            process.allocations += g_allocations - allocations;
+        }
+    }
+
+    printf("    {\n");
+    printf("      \"format\": \"%s\",\n", format.name);
+    printf("      \"scans\": %llu,\n", (unsigned long long)done);
+    printf("      \"points_per_scan\": %.1f,\n", (double)points / done);
+    printf("      \"stages\": {\n");
+    printStage("decode", decode, decode.samples.size(), points, false);
+    printStage("ascend", ascend, done, points, false);
+    printStage("process", process, done, points, true);
+    printf("      }\n");
+    printf("    }%s\n", last ? "" : ",");
+    fflush(stdout);
+    return true;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    size_t scans = 2000;
+    std::string capture;
+    std::string capture_format = "plain";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--scans" && i + 1 < argc) {
+            scans = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--capture" && i + 1 < argc) {
+            capture = argv[++i];
+        } else if (arg == "--format" && i + 1 < argc) {
+            capture_format = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--scans N] [--capture FILE --format plain|intensity|g25]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (scans == 0) {
+        scans = 1;
+    }
+
+    size_t format_count = _countof(FORMATS);
+    printf("{\n  \"benchmark\": \"ydlidar_sdk\",\n  \"results\": [\n");
+    bool ok = true;
+    if (!capture.empty()) {
+        std::vector<uint8_t> stream;
+        const StreamFormat *format = NULL;
+        for (size_t i = 0; i < format_count; i++) {
+            if (capture_format == FORMATS[i].name) {
+                format = &FORMATS[i];
+            }
+        }
+        if (!format || !readCapture(capture, stream)) {
+            fprintf(stderr, "cannot read capture %s as %s\n", capture.c_str(), capture_format.c_str());
+            return 1;
+        }
+        ok = runFormat(*format, stream, scans, true);
+    } else {
+        for (size_t i = 0; i < format_count; i++) {
+            ok = runFormat(FORMATS[i], makeStream(FORMATS[i]), scans, i + 1 == format_count) && ok;
+        }
+    }
+    printf("  ]\n}\n");
+    return ok ? 0 : 1;
+}
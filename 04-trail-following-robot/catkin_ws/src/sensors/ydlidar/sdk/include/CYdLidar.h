@@ -2,6 +2,9 @@
 #pragma once
 #include "utils.h"
 #include "ydlidar_driver.h"
+#include "device_cache.h"
+#include "scan_broker.h"
+#include "scan_log.h"
 #include <math.h>
 
 #if !defined(__cplusplus)
@@ -36,12 +39,18 @@ class YDLIDAR_API CYdLidar
     PropertyBuilderByName(bool,Exposure,private)///< 设置和获取激光时候开启低光功率曝光模式 只有S4雷达支持
     PropertyBuilderByName(bool,Reversion, private)///< 设置和获取是否旋转激光180度
     PropertyBuilderByName(bool,AutoReconnect, private)///< 设置异常是否自动重新连接
+    PropertyBuilderByName(bool,CartesianOutput, private)///< 设置是否输出笛卡尔坐标(x, y)及每个点时间
 
     PropertyBuilderByName(int,SerialBaudrate,private)///< 设置和获取激光通讯波特率
     PropertyBuilderByName(int,SampleRate,private)///< 设置和获取激光采样频率
 
     PropertyBuilderByName(std::string,SerialPort,private)///< 设置和获取激光端口号
     PropertyBuilderByName(std::vector<float>,IgnoreArray,private)///< 设置和获取激光剔除点
+    PropertyBuilderByName(std::string,CacheFile,private)///< 设置和获取设备配置缓存文件, 为空时不使用缓存
+    PropertyBuilderByName(std::string,BrokerName,private)///< 设置和获取共享内存扫描发布名称, 为空时不发布
+    PropertyBuilderByName(std::string,RecordFile,private)///< 设置和获取扫描记录文件, 为空时不记录
+    PropertyBuilderByName(std::string,ReplayFile,private)///< 设置和获取回放的扫描记录文件, 设置后不连接雷达
+    PropertyBuilderByName(float,ReplaySpeed,private)///< 设置和获取回放速度, 1 实时, 0 尽快
 
 
 public:
@@ -58,6 +67,17 @@ public:
     //Turn off the motor enable and close the scan
 	bool  turnOff(); //!< See base class docs
 
+    /** Keeps the motor spinning but discards scan data until resume(). Returns false if not scanning */
+    bool standby();
+    /** Leaves standby, the next complete revolution is delivered without any command round trip */
+    bool resume();
+    bool isStandby() const;
+
+    /** Applies a new scan frequency [Hz] and sampling rate [K] while running. Only the changed device
+      * settings are sent (scan stopped and restarted), the angle/range properties need no call.
+      */
+    bool reconfigureScan(int frequency, int sample_rate);
+
     /** Returns true if the device is in good health, If it's not*/
 	bool getDeviceHealth() const;
 
@@ -67,6 +87,16 @@ public:
     /** Retruns true if the scan frequency is set to user's frequency is successful, If it's not*/
     bool checkScanFrequency();
 
+    /** Switches models with selectable rates to m_SampleRate and returns the sampling rate [K] the
+      * device runs at. rate_known uses the last rate code instead of reading it from the device.
+      */
+    int checkSamplingRate(int model, bool rate_known);
+
+    /** Positions the replay at the first revolution stamped at or after stamp [ns] */
+    bool seekReplay(uint64_t stamp);
+    /** True once the whole ReplayFile was delivered */
+    bool replayFinished() const;
+
     //Turn off lidar connection
     void disconnecting(); //!< Closes the comms with the laser. Shouldn't have to be directly needed by the user
 
@@ -87,6 +117,30 @@ protected:
       */
     bool checkHardware();
 
+    /** Returns true if the cached configuration of the device on this port was verified
+      * with a single device info request and applied. If it's not, the entry is dropped.
+      */
+    bool checkCachedConfig(int &type);
+
+    /** Records the configuration found by the full probe in the cache file */
+    void storeCachedConfig();
+
+    /** Returns true if the device sampling rate code reached target. The steps are
+      * pipelined in one exchange, with a bounded synchronous fallback.
+      */
+    bool switchSamplingRate(sampling_rate &rate, int target, int rate_count);
+
+    /** Builds the scan from one revolution of ascended nodes */
+    bool processScan(node_info *nodes, size_t count, LaserScan &outscan);
+
+    /** Decodes the next revolution of ReplayFile, paced by ReplaySpeed */
+    bool replayScan(LaserScan &outscan);
+
+    /** Rebuilds the cos/sin tables if the scan geometry changed */
+    void updateTrigTable(size_t counts, float min_angle, float ang_increment);
+
+    /** Fills x, y and point_time of the scan from its ranges */
+    void toCartesian(LaserScan &scan);
 
 
 private:
@@ -95,6 +149,20 @@ private:
     double each_angle;
     bool m_isMultipleRate;
     double m_FrequencyOffset;
+    int m_requestSampleRate;
+
+    DeviceCache m_cache;
+    device_info m_deviceInfo;
+    ScanBroker m_broker;
+    ScanLogWriter m_recorder;
+    ScanLogReader m_replay;
+    uint64_t m_replayStart;
+    uint64_t m_replayClock;
+
+    std::vector<float> m_cosTable;
+    std::vector<float> m_sinTable;
+    float m_tableMinAngle;
+    float m_tableIncrement;
 
     YDlidarDriver *lidarPtr;
 };	// End of class
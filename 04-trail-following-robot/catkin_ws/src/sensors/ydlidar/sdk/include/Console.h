@@ -10,6 +10,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include "v8stdint.h"
+#include <ydlidar/tracer.h>
 
 using namespace std;
 namespace ydlidar
@@ -28,6 +29,19 @@ namespace ydlidar
     Console () {}
     virtual ~Console (void) {}
   public:
+    /**
+     * @brief hand a formatted message to the trace ring instead of stdout
+     * @return true if TRACE_CONSOLE is enabled and the message was queued
+     */
+    bool
+    traced (const char* color_, const char* prefix_, const char* out_, const char* suffix_)
+    {
+      if (!Tracer::instance().enabled(TRACE_CONSOLE))
+        return false;
+      Tracer::instance().log(TRACE_CONSOLE, "%s%s%s%s%s", color_, prefix_, out_, COLOR_NONE, suffix_);
+      return true;
+    }
+
     void
     show(const char* message_, ...)
     {
@@ -36,6 +50,8 @@ namespace ydlidar
         va_start(args, message_);
         vsnprintf (out, sizeof(out), message_, args);
         va_end(args);
+        if (traced (COLOR_GREEN, "", out, ""))
+          return;
         printf (COLOR_GREEN);
         printf (out);
         printf (COLOR_NONE);
@@ -48,6 +64,8 @@ namespace ydlidar
       va_start(args, message_);
       vsnprintf (out, sizeof(out), message_, args);
       va_end(args);
+      if (traced (COLOR_GREEN, "[YDLidar]: ", out, "\r\n"))
+        return;
       printf (COLOR_GREEN);
       printf ("[YDLidar]: ");
       printf (out);
@@ -64,6 +82,8 @@ namespace ydlidar
       va_start(args, warning_);
       vsnprintf (out, sizeof(out), warning_, args);
       va_end(args);
+      if (traced (COLOR_YELLOW, "Warning: ", out, "\r\n"))
+        return;
       printf (COLOR_YELLOW);
       printf ("Warning: ");
       printf (out);
@@ -80,6 +100,8 @@ namespace ydlidar
       va_start(args, error_);
       vsnprintf (out, sizeof(out), error_, args);
       va_end(args);
+      if (traced (COLOR_RED, "Error: ", out, "\r\n"))
+        return;
       printf (COLOR_RED);
       printf ("Error: ");
       printf (out);
@@ -99,6 +121,8 @@ namespace ydlidar
         va_start(args, message_);
         vsnprintf (out, sizeof(out), message_, args);
         va_end(args);
+        if (traced (COLOR_CYAN, ">>>   ", out, "\r\n"))
+          return;
         printf (COLOR_CYAN);
         printf (">>>   ");
         printf (out);
@@ -0,0 +1,70 @@
+
+#pragma once
+#include "utils.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ydlidar
+{
+  /**
+   * @brief Last known configuration of one device, keyed by its serial number.
+   */
+  struct DeviceCacheEntry {
+    uint8_t     serialnum[16];      ///< 系列号
+    std::string port;               ///< 串口号
+    int         baudrate;           ///< 波特率
+    int         model;              ///< 雷达型号
+    uint16_t    firmware_version;   ///< 固件版本号
+    uint8_t     hardware_version;   ///< 硬件版本号
+    int         sampling_rate_code; ///< 设备采样频率代码, -1 未知
+    int         sample_rate;        ///< 实际采样频率 [K]
+    int         request_sample_rate;///< 用户设置的采样频率 [K]
+    int         scan_frequency;     ///< 用户设置的扫描频率 [Hz]
+    int         node_counts;        ///< 一圈点数
+    double      each_angle;         ///< 角度分辨率
+    bool        multiple_rate;      ///< 采样倍频
+    bool        intensities;        ///< 信号质量
+
+    DeviceCacheEntry();
+  };
+
+  /**
+   * @brief Small text file holding one DeviceCacheEntry per line.
+   * Lets CYdLidar verify a known device with a single command on start
+   * instead of probing baud rates, sampling rate and scan frequency.
+   */
+  class YDLIDAR_API DeviceCache
+  {
+  public:
+    /** Reads the cache file, a missing file is an empty cache */
+    bool load(const std::string &path);
+
+    /** Writes the cache file atomically (temporary file + rename) */
+    bool save() const;
+
+    /** Entry of the device with this serial number, NULL if unknown */
+    const DeviceCacheEntry *find(const uint8_t serialnum[16]) const;
+
+    /** Entry of the device last seen on this port, NULL if unknown */
+    const DeviceCacheEntry *findByPort(const std::string &port) const;
+
+    /** Adds or replaces the entry with the same serial number */
+    void store(const DeviceCacheEntry &entry);
+
+    /** Drops the entry with this serial number */
+    void erase(const uint8_t serialnum[16]);
+
+    /** Drops the entry last seen on this port */
+    void eraseByPort(const std::string &port);
+
+    const std::string &path() const {
+      return m_path;
+    }
+
+  private:
+    std::string                   m_path;
+    std::vector<DeviceCacheEntry> m_entries;
+  };
+
+}
@@ -0,0 +1,143 @@
+
+#pragma once
+#include "utils.h"
+#include "ydlidar_protocol.h"
+#include <atomic>
+#include <string>
+
+namespace ydlidar
+{
+  /**
+   * @brief Shared memory layout of the broker: a header followed by slot_count
+   * slots, each a ScanSlotHeader and then max_points ranges and intensities.
+   */
+  struct ScanBrokerHeader {
+    uint32_t              magic;        ///< SCAN_BROKER_MAGIC
+    uint32_t              version;      ///< SCAN_BROKER_VERSION
+    uint32_t              slot_count;   ///< 槽数量
+    uint32_t              max_points;   ///< 每圈最大点数
+    uint64_t              slot_size;    ///< 每个槽字节数
+    std::atomic<uint64_t> write_index;  ///< 已发布的扫描数
+  };
+
+  struct ScanSlotHeader {
+    std::atomic<uint32_t> seq;          ///< seqlock, 奇数表示正在写
+    uint32_t              count;        ///< 点数
+    uint64_t              index;        ///< 扫描序号
+    uint64_t              self_time_stamp;
+    uint64_t              system_time_stamp;
+    LaserConfig           config;
+  };
+
+  /**
+   * @brief Zero-copy view of one scan inside the shared memory ring.
+   * The data may be overwritten by the writer at any time; check
+   * ScanBrokerClient::validate() after using it.
+   */
+  struct ScanView {
+    const float    *ranges;
+    const float    *intensities;
+    uint32_t        count;
+    uint64_t        index;
+    uint64_t        self_time_stamp;
+    uint64_t        system_time_stamp;
+    LaserConfig     config;
+
+    const ScanSlotHeader *slot;
+    uint32_t        seq;
+  };
+
+  /**
+   * @brief Publishes decoded scans to a POSIX shared memory ring.
+   * A single writer (the process owning the serial port) and any number of
+   * local ScanBrokerClient readers, no locks on either side.
+   */
+  class YDLIDAR_API ScanBroker
+  {
+  public:
+    enum {
+      DEFAULT_SLOTS  = 8,
+      DEFAULT_POINTS = 3600,
+    };
+
+    ScanBroker();
+    ~ScanBroker();
+
+    /**
+     * @brief create the shared memory ring
+     * @param[in] name  shm name, e.g. "/ydlidar_scan"
+     */
+    bool open(const std::string &name, uint32_t slot_count = DEFAULT_SLOTS,
+              uint32_t max_points = DEFAULT_POINTS);
+
+    /** Unmaps and unlinks the ring, attached readers keep their mapping */
+    void close();
+
+    bool isOpen() const {
+      return m_header != NULL;
+    }
+
+    /** Copies the scan into the next slot, ranges beyond max_points are dropped */
+    bool publish(const LaserScan &scan);
+
+  private:
+    ScanBroker(const ScanBroker &);
+    ScanBroker &operator=(const ScanBroker &);
+
+    std::string       m_name;
+    ScanBrokerHeader *m_header;
+    size_t            m_size;
+  };
+
+  /**
+   * @brief Reader side of ScanBroker, no ROS and no serial port needed.
+   */
+  class YDLIDAR_API ScanBrokerClient
+  {
+  public:
+    enum {
+      DEFAULT_TIMEOUT = 2000, ///< 默认超时时间 [ms]
+    };
+
+    ScanBrokerClient();
+    ~ScanBrokerClient();
+
+    /** Maps an existing ring read-only */
+    bool attach(const std::string &name);
+
+    void detach();
+
+    bool isAttached() const {
+      return m_header != NULL;
+    }
+
+    /**
+     * @brief wait for the newest unread scan and return a view into shared memory
+     * @return RESULT_OK, RESULT_TIMEOUT if no new scan arrived, RESULT_FAIL if not attached
+     */
+    result_t waitScan(ScanView &view, uint32_t timeout = DEFAULT_TIMEOUT);
+
+    /** True if the slot was not rewritten since waitScan returned the view */
+    bool validate(const ScanView &view) const;
+
+    /** Copying variant of waitScan, retries if the writer overtook the reader */
+    result_t readScan(LaserScan &scan, uint32_t timeout = DEFAULT_TIMEOUT);
+
+    /** Scans published but never returned to this reader */
+    uint64_t dropped() const {
+      return m_dropped;
+    }
+
+  private:
+    ScanBrokerClient(const ScanBrokerClient &);
+    ScanBrokerClient &operator=(const ScanBrokerClient &);
+
+    const ScanSlotHeader *slot(uint64_t index) const;
+
+    const ScanBrokerHeader *m_header;
+    size_t                  m_size;
+    uint64_t                m_next;
+    uint64_t                m_dropped;
+  };
+
+}
@@ -0,0 +1,152 @@
+
+#pragma once
+#include "utils.h"
+#include "ydlidar_protocol.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace ydlidar
+{
+  /**
+   * @brief Scan log file layout:
+   * ScanLogFileHeader, then one block per revolution (ScanLogRevolution followed
+   * by the encoded nodes), then the ScanLogIndexEntry array and a ScanLogTrailer.
+   *
+   * Each node is encoded as zigzag varints: the second difference of
+   * angle_q6_checkbit, the first difference of distance_q2 and the second difference
+   * of stamp. A quality byte (sync_quality >> LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) follows.
+   * A typical node takes 4-5 bytes, a node_info takes 16.
+   */
+  struct ScanLogFileHeader {
+    char        magic[8];           ///< "YDSCNLOG"
+    uint32_t    version;
+    uint32_t    model;              ///< 雷达型号
+    uint8_t     serialnum[16];      ///< 系列号
+  } __attribute__((packed));
+
+  enum {
+    SCAN_LOG_MULTIPLE_RATE = 0x01,  ///< distance_q2 is in 1/2000 m
+  };
+
+  struct ScanLogRevolution {
+    uint32_t    magic;              ///< SCAN_LOG_BLOCK_MAGIC
+    uint32_t    payload_size;       ///< 编码后的节点字节数
+    uint64_t    stamp;              ///< 第一个点的时间戳 [ns]
+    uint32_t    count;              ///< 点数
+    uint16_t    node_counts;        ///< 固定分辨率时一圈点数
+    uint8_t     flags;              ///< SCAN_LOG_MULTIPLE_RATE
+    uint8_t     scan_frequence;     ///< 扫描频率 * 10
+    uint8_t     sample_rate;        ///< 采样频率 [K]
+    uint8_t     reserved[7];
+  } __attribute__((packed));
+
+  struct ScanLogIndexEntry {
+    uint64_t    stamp;
+    uint64_t    offset;             ///< 文件中 ScanLogRevolution 的位置
+  } __attribute__((packed));
+
+  struct ScanLogTrailer {
+    uint64_t    index_offset;
+    uint32_t    index_count;
+    uint32_t    magic;              ///< SCAN_LOG_TRAILER_MAGIC
+  } __attribute__((packed));
+
+  /**
+   * @brief Appends revolutions of ascended nodes to a scan log.
+   */
+  class YDLIDAR_API ScanLogWriter
+  {
+  public:
+    enum {
+      INDEX_INTERVAL = 16,  ///< 每隔多少圈写一个索引
+    };
+
+    ScanLogWriter();
+    ~ScanLogWriter();
+
+    /** Creates (truncates) the log, info may be NULL */
+    bool open(const std::string &path, const device_info *info = NULL);
+
+    /** Writes the time index and the trailer and closes the file */
+    bool close();
+
+    bool isOpen() const {
+      return m_fp != NULL;
+    }
+
+    /** Appends one revolution, nodes as returned by ascendScanData */
+    bool write(const node_info *nodes, size_t count, uint16_t node_counts,
+               bool multiple_rate, uint8_t sample_rate);
+
+  private:
+    ScanLogWriter(const ScanLogWriter &);
+    ScanLogWriter &operator=(const ScanLogWriter &);
+
+    FILE                           *m_fp;
+    uint64_t                        m_offset;
+    uint64_t                        m_revolutions;
+    std::vector<ScanLogIndexEntry>  m_index;
+    std::vector<uint8_t>            m_buffer;
+  };
+
+  /**
+   * @brief Memory maps a scan log and decodes it revolution by revolution.
+   * A log without trailer (recorder killed) is readable up to its last complete
+   * revolution, the index is then rebuilt on open.
+   */
+  class YDLIDAR_API ScanLogReader
+  {
+  public:
+    ScanLogReader();
+    ~ScanLogReader();
+
+    bool open(const std::string &path);
+    void close();
+
+    bool isOpen() const {
+      return m_data != NULL;
+    }
+
+    const ScanLogFileHeader &header() const {
+      return *reinterpret_cast<const ScanLogFileHeader *>(m_data);
+    }
+
+    /** Stamp of the first revolution, 0 if the log is empty */
+    uint64_t startStamp() const;
+
+    /** Positions at the first revolution stamped at or after stamp, O(log n) */
+    bool seek(uint64_t stamp);
+
+    /** Back to the first revolution */
+    void rewind();
+
+    /** True if next() has no more revolutions */
+    bool eof() const {
+      return m_pos >= m_end;
+    }
+
+    /**
+     * @brief decode the next revolution
+     * @param[out] rev   revolution header
+     * @param[out] nodes decoded nodes
+     * @param[in,out] count capacity of nodes, then number of nodes
+     * @return false at the end of the log or on a corrupt block
+     */
+    bool next(ScanLogRevolution &rev, node_info *nodes, size_t &count);
+
+  private:
+    ScanLogReader(const ScanLogReader &);
+    ScanLogReader &operator=(const ScanLogReader &);
+
+    const ScanLogRevolution *block(size_t offset) const;
+    void rebuildIndex();
+
+    const uint8_t                  *m_data;
+    size_t                          m_size;
+    size_t                          m_pos;
+    size_t                          m_end;
+    std::vector<ScanLogIndexEntry>  m_index;
+  };
+
+}
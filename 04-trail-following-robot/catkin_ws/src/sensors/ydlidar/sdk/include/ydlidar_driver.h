@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <atomic>
 #include <map>
+#include <vector>
 #include "locker.h"
 #include "serial.h"
 #include "thread.h"
@@ -123,6 +124,33 @@ namespace ydlidar{
     	*/
         bool getMultipleRate() const;
 
+		/**
+		* @brief 设置已知的采样频率代码 \n
+		* @param[in] rate    采样频率代码, -1 未知
+		* @note 已知时 checkTransTime 不再查询雷达采样频率
+		*/
+		void setCachedSamplingRate(int rate);
+
+		/**
+		* @brief 获取最近一次查询或设置的采样频率代码 \n
+		* @return 采样频率代码, -1 未知
+		*/
+		int getCachedSamplingRate() const;
+
+		/**
+		* @brief 设置待机模式 \n
+		* @param[in] enable    是否待机:
+		*     true	电机保持转动, 丢弃串口数据, 不输出扫描
+		*	  false 恢复输出, 从下一整圈开始
+		* @note 不发送任何命令, 可在扫描中调用
+		*/
+		void setStandby(bool enable);
+
+		/**
+		* @brief 是否处于待机模式 \n
+		*/
+		bool isStandby() const;
+
 		/**
 		 * @brief 检测传输时间 \n
 		 * */
@@ -165,6 +193,24 @@ namespace ydlidar{
     	*/
 		result_t stop();
 
+		/**
+		* @brief 停止扫描, 电机保持转动 \n
+		* @return 返回执行结果
+		* @retval RESULT_OK       关闭成功
+		* @note 运行时更改配置用, 之后用 ::restartScan 恢复扫描
+		*/
+		result_t stopScan();
+
+		/**
+		* @brief 电机已转动时开启扫描, 不重新启动电机 \n
+		* @param[in] force    扫描模式
+		* @param[in] timeout  超时时间
+		* @return 返回执行结果
+		* @retval RESULT_OK       开启成功
+		* @retval RESULT_FAILE    开启失败, 需要用 ::startScan 重新启动电机
+		*/
+		result_t restartScan(bool force = false, uint32_t timeout = DEFAULT_TIMEOUT);
+
 		
 		/**
 		* @brief 获取激光数据 \n
@@ -430,6 +476,28 @@ namespace ydlidar{
     	*/
 		result_t setPointsForOneRingFlag(scan_points& points,uint32_t timeout = DEFAULT_TIMEOUT);
 
+		/**
+		* @brief 排队一个无参数配置命令, 暂不发送 \n
+		* @param[in] cmd          命令码
+		* @param[out] response    应答数据, flushCommands 返回前必须保持有效
+		* @param[in] size         应答数据大小
+		* @param[out] result      该命令的执行结果, 由 flushCommands 填写, 可为 NULL
+		* @param[in] timeout      该命令应答的超时时间
+		* @note Pipelined batch call: nothing is sent before flushCommands.
+		*/
+		void queueCommand(uint8_t cmd, void * response, size_t size, result_t * result = NULL,
+		                  uint32_t timeout = DEFAULT_TIMEOUT);
+
+		/**
+		* @brief 发送所有排队的命令, 并按顺序读取应答 \n
+		* @return 返回执行结果
+		* @retval RESULT_OK       全部成功
+		* @retval RESULT_FAILE or RESULT_TIMEOUT   至少一个命令失败, 见各命令的 result
+		* @note 停止扫描后再执行当前操作. The queued commands go out in a single write, then the call
+		*       blocks until every response arrived or timed out; responses are matched in FIFO order.
+		*/
+		result_t flushCommands();
+
 	protected:
 
 		/**
@@ -517,8 +585,9 @@ namespace ydlidar{
 		* @retval RESULT_TIMEOUT  等待超时
     	* @retval RESULT_FAILE    获取失败	
 		* @note 当timeout = -1 时, 将一直等待
+		* @note 虚函数, 基准测试用内存数据流替代串口
     	*/
-        result_t waitForData(size_t data_count,uint32_t timeout = DEFAULT_TIMEOUT, size_t * returned_size = NULL);
+        virtual result_t waitForData(size_t data_count,uint32_t timeout = DEFAULT_TIMEOUT, size_t * returned_size = NULL);
 
 		/**
 		* @brief 获取串口数据 \n
@@ -528,7 +597,7 @@ namespace ydlidar{
     	* @retval RESULT_OK       获取成功
     	* @retval RESULT_FAILE    获取失败	
     	*/
-		result_t getData(uint8_t * data, size_t size);
+		virtual result_t getData(uint8_t * data, size_t size);
 
 		/**
 		* @brief 串口发送数据 \n
@@ -647,9 +716,20 @@ namespace ydlidar{
         uint16_t Valu8Tou16;
 		bool isMultipleRate;
         uint8_t scan_frequence;
+        std::atomic<bool> m_standby;        ///< 待机模式
 
         std::string serial_port;///< 雷达端口
 
+        struct PendingCommand {
+            uint8_t cmd;
+            uint8_t *response;
+            size_t size;
+            uint32_t timeout;
+            result_t *result;
+        };
+        std::vector<PendingCommand> m_pendingCommands;///< 排队的配置命令
+        Locker _cmd_lock;                   ///< 命令队列锁
+
 	};
 }
 
@@ -209,6 +209,12 @@ struct LaserScan {
     std::vector<float> ranges;
     //! Array of intensities
     std::vector<float> intensities;
+    //! Cartesian x of each range [m], only filled with CYdLidar::setCartesianOutput(true). NaN for invalid ranges
+    std::vector<float> x;
+    //! Cartesian y of each range [m], only filled with CYdLidar::setCartesianOutput(true). NaN for invalid ranges
+    std::vector<float> y;
+    //! Time of each range relative to system_time_stamp [s], only filled with CYdLidar::setCartesianOutput(true)
+    std::vector<float> point_time;
     //! Self reported time stamp in nanoseconds
     uint64_t self_time_stamp;
     //! System time when first range was measured in nanoseconds
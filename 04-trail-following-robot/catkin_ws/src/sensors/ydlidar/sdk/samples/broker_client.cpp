@@ -0,0 +1,50 @@
+#include "scan_broker.h"
+#include "timer.h"
+#include "Console.h"
+#include <string>
+
+using namespace std;
+using namespace ydlidar;
+
+/**
+ * Reads scans published by a CYdLidar with BrokerName set (or the ROS node
+ * with the broker_name param), without touching the serial port.
+ */
+int main(int argc, char * argv[])
+{
+    std::string name = "/ydlidar_scan";
+    if (argc > 1) {
+        name = argv[1];
+    }
+    ydlidar::init(argc, argv);
+
+    ScanBrokerClient client;
+    while (ydlidar::ok() && !client.attach(name)) {
+        ydlidar::console.warning("Waiting for scan broker %s", name.c_str());
+        delay(1000);
+    }
+
+    while (ydlidar::ok()) {
+        ScanView view;
+        result_t ans = client.waitScan(view);
+        if (IS_OK(ans)) {
+            // read straight from shared memory, then check the writer did not overtake us
+            float nearest = view.config.max_range;
+            for (uint32_t i = 0; i < view.count; i++) {
+                if (view.ranges[i] > 0 && view.ranges[i] < nearest) {
+                    nearest = view.ranges[i];
+                }
+            }
+            if (client.validate(view)) {
+                ydlidar::console.message("Scan received[%llu]: %u ranges, nearest %.2fm, dropped %llu",
+                                         (unsigned long long)view.self_time_stamp, view.count, nearest,
+                                         (unsigned long long)client.dropped());
+            }
+        } else if (IS_TIMEOUT(ans)) {
+            // the writer may have restarted and replaced the ring
+            ydlidar::console.warning("No scan from %s, re-attaching", name.c_str());
+            client.attach(name);
+        }
+    }
+    return 0;
+}
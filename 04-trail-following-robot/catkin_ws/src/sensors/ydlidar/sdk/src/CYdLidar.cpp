@@ -1,6 +1,13 @@
 #include "CYdLidar.h"
 #include "common.h"
 #include <map>
+#include <string.h>
+#include <limits>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 
 
@@ -21,6 +28,12 @@ CYdLidar::CYdLidar() : lidarPtr(nullptr)
     m_Exposure          = false;
     m_Reversion         = false;
     m_AutoReconnect     = true;
+    m_CartesianOutput   = false;
+    m_CacheFile         = "";
+    m_BrokerName        = "";
+    m_RecordFile        = "";
+    m_ReplayFile        = "";
+    m_ReplaySpeed       = 1.f;
     m_MaxAngle          = 180.f;
     m_MinAngle          = -180.f;
     m_MaxRange          = 16.0;
@@ -32,7 +45,13 @@ CYdLidar::CYdLidar() : lidarPtr(nullptr)
     each_angle          = 0.5;
     m_FrequencyOffset   = 0.4;
     m_isMultipleRate    = false;
+    m_requestSampleRate = m_SampleRate;
+    m_tableMinAngle     = 0.f;
+    m_tableIncrement    = 0.f;
+    m_replayStart       = 0;
+    m_replayClock       = 0;
     m_IgnoreArray.clear();
+    memset(&m_deviceInfo, 0, sizeof(m_deviceInfo));
 }
 
 /*-------------------------------------------------------------
@@ -45,6 +64,7 @@ CYdLidar::~CYdLidar()
 
 void CYdLidar::disconnecting()
 {
+    m_recorder.close();
     if (lidarPtr) {
         lidarPtr->disconnect();
         delete lidarPtr;
@@ -58,6 +78,10 @@ void CYdLidar::disconnecting()
 bool  CYdLidar::doProcessSimple(LaserScan &outscan, bool &hardwareError){
 	hardwareError			= false;
 
+    if (m_replay.isOpen()) {
+        return replayScan(outscan);
+    }
+
 	// Bound?
     if (!checkHardware())
 	{
@@ -65,155 +89,292 @@ bool  CYdLidar::doProcessSimple(LaserScan &outscan, bool &hardwareError){
         return false;
 	}
 
+    if (lidarPtr->isStandby()) {
+        return false;
+    }
+
     node_info nodes[3600];
     size_t   count = _countof(nodes);
 
-    size_t all_nodes_counts = node_counts;
-
     //  wait Scan data:
-    uint64_t tim_scan_start = getTime();
+    uint64_t trace_start = Tracer::now();
     result_t op_result =  lidarPtr->grabScanData(nodes, count);
-    uint64_t tim_scan_end = getTime();
+    Tracer::instance().complete(TRACE_LIDAR, "grabScanData", trace_start, count);
 
 	// Fill in scan data:
     if (IS_OK(op_result))
 	{
+        YDLIDAR_TRACE_SCOPE(TRACE_LIDAR, "process");
         op_result = lidarPtr->ascendScanData(nodes, count);
-		//同步后的时间
-        tim_scan_start = nodes[0].stamp;
-        tim_scan_end   = nodes[0].stamp;
-
         if (IS_OK(op_result))
 		{
-            if(!m_FixedResolution){
-                all_nodes_counts = count;
-            } else {
-                all_nodes_counts = node_counts;
+            if (m_recorder.isOpen()) {
+                m_recorder.write(nodes, count, node_counts, m_isMultipleRate, m_SampleRate);
             }
-            each_angle = 360.0/all_nodes_counts;
-
-            node_info *angle_compensate_nodes = new node_info[all_nodes_counts];
-            memset(angle_compensate_nodes, 0, all_nodes_counts*sizeof(node_info));
-            unsigned int i = 0;
-            for( ; i < count; i++) {
-                if (nodes[i].distance_q2 != 0) {
-                    float angle = (float)((nodes[i].angle_q6_checkbit >> LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT)/64.0f);
-                    if(m_Reversion){
-                       angle=angle+180;
-                       if(angle>=360){ angle=angle-360;}
-                        nodes[i].angle_q6_checkbit = ((uint16_t)(angle * 64.0f)) << LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT;
-                    }
-                    int inter =(int)( angle / each_angle );
-                    float angle_pre = angle - inter * each_angle;
-                    float angle_next = (inter+1) * each_angle - angle;
-                    if (angle_pre < angle_next) {
-                        if(inter < all_nodes_counts)
-                            angle_compensate_nodes[inter]=nodes[i];
-                    } else {
-                        if (inter < all_nodes_counts -1)
-                            angle_compensate_nodes[inter+1]=nodes[i];
-                    }
-                }
+            return processScan(nodes, count, outscan);
+		}
 
-                if(tim_scan_start > nodes[i].stamp) {
-                    tim_scan_start = nodes[i].stamp;
-                }
-                if(tim_scan_end < nodes[i].stamp) {
-                    tim_scan_end = nodes[i].stamp;
-                }
+    } else {
+        if (op_result==RESULT_FAIL) {
+			// Error? Retry connection
+			//this->disconnect();
+		}
+	}
+
+	return false;
+
+}
 
-             }
 
-            LaserScan scan_msg;
+/*-------------------------------------------------------------
+						replayScan
+-------------------------------------------------------------*/
+bool CYdLidar::replayScan(LaserScan &outscan)
+{
+    node_info nodes[3600];
+    size_t count = _countof(nodes);
+    ScanLogRevolution rev;
+    if (!m_replay.next(rev, nodes, count)) {
+        return false;
+    }
+    if (m_ReplaySpeed > 0) {
+        uint64_t now = getTime();
+        if (!m_replayClock || rev.stamp < m_replayStart) {
+            m_replayClock = now;
+            m_replayStart = rev.stamp;
+        }
+        uint64_t due = m_replayClock + (uint64_t)((rev.stamp - m_replayStart) / m_ReplaySpeed);
+        if (due > now) {
+            delay((due - now) / 1000000);
+        }
+    }
+    node_counts = rev.node_counts;
+    m_isMultipleRate = (rev.flags & SCAN_LOG_MULTIPLE_RATE) != 0;
+    return processScan(nodes, count, outscan);
+}
+
+bool CYdLidar::seekReplay(uint64_t stamp)
+{
+    m_replayClock = 0;
+    return m_replay.seek(stamp);
+}
 
-            if (m_MaxAngle< m_MinAngle) {
-                float temp = m_MinAngle;
-                m_MinAngle = m_MaxAngle;
-                m_MaxAngle = temp;
+bool CYdLidar::replayFinished() const
+{
+    return m_replay.isOpen() && m_replay.eof();
+}
+
+/*-------------------------------------------------------------
+						processScan
+-------------------------------------------------------------*/
+bool CYdLidar::processScan(node_info *nodes, size_t count, LaserScan &outscan)
+{
+    size_t all_nodes_counts = node_counts;
+	//同步后的时间
+    uint64_t tim_scan_start = nodes[0].stamp;
+    uint64_t tim_scan_end   = nodes[0].stamp;
+
+    if(!m_FixedResolution){
+        all_nodes_counts = count;
+    } else {
+        all_nodes_counts = node_counts;
+    }
+    each_angle = 360.0/all_nodes_counts;
+
+    node_info *angle_compensate_nodes = new node_info[all_nodes_counts];
+    memset(angle_compensate_nodes, 0, all_nodes_counts*sizeof(node_info));
+    unsigned int i = 0;
+    for( ; i < count; i++) {
+        if (nodes[i].distance_q2 != 0) {
+            float angle = (float)((nodes[i].angle_q6_checkbit >> LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT)/64.0f);
+            if(m_Reversion){
+               angle=angle+180;
+               if(angle>=360){ angle=angle-360;}
+                nodes[i].angle_q6_checkbit = ((uint16_t)(angle * 64.0f)) << LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT;
             }
+            int inter =(int)( angle / each_angle );
+            float angle_pre = angle - inter * each_angle;
+            float angle_next = (inter+1) * each_angle - angle;
+            if (angle_pre < angle_next) {
+                if(inter < all_nodes_counts)
+                    angle_compensate_nodes[inter]=nodes[i];
+            } else {
+                if (inter < all_nodes_counts -1)
+                    angle_compensate_nodes[inter+1]=nodes[i];
+            }
+        }
 
+        if(tim_scan_start > nodes[i].stamp) {
+            tim_scan_start = nodes[i].stamp;
+        }
+        if(tim_scan_end < nodes[i].stamp) {
+            tim_scan_end = nodes[i].stamp;
+        }
 
-            double scan_time = tim_scan_end - tim_scan_start;
-            int counts = all_nodes_counts*((m_MaxAngle-m_MinAngle)/360.0f);
-            int angle_start = 180+m_MinAngle;
-            int node_start = all_nodes_counts*(angle_start/360.0f);
+     }
 
-            scan_msg.ranges.resize(counts);
-            scan_msg.intensities.resize(counts);
-            float range = 0.0;
-            float intensity = 0.0;
-            int index = 0;
+    LaserScan scan_msg;
 
+    if (m_MaxAngle< m_MinAngle) {
+        float temp = m_MinAngle;
+        m_MinAngle = m_MaxAngle;
+        m_MaxAngle = temp;
+    }
 
-            for (size_t i = 0; i < all_nodes_counts; i++) {
-                if(m_isMultipleRate) {
-                    range = (float)angle_compensate_nodes[i].distance_q2/2000.f;
-                }else {
-                    range = (float)angle_compensate_nodes[i].distance_q2/4000.f;
-                }
-                intensity = (float)(angle_compensate_nodes[i].sync_quality >> LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT);
 
-                if (i<all_nodes_counts/2) {
-                    index = all_nodes_counts/2-1-i;
-                } else {
-                    index =all_nodes_counts-1-(i-all_nodes_counts/2);
-                }
+    double scan_time = tim_scan_end - tim_scan_start;
+    int counts = all_nodes_counts*((m_MaxAngle-m_MinAngle)/360.0f);
+    int angle_start = 180+m_MinAngle;
+    int node_start = all_nodes_counts*(angle_start/360.0f);
 
-                if (m_IgnoreArray.size() != 0) {
-                    float angle = (float)((angle_compensate_nodes[i].angle_q6_checkbit >> LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT)/64.0f);
-                    if (angle>180) {
-                        angle=360-angle;
-                    } else {
-                        angle=-angle;
-                    }
+    scan_msg.ranges.resize(counts);
+    scan_msg.intensities.resize(counts);
+    float range = 0.0;
+    float intensity = 0.0;
+    int index = 0;
 
-                    for (uint16_t j = 0; j < m_IgnoreArray.size();j = j+2) {
-                        if ((m_IgnoreArray[j] < angle) && (angle <= m_IgnoreArray[j+1])) {
-                           range = 0.0;
-                           break;
-                        }
-                    }
-                }
 
-                if (range > m_MaxRange|| range < m_MinRange) {
-                    range = 0.0;
-                }
+    for (size_t i = 0; i < all_nodes_counts; i++) {
+        if(m_isMultipleRate) {
+            range = (float)angle_compensate_nodes[i].distance_q2/2000.f;
+        }else {
+            range = (float)angle_compensate_nodes[i].distance_q2/4000.f;
+        }
+        intensity = (float)(angle_compensate_nodes[i].sync_quality >> LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT);
+
+        if (i<all_nodes_counts/2) {
+            index = all_nodes_counts/2-1-i;
+        } else {
+            index =all_nodes_counts-1-(i-all_nodes_counts/2);
+        }
 
-                int pos = index - node_start ;
-                if (0<= pos && pos < counts) {
-                    scan_msg.ranges[pos] =  range;
-                    scan_msg.intensities[pos] = intensity;
+        if (m_IgnoreArray.size() != 0) {
+            float angle = (float)((angle_compensate_nodes[i].angle_q6_checkbit >> LIDAR_RESP_MEASUREMENT_ANGLE_SHIFT)/64.0f);
+            if (angle>180) {
+                angle=360-angle;
+            } else {
+                angle=-angle;
+            }
+
+            for (uint16_t j = 0; j < m_IgnoreArray.size();j = j+2) {
+                if ((m_IgnoreArray[j] < angle) && (angle <= m_IgnoreArray[j+1])) {
+                   range = 0.0;
+                   break;
                 }
             }
+        }
 
-            scan_msg.system_time_stamp = tim_scan_start;
-            scan_msg.self_time_stamp = tim_scan_start;
-            scan_msg.config.min_angle = DEG2RAD(m_MinAngle);
-            scan_msg.config.max_angle = DEG2RAD(m_MaxAngle);
-            scan_msg.config.ang_increment = (scan_msg.config.max_angle - scan_msg.config.min_angle) / (double)counts;
-            scan_msg.config.time_increment = scan_time / (double)counts;
-            scan_msg.config.scan_time = scan_time;
-            scan_msg.config.min_range = m_MinRange;
-            scan_msg.config.max_range = m_MaxRange;
-            outscan = scan_msg;
-            delete[] angle_compensate_nodes;
-            return true;
+        if (range > m_MaxRange|| range < m_MinRange) {
+            range = 0.0;
+        }
 
+        int pos = index - node_start ;
+        if (0<= pos && pos < counts) {
+            scan_msg.ranges[pos] =  range;
+            scan_msg.intensities[pos] = intensity;
+        }
+    }
 
-		}
+    scan_msg.system_time_stamp = tim_scan_start;
+    scan_msg.self_time_stamp = tim_scan_start;
+    scan_msg.config.min_angle = DEG2RAD(m_MinAngle);
+    scan_msg.config.max_angle = DEG2RAD(m_MaxAngle);
+    scan_msg.config.ang_increment = (scan_msg.config.max_angle - scan_msg.config.min_angle) / (double)counts;
+    scan_msg.config.time_increment = scan_time / (double)counts;
+    scan_msg.config.scan_time = scan_time;
+    scan_msg.config.min_range = m_MinRange;
+    scan_msg.config.max_range = m_MaxRange;
+    if (m_CartesianOutput) {
+        toCartesian(scan_msg);
+    }
+    if (m_broker.isOpen()) {
+        m_broker.publish(scan_msg);
+    }
+    outscan = scan_msg;
+    delete[] angle_compensate_nodes;
+    return true;
+}
 
-    } else {
-        if (op_result==RESULT_FAIL) {
-			// Error? Retry connection
-			//this->disconnect();
-		}
-	}
+/*-------------------------------------------------------------
+                        updateTrigTable
+-------------------------------------------------------------*/
+void CYdLidar::updateTrigTable(size_t counts, float min_angle, float ang_increment)
+{
+    if (m_cosTable.size() == counts &&
+            m_tableMinAngle == min_angle &&
+            m_tableIncrement == ang_increment) {
+        return;
+    }
+    m_cosTable.resize(counts);
+    m_sinTable.resize(counts);
+    for (size_t i = 0; i < counts; i++) {
+        double angle = min_angle + i*(double)ang_increment;
+        m_cosTable[i] = (float)cos(angle);
+        m_sinTable[i] = (float)sin(angle);
+    }
+    m_tableMinAngle = min_angle;
+    m_tableIncrement = ang_increment;
+}
 
-	return false;
+/*-------------------------------------------------------------
+                        toCartesian
+-------------------------------------------------------------*/
+void CYdLidar::toCartesian(LaserScan &scan)
+{
+    const size_t counts = scan.ranges.size();
+    updateTrigTable(counts, scan.config.min_angle, scan.config.ang_increment);
+    scan.x.resize(counts);
+    scan.y.resize(counts);
+    scan.point_time.resize(counts);
+
+    const float *r = scan.ranges.data();
+    const float *c = m_cosTable.data();
+    const float *s = m_sinTable.data();
+    float *x = scan.x.data();
+    float *y = scan.y.data();
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    size_t i = 0;
+
+    //invalid ranges are reported as 0, those points become NaN
+#if defined(__SSE2__)
+    const __m128 zero4 = _mm_setzero_ps();
+    const __m128 nan4 = _mm_set1_ps(nan);
+    for (; i + 4 <= counts; i += 4) {
+        __m128 r4 = _mm_loadu_ps(r + i);
+        __m128 valid = _mm_cmpgt_ps(r4, zero4);
+        __m128 x4 = _mm_mul_ps(r4, _mm_loadu_ps(c + i));
+        __m128 y4 = _mm_mul_ps(r4, _mm_loadu_ps(s + i));
+        _mm_storeu_ps(x + i, _mm_or_ps(_mm_and_ps(valid, x4), _mm_andnot_ps(valid, nan4)));
+        _mm_storeu_ps(y + i, _mm_or_ps(_mm_and_ps(valid, y4), _mm_andnot_ps(valid, nan4)));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const float32x4_t zero4 = vdupq_n_f32(0.f);
+    const float32x4_t nan4 = vdupq_n_f32(nan);
+    for (; i + 4 <= counts; i += 4) {
+        float32x4_t r4 = vld1q_f32(r + i);
+        uint32x4_t valid = vcgtq_f32(r4, zero4);
+        vst1q_f32(x + i, vbslq_f32(valid, vmulq_f32(r4, vld1q_f32(c + i)), nan4));
+        vst1q_f32(y + i, vbslq_f32(valid, vmulq_f32(r4, vld1q_f32(s + i)), nan4));
+    }
+#endif
+    for (; i < counts; i++) {
+        if (r[i] > 0.f) {
+            x[i] = r[i]*c[i];
+            y[i] = r[i]*s[i];
+        } else {
+            x[i] = nan;
+            y[i] = nan;
+        }
+    }
 
+    //time_increment is in nanoseconds here, point_time is in seconds
+    const float dt = scan.config.time_increment/1e9f;
+    float *t = scan.point_time.data();
+    for (i = 0; i < counts; i++) {
+        t[i] = i*dt;
+    }
 }
 
-
 /*-------------------------------------------------------------
 						turnOn
 -------------------------------------------------------------*/
@@ -234,6 +395,7 @@ bool  CYdLidar::turnOn()
 bool  CYdLidar::turnOff()
 {
     if (lidarPtr) {
+        lidarPtr->setStandby(false);
         lidarPtr->stop();
         lidarPtr->stopMotor();
         isScanning = false;
@@ -241,6 +403,91 @@ bool  CYdLidar::turnOff()
 	return true;
 }
 
+/*-------------------------------------------------------------
+						standby
+-------------------------------------------------------------*/
+bool CYdLidar::standby()
+{
+    if (!lidarPtr || !isScanning) {
+        return false;
+    }
+    lidarPtr->setStandby(true);
+    return true;
+}
+
+/*-------------------------------------------------------------
+						resume
+-------------------------------------------------------------*/
+bool CYdLidar::resume()
+{
+    if (!lidarPtr) {
+        return false;
+    }
+    lidarPtr->setStandby(false);
+    return isScanning;
+}
+
+bool CYdLidar::isStandby() const
+{
+    return lidarPtr && lidarPtr->isStandby();
+}
+
+/*-------------------------------------------------------------
+						reconfigureScan
+-------------------------------------------------------------*/
+bool CYdLidar::reconfigureScan(int frequency, int sample_rate)
+{
+    bool freq_changed = frequency != m_ScanFrequency;
+    bool rate_changed = sample_rate != m_requestSampleRate;
+    if (!freq_changed && !rate_changed) {
+        return true;
+    }
+    m_ScanFrequency = frequency;
+    m_SampleRate = sample_rate;
+    m_requestSampleRate = sample_rate;
+    if (!lidarPtr || !isScanning) {
+        //applied by the next checkStatus
+        return true;
+    }
+
+    // the motor keeps spinning, only the commands for what changed are sent
+    lidarPtr->stopScan();
+    isScanning = false;
+    if (rate_changed) {
+        m_SampleRate = checkSamplingRate(m_deviceInfo.model, true);
+    }
+    bool sets_frequency = m_deviceInfo.model == YDlidarDriver::YDLIDAR_G4 ||
+                          m_deviceInfo.model == YDlidarDriver::YDLIDAR_F4PRO ||
+                          m_deviceInfo.model == YDlidarDriver::YDLIDAR_G4C ||
+                          m_deviceInfo.model == YDlidarDriver::YDLIDAR_G10 ||
+                          m_deviceInfo.model == YDlidarDriver::YDLIDAR_G25;
+    if (sets_frequency && freq_changed) {
+        checkScanFrequency();
+    } else if (sets_frequency && 5 <= m_ScanFrequency && m_ScanFrequency <= 12) {
+        // the frequency is unchanged, node counts follow from the new rate
+        node_counts = m_SampleRate*1000/(m_ScanFrequency - m_FrequencyOffset);
+        each_angle = 360.0/node_counts;
+    }
+
+    result_t ans = lidarPtr->restartScan();
+    if (!IS_OK(ans)) {
+        // models that do not resume without a motor restart
+        ans = lidarPtr->startScan();
+    }
+    if (!IS_OK(ans)) {
+        ans = lidarPtr->startScan();
+    }
+    if (!IS_OK(ans)) {
+        ydlidar::console.error("[CYdLidar] Error restarting scanning mode: %x", ans);
+        return false;
+    }
+    isScanning = true;
+    if (!m_cache.path().empty()) {
+        storeCachedConfig();
+    }
+    return true;
+}
+
 /** Returns true if the device is connected & operative */
 bool CYdLidar::getDeviceHealth() const {
     if (!lidarPtr) return false;
@@ -279,10 +526,8 @@ bool CYdLidar::getDeviceInfo(int &type) {
         ydlidar::console.error("get DeviceInfo Error" );
 		return false;
 	}	 
+    m_deviceInfo = devinfo;
 	std::string model;
-    sampling_rate _rate;
-    int _samp_rate=4;
-    int bad = 0;
 
     m_isMultipleRate = false;
     type = devinfo.model;
@@ -300,57 +545,7 @@ bool CYdLidar::getDeviceInfo(int &type) {
             model="S4";
             break;
         case YDlidarDriver::YDLIDAR_G4:
-        {
             model="G4";
-            ans = lidarPtr->getSamplingRate(_rate);
-            if (IS_OK(ans)) {
-                switch (m_SampleRate) {
-                case 4:
-                    _samp_rate=YDlidarDriver::YDLIDAR_RATE_4K;
-                    break;
-                case 8:
-                    _samp_rate=YDlidarDriver::YDLIDAR_RATE_8K;
-                    break;
-                case 9:
-                    _samp_rate=YDlidarDriver::YDLIDAR_RATE_9K;
-                    break;
-                default:
-                    _samp_rate = _rate.rate;
-                    break;
-                }
-
-                while (_samp_rate != _rate.rate) {
-                    ans = lidarPtr->setSamplingRate(_rate);
-                    if (!IS_OK(ans)) {
-                        bad++;
-                        if(bad>5){
-                            break;
-                        }
-                    }
-                }
-
-                switch (_rate.rate) {
-                    case YDlidarDriver::YDLIDAR_RATE_4K:
-                        _samp_rate = 4;
-                        break;
-                    case YDlidarDriver::YDLIDAR_RATE_8K:
-                        node_counts = 1440;
-                        each_angle = 0.25;
-                        _samp_rate=8;
-                        break;
-                    case YDlidarDriver::YDLIDAR_RATE_9K:
-                        node_counts = 1440;
-                        each_angle = 0.25;
-                        _samp_rate=9;
-                        break;
-                    default:
-                        break;
-                }
-
-
-            }
-
-	    }
             break;
         case YDlidarDriver::YDLIDAR_X4:
             model="X4";
@@ -359,52 +554,13 @@ bool CYdLidar::getDeviceInfo(int &type) {
             model="G4Pro";
             break;
         case YDlidarDriver::YDLIDAR_F4PRO:
-        {
             model="F4Pro";
-            ans = lidarPtr->getSamplingRate(_rate);
-            if (IS_OK(ans)) {
-                switch (m_SampleRate) {
-                case 4:
-                    _samp_rate=0;
-                    break;
-                case 6:
-                    _samp_rate=1;
-                    break;
-                default:
-                    _samp_rate = _rate.rate;
-                    break;
-                }
-                while (_samp_rate != _rate.rate) {
-                    ans = lidarPtr->setSamplingRate(_rate);
-                    if (!IS_OK(ans)) {
-                        bad++;
-                        if(bad>5){
-                            break;
-                        }
-                    }
-                }
-
-                switch (_rate.rate) {
-                    case 0:
-                        _samp_rate = 4;
-                        break;
-                    case 1:
-                        node_counts = 1440;
-                        each_angle = 0.25;
-                        _samp_rate=6;
-                        break;
-                }
-
-            }
-
-        }
             break;
         case  YDlidarDriver::YDLIDAR_G4C:
             model = "G4C";
             break;
         case  YDlidarDriver::YDLIDAR_G10:
             model = "G10";
-             _samp_rate=10;
             break;
         case  YDlidarDriver::YDLIDAR_S4B:
             model = "S4B";
@@ -414,64 +570,14 @@ bool CYdLidar::getDeviceInfo(int &type) {
             break;
         case  YDlidarDriver::YDLIDAR_G25:
             model="G25";
-            ans = lidarPtr->getSamplingRate(_rate);
-            if (IS_OK(ans)) {
-                switch (m_SampleRate) {
-                case 8:
-                    _samp_rate=YDlidarDriver::YDLIDAR_RATE_4K;
-                    break;
-                case 16:
-                    _samp_rate=YDlidarDriver::YDLIDAR_RATE_8K;
-                    break;
-                case 18:
-                    _samp_rate=YDlidarDriver::YDLIDAR_RATE_9K;
-                    break;
-                default:
-                    _samp_rate = _rate.rate;
-                    break;
-                }
-
-                while (_samp_rate != _rate.rate) {
-                    ans = lidarPtr->setSamplingRate(_rate);
-                    if (!IS_OK(ans)) {
-                        bad++;
-                        if(bad>5){
-                            break;
-                        }
-                    }
-                }
-
-                switch (_rate.rate) {
-                    case YDlidarDriver::YDLIDAR_RATE_4K:
-                        _samp_rate = 8;
-                        node_counts = 1440;
-                        each_angle = 0.25;
-                        break;
-                    case YDlidarDriver::YDLIDAR_RATE_8K:
-                        node_counts = 2400;
-                        each_angle = 0.15;
-                        _samp_rate=16;
-                        break;
-                    case YDlidarDriver::YDLIDAR_RATE_9K:
-                        node_counts = 2600;
-                        each_angle = 0.1;
-                        _samp_rate=18;
-                        break;
-                    default:
-                        break;
-                }
-
-
-            }
             m_isMultipleRate = true;
-
             break;
         default:
             model = "Unknown";
             break;
     }
 
-    m_SampleRate = _samp_rate;
+    m_SampleRate = checkSamplingRate(devinfo.model, false);
     lidarPtr->setMultipleRate(m_isMultipleRate);
 
 
@@ -495,7 +601,7 @@ bool CYdLidar::getDeviceInfo(int &type) {
             ydlidar::console.show("%01X",devinfo.serialnum[i]&0xff);
         ydlidar::console.show("\n");
 
-        ydlidar::console.message("[YDLIDAR INFO] Current Sampling Rate : %dK" , _samp_rate);
+        ydlidar::console.message("[YDLIDAR INFO] Current Sampling Rate : %dK" , m_SampleRate);
 
 
         if (devinfo.model == YDlidarDriver::YDLIDAR_G4 ||
@@ -512,6 +618,129 @@ bool CYdLidar::getDeviceInfo(int &type) {
 
 }
 
+/*-------------------------------------------------------------
+                        checkSamplingRate
+-------------------------------------------------------------*/
+int CYdLidar::checkSamplingRate(int model, bool rate_known)
+{
+    sampling_rate _rate;
+    int _samp_rate = model == YDlidarDriver::YDLIDAR_G10 ? 10 : 4;
+    if (model != YDlidarDriver::YDLIDAR_G4 &&
+            model != YDlidarDriver::YDLIDAR_F4PRO &&
+            model != YDlidarDriver::YDLIDAR_G25) {
+        return _samp_rate;
+    }
+    // a reconfiguration knows the rate code the device was left at, the probe reads it
+    if (rate_known && lidarPtr->getCachedSamplingRate() >= 0) {
+        _rate.rate = lidarPtr->getCachedSamplingRate();
+    } else if (!IS_OK(lidarPtr->getSamplingRate(_rate))) {
+        return _samp_rate;
+    }
+
+    switch (model) {
+        case YDlidarDriver::YDLIDAR_G4:
+            switch (m_SampleRate) {
+            case 4:
+                _samp_rate=YDlidarDriver::YDLIDAR_RATE_4K;
+                break;
+            case 8:
+                _samp_rate=YDlidarDriver::YDLIDAR_RATE_8K;
+                break;
+            case 9:
+                _samp_rate=YDlidarDriver::YDLIDAR_RATE_9K;
+                break;
+            default:
+                _samp_rate = _rate.rate;
+                break;
+            }
+
+            switchSamplingRate(_rate, _samp_rate, 3);
+
+            switch (_rate.rate) {
+                case YDlidarDriver::YDLIDAR_RATE_4K:
+                    _samp_rate = 4;
+                    break;
+                case YDlidarDriver::YDLIDAR_RATE_8K:
+                    node_counts = 1440;
+                    each_angle = 0.25;
+                    _samp_rate=8;
+                    break;
+                case YDlidarDriver::YDLIDAR_RATE_9K:
+                    node_counts = 1440;
+                    each_angle = 0.25;
+                    _samp_rate=9;
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case YDlidarDriver::YDLIDAR_F4PRO:
+            switch (m_SampleRate) {
+            case 4:
+                _samp_rate=0;
+                break;
+            case 6:
+                _samp_rate=1;
+                break;
+            default:
+                _samp_rate = _rate.rate;
+                break;
+            }
+            switchSamplingRate(_rate, _samp_rate, 2);
+
+            switch (_rate.rate) {
+                case 0:
+                    _samp_rate = 4;
+                    break;
+                case 1:
+                    node_counts = 1440;
+                    each_angle = 0.25;
+                    _samp_rate=6;
+                    break;
+            }
+            break;
+        case YDlidarDriver::YDLIDAR_G25:
+            switch (m_SampleRate) {
+            case 8:
+                _samp_rate=YDlidarDriver::YDLIDAR_RATE_4K;
+                break;
+            case 16:
+                _samp_rate=YDlidarDriver::YDLIDAR_RATE_8K;
+                break;
+            case 18:
+                _samp_rate=YDlidarDriver::YDLIDAR_RATE_9K;
+                break;
+            default:
+                _samp_rate = _rate.rate;
+                break;
+            }
+
+            switchSamplingRate(_rate, _samp_rate, 3);
+
+            switch (_rate.rate) {
+                case YDlidarDriver::YDLIDAR_RATE_4K:
+                    _samp_rate = 8;
+                    node_counts = 1440;
+                    each_angle = 0.25;
+                    break;
+                case YDlidarDriver::YDLIDAR_RATE_8K:
+                    node_counts = 2400;
+                    each_angle = 0.15;
+                    _samp_rate=16;
+                    break;
+                case YDlidarDriver::YDLIDAR_RATE_9K:
+                    node_counts = 2600;
+                    each_angle = 0.1;
+                    _samp_rate=18;
+                    break;
+                default:
+                    break;
+            }
+            break;
+    }
+    return _samp_rate;
+}
+
 /*-------------------------------------------------------------
                         checkScanFrequency
 -------------------------------------------------------------*/
@@ -525,16 +754,35 @@ bool CYdLidar::checkScanFrequency()
         if (IS_OK(ans)) {
             freq = _scan_frequency.frequency/100.f;
             hz = m_ScanFrequency - freq;
-            if (hz>0) {
-                while (hz != 0) {
-                    lidarPtr->setScanFrequencyAdd(_scan_frequency);
-                    hz--;
+            if (hz != 0) {
+                // all 1Hz steps go out as one pipelined exchange
+                uint8_t cmd = hz > 0 ? LIDAR_CMD_SET_AIMSPEED_ADD : LIDAR_CMD_SET_AIMSPEED_DIS;
+                int steps = abs(hz);
+                std::vector<scan_frequency> answers(steps);
+                std::vector<result_t> results(steps, RESULT_FAIL);
+                for (int i = 0; i < steps; i++) {
+                    lidarPtr->queueCommand(cmd, &answers[i], sizeof(scan_frequency), &results[i]);
                 }
-                freq = _scan_frequency.frequency/100.0f;
-            } else {
-                while (hz != 0) {
-                    lidarPtr->setScanFrequencyDis(_scan_frequency);
-                    hz++;
+                bool all_ok = IS_OK(lidarPtr->flushCommands());
+                for (int i = 0; i < steps; i++) {
+                    if (IS_OK(results[i])) {
+                        _scan_frequency = answers[i];
+                    }
+                }
+
+                // bounded fallback: re-read the frequency and step one command at a time
+                if (!all_ok && IS_OK(lidarPtr->getScanFrequency(_scan_frequency))) {
+                    for (int i = 0; i < steps; i++) {
+                        hz = m_ScanFrequency - _scan_frequency.frequency/100.f;
+                        if (hz == 0) {
+                            break;
+                        }
+                        if (hz > 0) {
+                            lidarPtr->setScanFrequencyAdd(_scan_frequency);
+                        } else {
+                            lidarPtr->setScanFrequencyDis(_scan_frequency);
+                        }
+                    }
                 }
                 freq = _scan_frequency.frequency/100.0f;
             }
@@ -550,6 +798,42 @@ bool CYdLidar::checkScanFrequency()
 
 }
 
+/*-------------------------------------------------------------
+                        switchSamplingRate
+-------------------------------------------------------------*/
+bool CYdLidar::switchSamplingRate(sampling_rate &rate, int target, int rate_count)
+{
+    if (target < 0 || target >= rate_count) {
+        return rate.rate == target;
+    }
+    // each LIDAR_CMD_SET_SAMPLING_RATE advances the device to its next rate code,
+    // so the whole walk to the target goes out as one pipelined exchange
+    int steps = (target - rate.rate + rate_count) % rate_count;
+    if (steps > 0) {
+        std::vector<sampling_rate> answers(steps);
+        std::vector<result_t> results(steps, RESULT_FAIL);
+        for (int i = 0; i < steps; i++) {
+            lidarPtr->queueCommand(LIDAR_CMD_SET_SAMPLING_RATE, &answers[i], sizeof(sampling_rate), &results[i]);
+        }
+        bool all_ok = IS_OK(lidarPtr->flushCommands());
+        for (int i = 0; i < steps; i++) {
+            if (IS_OK(results[i])) {
+                rate = answers[i];
+            }
+        }
+        if (!all_ok) {
+            // a lost answer does not tell whether the device stepped
+            lidarPtr->getSamplingRate(rate);
+        }
+    }
+
+    // bounded fallback, one synchronous step at a time
+    for (int i = 0; i < rate_count && rate.rate != target; i++) {
+        lidarPtr->setSamplingRate(rate);
+    }
+    return rate.rate == target;
+}
+
 /*-------------------------------------------------------------
 						checkCOMMs
 -------------------------------------------------------------*/
@@ -604,8 +888,9 @@ bool CYdLidar::checkStatus()
     checkmodel.insert(std::map<int, bool>::value_type(230400, false));
     checkmodel.insert(std::map<int, bool>::value_type(512000, false));
 
-    bool ret = false;
     int m_type = -1;
+    bool warm_start = !m_cache.path().empty() && checkCachedConfig(m_type);
+    bool ret = warm_start;
 
     while (!ret) {
         ret = getDeviceHealth();
@@ -668,9 +953,16 @@ bool CYdLidar::checkStatus()
         if (!IS_OK(s_result)) {
             ydlidar::console.error("[CYdLidar] Error starting scanning mode: %x", s_result);
             isScanning = false;
+            if (!m_cache.path().empty()) {
+                m_cache.erase(m_deviceInfo.serialnum);
+                m_cache.save();
+            }
             return false;
         }
     }
+    if (!warm_start && !m_cache.path().empty()) {
+        storeCachedConfig();
+    }
     lidarPtr->setAutoReconnect(m_AutoReconnect);
     ydlidar::console.message("[YDLIDAR INFO] Now YDLIDAR is scanning ......\n");
     isScanning = true;
@@ -678,6 +970,116 @@ bool CYdLidar::checkStatus()
 
 }
 
+/*-------------------------------------------------------------
+                        checkCachedConfig
+-------------------------------------------------------------*/
+bool CYdLidar::checkCachedConfig(int &type)
+{
+    const DeviceCacheEntry *entry = m_cache.findByPort(m_SerialPort);
+    if (!entry) {
+        return false;
+    }
+
+    device_info devinfo;
+    result_t ans = lidarPtr->getDeviceInfo(devinfo);
+    if (!IS_OK(ans)) {
+        ydlidar::console.warning("[YDLIDAR] No answer with the cached configuration of %s, probing the device",
+                                 m_SerialPort.c_str());
+        m_cache.eraseByPort(m_SerialPort);
+        m_cache.save();
+        return false;
+    }
+    m_deviceInfo = devinfo;
+
+    entry = m_cache.find(devinfo.serialnum);
+    if (!entry || entry->model != devinfo.model ||
+            entry->firmware_version != devinfo.firmware_version ||
+            entry->baudrate != m_SerialBaudrate ||
+            entry->request_sample_rate != m_requestSampleRate ||
+            entry->scan_frequency != m_ScanFrequency) {
+        if (entry) {
+            m_cache.erase(devinfo.serialnum);
+            m_cache.save();
+        }
+        return false;
+    }
+
+    // a bad device takes the full path, which reports and retries
+    if (!getDeviceHealth()) {
+        return false;
+    }
+
+    // read back what the full configuration would have set, in one pipelined
+    // exchange: the scan frequency where checkScanFrequency applies it, and the
+    // sampling rate of models with switchable rates, which the cached
+    // node_counts and each_angle depend on
+    bool sets_frequency = (devinfo.model == YDlidarDriver::YDLIDAR_G4 ||
+                           devinfo.model == YDlidarDriver::YDLIDAR_F4PRO ||
+                           devinfo.model == YDlidarDriver::YDLIDAR_G4C ||
+                           devinfo.model == YDlidarDriver::YDLIDAR_G10 ||
+                           devinfo.model == YDlidarDriver::YDLIDAR_G25) &&
+                          5 <= m_ScanFrequency && m_ScanFrequency <= 12;
+    bool sets_rate = entry->sampling_rate_code >= 0;
+    scan_frequency _scan_frequency;
+    sampling_rate _rate;
+    result_t frequency_ans = RESULT_FAIL, rate_ans = RESULT_FAIL;
+    if (sets_frequency) {
+        lidarPtr->queueCommand(LIDAR_CMD_GET_AIMSPEED, &_scan_frequency, sizeof(_scan_frequency), &frequency_ans);
+    }
+    if (sets_rate) {
+        lidarPtr->queueCommand(LIDAR_CMD_GET_SAMPLING_RATE, &_rate, sizeof(_rate), &rate_ans);
+    }
+    lidarPtr->flushCommands();
+    bool verified = (!sets_frequency || (IS_OK(frequency_ans) &&
+                                         (int)(m_ScanFrequency - _scan_frequency.frequency/100.f) == 0)) &&
+                    (!sets_rate || (IS_OK(rate_ans) && _rate.rate == entry->sampling_rate_code));
+    if (!verified) {
+        ydlidar::console.warning("[YDLIDAR] %s does not run the cached configuration, configuring it",
+                                 m_SerialPort.c_str());
+        m_cache.erase(devinfo.serialnum);
+        m_cache.save();
+        return false;
+    }
+
+    node_counts = entry->node_counts;
+    each_angle = entry->each_angle;
+    m_SampleRate = entry->sample_rate;
+    m_isMultipleRate = entry->multiple_rate;
+    lidarPtr->setMultipleRate(m_isMultipleRate);
+    lidarPtr->setCachedSamplingRate(entry->sampling_rate_code);
+    type = devinfo.model;
+
+    ydlidar::console.message("[YDLIDAR INFO] Using cached configuration of %s: Sampling Rate %dK, Scan Frequency %dHz",
+                             m_SerialPort.c_str(), m_SampleRate, m_ScanFrequency);
+    return true;
+}
+
+/*-------------------------------------------------------------
+                        storeCachedConfig
+-------------------------------------------------------------*/
+void CYdLidar::storeCachedConfig()
+{
+    DeviceCacheEntry entry;
+    memcpy(entry.serialnum, m_deviceInfo.serialnum, sizeof(entry.serialnum));
+    entry.port = m_SerialPort;
+    entry.baudrate = m_SerialBaudrate;
+    entry.model = m_deviceInfo.model;
+    entry.firmware_version = m_deviceInfo.firmware_version;
+    entry.hardware_version = m_deviceInfo.hardware_version;
+    entry.sampling_rate_code = lidarPtr->getCachedSamplingRate();
+    entry.sample_rate = m_SampleRate;
+    entry.request_sample_rate = m_requestSampleRate;
+    entry.scan_frequency = m_ScanFrequency;
+    entry.node_counts = node_counts;
+    entry.each_angle = each_angle;
+    entry.multiple_rate = m_isMultipleRate;
+    entry.intensities = m_Intensities;
+    m_cache.store(entry);
+    if (!m_cache.save()) {
+        ydlidar::console.warning("[YDLIDAR] Cannot write configuration cache %s", m_cache.path().c_str());
+    }
+}
+
 /*-------------------------------------------------------------
                         checkHardware
 -------------------------------------------------------------*/
@@ -701,6 +1103,25 @@ bool CYdLidar::checkHardware()
 bool CYdLidar::initialize()
 {
 	bool ret = true;
+    m_requestSampleRate = m_SampleRate;
+    if (!m_CacheFile.empty()) {
+        m_cache.load(m_CacheFile);
+        const DeviceCacheEntry *entry = m_cache.findByPort(m_SerialPort);
+        if (entry) {
+            m_SerialBaudrate = entry->baudrate;
+        }
+    }
+    if (!m_BrokerName.empty() && !m_broker.open(m_BrokerName)) {
+        ydlidar::console.warning("[CYdLidar::initialize] Cannot create scan broker %s", m_BrokerName.c_str());
+    }
+    if (!m_ReplayFile.empty()) {
+        if (!m_replay.open(m_ReplayFile)) {
+            ydlidar::console.error("[CYdLidar::initialize] Cannot open scan log %s", m_ReplayFile.c_str());
+            return false;
+        }
+        m_replayClock = 0;
+        return true;
+    }
     if (!checkCOMMs()) {
          ydlidar::console.error("[CYdLidar::initialize] Error initializing YDLIDAR scanner.");
         return false;
@@ -708,6 +1129,9 @@ bool CYdLidar::initialize()
     if (!checkStatus()) {
          ydlidar::console.warning("[CYdLidar::initialize] Error initializing YDLIDAR scanner.because of failure in scan mode.");
     }
+    if (!m_RecordFile.empty() && !m_recorder.open(m_RecordFile, &m_deviceInfo)) {
+        ydlidar::console.warning("[CYdLidar::initialize] Cannot create scan log %s", m_RecordFile.c_str());
+    }
     if (!turnOn()) {
         ydlidar::console.warning("[CYdLidar::initialize] Error initializing YDLIDAR scanner. Because the motor falied to start.");
 		
@@ -0,0 +1,144 @@
+#include "device_cache.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace ydlidar
+{
+
+DeviceCacheEntry::DeviceCacheEntry()
+  : baudrate(0), model(-1), firmware_version(0), hardware_version(0),
+    sampling_rate_code(-1), sample_rate(0), request_sample_rate(0),
+    scan_frequency(0), node_counts(0), each_angle(0.0),
+    multiple_rate(false), intensities(false) {
+  memset(serialnum, 0, sizeof(serialnum));
+}
+
+/*-------------------------------------------------------------
+                        load
+-------------------------------------------------------------*/
+bool DeviceCache::load(const std::string &path) {
+  m_path = path;
+  m_entries.clear();
+
+  FILE *fp = fopen(path.c_str(), "r");
+  if (!fp) {
+    return false;
+  }
+
+  char line[512];
+  while (fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#') {
+      continue;
+    }
+    DeviceCacheEntry entry;
+    char serial[33];
+    char port[256];
+    unsigned int firmware, hardware;
+    int multiple_rate, intensities;
+    int n = sscanf(line, "%32s %255s %d %d %u %u %d %d %d %d %d %lf %d %d",
+                   serial, port, &entry.baudrate, &entry.model, &firmware, &hardware,
+                   &entry.sampling_rate_code, &entry.sample_rate, &entry.request_sample_rate,
+                   &entry.scan_frequency, &entry.node_counts, &entry.each_angle,
+                   &multiple_rate, &intensities);
+    if (n != 14 || strlen(serial) != 32) {
+      continue;
+    }
+    bool valid = true;
+    for (int i = 0; i < 16; i++) {
+      unsigned int byte;
+      if (sscanf(serial + 2 * i, "%2x", &byte) != 1) {
+        valid = false;
+        break;
+      }
+      entry.serialnum[i] = (uint8_t)byte;
+    }
+    if (!valid) {
+      continue;
+    }
+    entry.port = port;
+    entry.firmware_version = (uint16_t)firmware;
+    entry.hardware_version = (uint8_t)hardware;
+    entry.multiple_rate = multiple_rate != 0;
+    entry.intensities = intensities != 0;
+    m_entries.push_back(entry);
+  }
+  fclose(fp);
+  return true;
+}
+
+/*-------------------------------------------------------------
+                        save
+-------------------------------------------------------------*/
+bool DeviceCache::save() const {
+  if (m_path.empty()) {
+    return false;
+  }
+  std::string tmp = m_path + ".tmp";
+  FILE *fp = fopen(tmp.c_str(), "w");
+  if (!fp) {
+    return false;
+  }
+  fputs("# serial port baudrate model firmware hardware rate_code sample_rate "
+        "request_sample_rate frequency node_counts each_angle multiple_rate intensities\n", fp);
+  for (size_t i = 0; i < m_entries.size(); i++) {
+    const DeviceCacheEntry &e = m_entries[i];
+    for (int j = 0; j < 16; j++) {
+      fprintf(fp, "%02X", e.serialnum[j]);
+    }
+    fprintf(fp, " %s %d %d %u %u %d %d %d %d %d %.9g %d %d\n",
+            e.port.c_str(), e.baudrate, e.model, (unsigned int)e.firmware_version,
+            (unsigned int)e.hardware_version, e.sampling_rate_code, e.sample_rate,
+            e.request_sample_rate, e.scan_frequency, e.node_counts, e.each_angle,
+            e.multiple_rate ? 1 : 0, e.intensities ? 1 : 0);
+  }
+  if (fclose(fp) != 0) {
+    remove(tmp.c_str());
+    return false;
+  }
+  return rename(tmp.c_str(), m_path.c_str()) == 0;
+}
+
+const DeviceCacheEntry *DeviceCache::find(const uint8_t serialnum[16]) const {
+  for (size_t i = 0; i < m_entries.size(); i++) {
+    if (memcmp(m_entries[i].serialnum, serialnum, 16) == 0) {
+      return &m_entries[i];
+    }
+  }
+  return NULL;
+}
+
+const DeviceCacheEntry *DeviceCache::findByPort(const std::string &port) const {
+  for (size_t i = 0; i < m_entries.size(); i++) {
+    if (m_entries[i].port == port) {
+      return &m_entries[i];
+    }
+  }
+  return NULL;
+}
+
+void DeviceCache::store(const DeviceCacheEntry &entry) {
+  erase(entry.serialnum);
+  // a port holds one device at a time
+  eraseByPort(entry.port);
+  m_entries.push_back(entry);
+}
+
+void DeviceCache::erase(const uint8_t serialnum[16]) {
+  for (size_t i = 0; i < m_entries.size(); i++) {
+    if (memcmp(m_entries[i].serialnum, serialnum, 16) == 0) {
+      m_entries.erase(m_entries.begin() + i);
+      return;
+    }
+  }
+}
+
+void DeviceCache::eraseByPort(const std::string &port) {
+  for (size_t i = 0; i < m_entries.size(); i++) {
+    if (m_entries[i].port == port) {
+      m_entries.erase(m_entries.begin() + i);
+      return;
+    }
+  }
+}
+
+}
@@ -0,0 +1,258 @@
+#include "scan_broker.h"
+#include "timer.h"
+#include <string.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ydlidar
+{
+
+namespace
+{
+const uint32_t SCAN_BROKER_MAGIC   = 0x42534459; // "YDSB"
+const uint32_t SCAN_BROKER_VERSION = 1;
+
+inline size_t align64(size_t size) {
+  return (size + 63) & ~(size_t)63;
+}
+
+inline size_t slotOffset(uint64_t slot, uint64_t slot_size) {
+  return align64(sizeof(ScanBrokerHeader)) + slot * slot_size;
+}
+
+inline float *slotRanges(ScanSlotHeader *slot) {
+  return reinterpret_cast<float *>(reinterpret_cast<uint8_t *>(slot) + align64(sizeof(ScanSlotHeader)));
+}
+
+inline const float *slotRanges(const ScanSlotHeader *slot) {
+  return reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(slot) + align64(sizeof(ScanSlotHeader)));
+}
+}
+
+/*-------------------------------------------------------------
+                        ScanBroker
+-------------------------------------------------------------*/
+ScanBroker::ScanBroker() : m_header(NULL), m_size(0) {
+}
+
+ScanBroker::~ScanBroker() {
+  close();
+}
+
+bool ScanBroker::open(const std::string &name, uint32_t slot_count, uint32_t max_points) {
+#if defined(_WIN32)
+  return false;
+#else
+  close();
+  if (name.empty() || slot_count == 0 || max_points == 0) {
+    return false;
+  }
+
+  uint64_t slot_size = align64(align64(sizeof(ScanSlotHeader)) + 2 * max_points * sizeof(float));
+  size_t size = slotOffset(slot_count, slot_size);
+
+  // a ring left behind by a crashed writer is replaced, its readers have to re-attach
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  if (ftruncate(fd, size) != 0) {
+    ::close(fd);
+    shm_unlink(name.c_str());
+    return false;
+  }
+  void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  // the mapping is zero filled: write_index and every seq start at 0
+  m_header = static_cast<ScanBrokerHeader *>(addr);
+  m_header->slot_count = slot_count;
+  m_header->max_points = max_points;
+  m_header->slot_size = slot_size;
+  m_header->version = SCAN_BROKER_VERSION;
+  std::atomic_thread_fence(std::memory_order_release);
+  m_header->magic = SCAN_BROKER_MAGIC;
+  m_name = name;
+  m_size = size;
+  return true;
+#endif
+}
+
+void ScanBroker::close() {
+#if !defined(_WIN32)
+  if (m_header) {
+    munmap(m_header, m_size);
+    shm_unlink(m_name.c_str());
+    m_header = NULL;
+    m_size = 0;
+  }
+#endif
+}
+
+bool ScanBroker::publish(const LaserScan &scan) {
+  if (!m_header) {
+    return false;
+  }
+  uint64_t index = m_header->write_index.load(std::memory_order_relaxed);
+  ScanSlotHeader *slot = reinterpret_cast<ScanSlotHeader *>(
+                           reinterpret_cast<uint8_t *>(m_header) +
+                           slotOffset(index % m_header->slot_count, m_header->slot_size));
+
+  uint32_t count = scan.ranges.size() < m_header->max_points ?
+                   (uint32_t)scan.ranges.size() : m_header->max_points;
+  uint32_t seq = slot->seq.load(std::memory_order_relaxed);
+  slot->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->count = count;
+  slot->index = index;
+  slot->self_time_stamp = scan.self_time_stamp;
+  slot->system_time_stamp = scan.system_time_stamp;
+  slot->config = scan.config;
+  float *ranges = slotRanges(slot);
+  float *intensities = ranges + m_header->max_points;
+  if (count) {
+    memcpy(ranges, &scan.ranges[0], count * sizeof(float));
+  }
+  if (scan.intensities.size() >= count && count) {
+    memcpy(intensities, &scan.intensities[0], count * sizeof(float));
+  } else {
+    memset(intensities, 0, count * sizeof(float));
+  }
+
+  slot->seq.store(seq + 2, std::memory_order_release);
+  m_header->write_index.store(index + 1, std::memory_order_release);
+  return true;
+}
+
+/*-------------------------------------------------------------
+                        ScanBrokerClient
+-------------------------------------------------------------*/
+ScanBrokerClient::ScanBrokerClient() : m_header(NULL), m_size(0), m_next(0), m_dropped(0) {
+}
+
+ScanBrokerClient::~ScanBrokerClient() {
+  detach();
+}
+
+bool ScanBrokerClient::attach(const std::string &name) {
+#if defined(_WIN32)
+  return false;
+#else
+  detach();
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ScanBrokerHeader)) {
+    ::close(fd);
+    return false;
+  }
+  void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+  const ScanBrokerHeader *header = static_cast<const ScanBrokerHeader *>(addr);
+  if (header->magic != SCAN_BROKER_MAGIC || header->version != SCAN_BROKER_VERSION ||
+      slotOffset(header->slot_count, header->slot_size) > (size_t)st.st_size) {
+    munmap(addr, st.st_size);
+    return false;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  m_header = header;
+  m_size = st.st_size;
+  m_next = m_header->write_index.load(std::memory_order_acquire);
+  m_dropped = 0;
+  return true;
+#endif
+}
+
+void ScanBrokerClient::detach() {
+#if !defined(_WIN32)
+  if (m_header) {
+    munmap(const_cast<ScanBrokerHeader *>(m_header), m_size);
+    m_header = NULL;
+    m_size = 0;
+  }
+#endif
+}
+
+const ScanSlotHeader *ScanBrokerClient::slot(uint64_t index) const {
+  return reinterpret_cast<const ScanSlotHeader *>(
+           reinterpret_cast<const uint8_t *>(m_header) +
+           slotOffset(index % m_header->slot_count, m_header->slot_size));
+}
+
+result_t ScanBrokerClient::waitScan(ScanView &view, uint32_t timeout) {
+  if (!m_header) {
+    return RESULT_FAIL;
+  }
+  uint32_t startTs = getms();
+  for (;;) {
+    uint64_t written = m_header->write_index.load(std::memory_order_acquire);
+    if (written > m_next) {
+      // always hand out the newest scan, older ones are counted as dropped
+      uint64_t index = written - 1;
+      const ScanSlotHeader *s = slot(index);
+      uint32_t seq = s->seq.load(std::memory_order_acquire);
+      if ((seq & 1) == 0) {
+        view.count = s->count;
+        view.index = s->index;
+        view.self_time_stamp = s->self_time_stamp;
+        view.system_time_stamp = s->system_time_stamp;
+        view.config = s->config;
+        view.ranges = slotRanges(s);
+        view.intensities = view.ranges + m_header->max_points;
+        view.slot = s;
+        view.seq = seq;
+        if (validate(view) && view.index == index) {
+          m_dropped += index - m_next;
+          m_next = index + 1;
+          return RESULT_OK;
+        }
+      }
+      // overtaken by the writer, retry with the newest slot
+      continue;
+    }
+    if (getms() - startTs >= timeout) {
+      return RESULT_TIMEOUT;
+    }
+    delay(1);
+  }
+}
+
+bool ScanBrokerClient::validate(const ScanView &view) const {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return view.slot->seq.load(std::memory_order_relaxed) == view.seq;
+}
+
+result_t ScanBrokerClient::readScan(LaserScan &scan, uint32_t timeout) {
+  ScanView view;
+  result_t ans;
+  while ((ans = waitScan(view, timeout)) == RESULT_OK) {
+    scan.ranges.assign(view.ranges, view.ranges + view.count);
+    scan.intensities.assign(view.intensities, view.intensities + view.count);
+    scan.self_time_stamp = view.self_time_stamp;
+    scan.system_time_stamp = view.system_time_stamp;
+    scan.config = view.config;
+    if (validate(view)) {
+      return RESULT_OK;
+    }
+    // the copy raced with the writer, take the next one
+    m_next = view.index;
+  }
+  return ans;
+}
+
+}
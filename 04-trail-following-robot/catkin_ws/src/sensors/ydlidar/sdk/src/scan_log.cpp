@@ -0,0 +1,339 @@
+#include "scan_log.h"
+#include <string.h>
+#include <algorithm>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ydlidar
+{
+
+namespace
+{
+const char     SCAN_LOG_MAGIC[8]      = {'Y', 'D', 'S', 'C', 'N', 'L', 'O', 'G'};
+const uint32_t SCAN_LOG_VERSION       = 1;
+const uint32_t SCAN_LOG_BLOCK_MAGIC   = 0x31564552; // "REV1"
+const uint32_t SCAN_LOG_TRAILER_MAGIC = 0x58444e49; // "INDX"
+
+inline void putVarint(std::vector<uint8_t> &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+inline void putSigned(std::vector<uint8_t> &out, int64_t value) {
+  putVarint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+inline bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    uint8_t byte = *p++;
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline bool getSigned(const uint8_t *&p, const uint8_t *end, int64_t &value) {
+  uint64_t raw;
+  if (!getVarint(p, end, raw)) {
+    return false;
+  }
+  value = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+  return true;
+}
+
+bool stampLess(const ScanLogIndexEntry &entry, uint64_t stamp) {
+  return entry.stamp < stamp;
+}
+}
+
+/*-------------------------------------------------------------
+                        ScanLogWriter
+-------------------------------------------------------------*/
+ScanLogWriter::ScanLogWriter() : m_fp(NULL), m_offset(0), m_revolutions(0) {
+}
+
+ScanLogWriter::~ScanLogWriter() {
+  close();
+}
+
+bool ScanLogWriter::open(const std::string &path, const device_info *info) {
+  close();
+  m_fp = fopen(path.c_str(), "wb");
+  if (!m_fp) {
+    return false;
+  }
+  ScanLogFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SCAN_LOG_MAGIC, sizeof(header.magic));
+  header.version = SCAN_LOG_VERSION;
+  if (info) {
+    header.model = info->model;
+    memcpy(header.serialnum, info->serialnum, sizeof(header.serialnum));
+  }
+  if (fwrite(&header, sizeof(header), 1, m_fp) != 1) {
+    fclose(m_fp);
+    m_fp = NULL;
+    return false;
+  }
+  m_offset = sizeof(header);
+  m_revolutions = 0;
+  m_index.clear();
+  return true;
+}
+
+bool ScanLogWriter::write(const node_info *nodes, size_t count, uint16_t node_counts,
+                          bool multiple_rate, uint8_t sample_rate) {
+  if (!m_fp || count == 0) {
+    return false;
+  }
+
+  m_buffer.clear();
+  int64_t prev_angle = 0, prev_dangle = 0;
+  int64_t prev_distance = 0;
+  int64_t prev_stamp = nodes[0].stamp, prev_dstamp = 0;
+  for (size_t i = 0; i < count; i++) {
+    int64_t dangle = (int64_t)nodes[i].angle_q6_checkbit - prev_angle;
+    putSigned(m_buffer, dangle - prev_dangle);
+    prev_angle = nodes[i].angle_q6_checkbit;
+    prev_dangle = dangle;
+
+    putSigned(m_buffer, (int64_t)nodes[i].distance_q2 - prev_distance);
+    prev_distance = nodes[i].distance_q2;
+
+    int64_t dstamp = (int64_t)nodes[i].stamp - prev_stamp;
+    putSigned(m_buffer, dstamp - prev_dstamp);
+    prev_stamp = nodes[i].stamp;
+    prev_dstamp = dstamp;
+
+    m_buffer.push_back((uint8_t)(nodes[i].sync_quality >> LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT));
+  }
+
+  ScanLogRevolution rev;
+  memset(&rev, 0, sizeof(rev));
+  rev.magic = SCAN_LOG_BLOCK_MAGIC;
+  rev.payload_size = m_buffer.size();
+  rev.stamp = nodes[0].stamp;
+  rev.count = count;
+  rev.node_counts = node_counts;
+  rev.flags = multiple_rate ? SCAN_LOG_MULTIPLE_RATE : 0;
+  rev.scan_frequence = nodes[0].scan_frequence;
+  rev.sample_rate = sample_rate;
+
+  if (m_revolutions % INDEX_INTERVAL == 0) {
+    ScanLogIndexEntry entry;
+    entry.stamp = rev.stamp;
+    entry.offset = m_offset;
+    m_index.push_back(entry);
+  }
+  if (fwrite(&rev, sizeof(rev), 1, m_fp) != 1 ||
+      fwrite(&m_buffer[0], m_buffer.size(), 1, m_fp) != 1) {
+    return false;
+  }
+  m_offset += sizeof(rev) + m_buffer.size();
+  m_revolutions++;
+  return true;
+}
+
+bool ScanLogWriter::close() {
+  if (!m_fp) {
+    return false;
+  }
+  ScanLogTrailer trailer;
+  trailer.index_offset = m_offset;
+  trailer.index_count = m_index.size();
+  trailer.magic = SCAN_LOG_TRAILER_MAGIC;
+  bool ret = true;
+  if (!m_index.empty() &&
+      fwrite(&m_index[0], sizeof(ScanLogIndexEntry), m_index.size(), m_fp) != m_index.size()) {
+    ret = false;
+  }
+  if (ret && fwrite(&trailer, sizeof(trailer), 1, m_fp) != 1) {
+    ret = false;
+  }
+  if (fclose(m_fp) != 0) {
+    ret = false;
+  }
+  m_fp = NULL;
+  m_index.clear();
+  return ret;
+}
+
+/*-------------------------------------------------------------
+                        ScanLogReader
+-------------------------------------------------------------*/
+ScanLogReader::ScanLogReader() : m_data(NULL), m_size(0), m_pos(0), m_end(0) {
+}
+
+ScanLogReader::~ScanLogReader() {
+  close();
+}
+
+bool ScanLogReader::open(const std::string &path) {
+#if defined(_WIN32)
+  return false;
+#else
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ScanLogFileHeader)) {
+    ::close(fd);
+    return false;
+  }
+  void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+  m_data = static_cast<const uint8_t *>(addr);
+  m_size = st.st_size;
+  if (memcmp(header().magic, SCAN_LOG_MAGIC, sizeof(SCAN_LOG_MAGIC)) != 0 ||
+      header().version != SCAN_LOG_VERSION) {
+    close();
+    return false;
+  }
+  madvise(addr, m_size, MADV_SEQUENTIAL);
+
+  m_index.clear();
+  m_end = 0;
+  if (m_size >= sizeof(ScanLogFileHeader) + sizeof(ScanLogTrailer)) {
+    ScanLogTrailer trailer;
+    memcpy(&trailer, m_data + m_size - sizeof(trailer), sizeof(trailer));
+    if (trailer.magic == SCAN_LOG_TRAILER_MAGIC && trailer.index_offset >= sizeof(ScanLogFileHeader) &&
+        trailer.index_offset + (uint64_t)trailer.index_count * sizeof(ScanLogIndexEntry) + sizeof(trailer) == m_size) {
+      m_index.resize(trailer.index_count);
+      if (trailer.index_count) {
+        memcpy(&m_index[0], m_data + trailer.index_offset, trailer.index_count * sizeof(ScanLogIndexEntry));
+      }
+      m_end = trailer.index_offset;
+    }
+  }
+  if (!m_end) {
+    rebuildIndex();
+  }
+  rewind();
+  return true;
+#endif
+}
+
+void ScanLogReader::close() {
+#if !defined(_WIN32)
+  if (m_data) {
+    munmap(const_cast<uint8_t *>(m_data), m_size);
+  }
+#endif
+  m_data = NULL;
+  m_size = 0;
+  m_pos = m_end = 0;
+  m_index.clear();
+}
+
+const ScanLogRevolution *ScanLogReader::block(size_t offset) const {
+  if (offset + sizeof(ScanLogRevolution) > m_end) {
+    return NULL;
+  }
+  const ScanLogRevolution *rev = reinterpret_cast<const ScanLogRevolution *>(m_data + offset);
+  if (rev->magic != SCAN_LOG_BLOCK_MAGIC ||
+      offset + sizeof(ScanLogRevolution) + rev->payload_size > m_end) {
+    return NULL;
+  }
+  return rev;
+}
+
+void ScanLogReader::rebuildIndex() {
+  // no trailer: walk the block headers, the last incomplete block is dropped
+  m_end = m_size;
+  size_t offset = sizeof(ScanLogFileHeader);
+  size_t revolutions = 0;
+  const ScanLogRevolution *rev;
+  while ((rev = block(offset)) != NULL) {
+    if (revolutions % ScanLogWriter::INDEX_INTERVAL == 0) {
+      ScanLogIndexEntry entry;
+      entry.stamp = rev->stamp;
+      entry.offset = offset;
+      m_index.push_back(entry);
+    }
+    offset += sizeof(ScanLogRevolution) + rev->payload_size;
+    revolutions++;
+  }
+  m_end = offset;
+}
+
+uint64_t ScanLogReader::startStamp() const {
+  return m_index.empty() ? 0 : m_index[0].stamp;
+}
+
+void ScanLogReader::rewind() {
+  m_pos = sizeof(ScanLogFileHeader);
+}
+
+bool ScanLogReader::seek(uint64_t stamp) {
+  if (!m_data) {
+    return false;
+  }
+  std::vector<ScanLogIndexEntry>::const_iterator it =
+    std::lower_bound(m_index.begin(), m_index.end(), stamp, stampLess);
+  if (it != m_index.begin()) {
+    --it;
+  }
+  m_pos = it == m_index.end() ? sizeof(ScanLogFileHeader) : it->offset;
+
+  // at most INDEX_INTERVAL block headers to skip, no decoding
+  const ScanLogRevolution *rev;
+  while ((rev = block(m_pos)) != NULL && rev->stamp < stamp) {
+    m_pos += sizeof(ScanLogRevolution) + rev->payload_size;
+  }
+  return rev != NULL;
+}
+
+bool ScanLogReader::next(ScanLogRevolution &rev, node_info *nodes, size_t &count) {
+  const ScanLogRevolution *b = block(m_pos);
+  if (!b || b->count > count) {
+    count = 0;
+    return false;
+  }
+  memcpy(&rev, b, sizeof(rev));
+
+  const uint8_t *p = m_data + m_pos + sizeof(ScanLogRevolution);
+  const uint8_t *end = p + rev.payload_size;
+  int64_t angle = 0, dangle = 0;
+  int64_t distance = 0;
+  int64_t stamp = rev.stamp, dstamp = 0;
+  for (uint32_t i = 0; i < rev.count; i++) {
+    int64_t ddangle, ddistance, ddstamp;
+    if (!getSigned(p, end, ddangle) || !getSigned(p, end, ddistance) ||
+        !getSigned(p, end, ddstamp) || p >= end) {
+      count = 0;
+      return false;
+    }
+    dangle += ddangle;
+    angle += dangle;
+    distance += ddistance;
+    dstamp += ddstamp;
+    stamp += dstamp;
+
+    nodes[i].sync_flag = i == 0 ? LIDAR_RESP_MEASUREMENT_SYNCBIT : 0;
+    nodes[i].angle_q6_checkbit = (uint16_t)angle;
+    nodes[i].distance_q2 = (uint16_t)distance;
+    nodes[i].stamp = (uint64_t)stamp;
+    nodes[i].sync_quality = (uint16_t)(*p++) << LIDAR_RESP_MEASUREMENT_QUALITY_SHIFT;
+    nodes[i].scan_frequence = rev.scan_frequence;
+  }
+  count = rev.count;
+  m_pos += sizeof(ScanLogRevolution) + rev.payload_size;
+  return true;
+}
+
+}
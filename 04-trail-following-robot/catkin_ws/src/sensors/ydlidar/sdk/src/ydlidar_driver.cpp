@@ -23,12 +23,17 @@ namespace ydlidar{
         isAutoconnting = false;
 		isMultipleRate = false;
 		scan_node_count = 0;
+		m_standby = false;
 
         m_baudrate = 115200;
 		isSupportMotorCtrl=true;
         m_sampling_rate=-1;
 		model = -1;
         scan_frequence = 0;
+        m_ns = 0;
+        m_last_ns = 0;
+        m_pointTime = 1e9/4000;
+        trans_delay = 0;
 
         //解析参数
         PackageSampleBytes = 2;
@@ -360,11 +365,32 @@ namespace ydlidar{
 		node_info      local_scan[MAX_SCAN_NODES];
 		size_t         scan_count = 0;
 		result_t            ans;
+		uint64_t       decode_start = Tracer::now();
 		memset(local_scan, 0, sizeof(local_scan));
 		waitScanData(local_buf, count);
 
         int timeout_count = 0;
 		while(isScanning) {
+			if (m_standby) {
+				//待机: 电机保持转动, 直接丢弃串口数据
+				scan_count = 0;
+				package_Sample_Index = 0;
+				local_scan[0].sync_flag = 0;
+				{
+					ScopedLocker l(_lock);
+					scan_node_count = 0;
+				}
+				{
+					ScopedLocker lk(_serial_lock);
+					if (_serial) {
+						_serial->flushInput();
+					}
+				}
+				delay(10);
+				timeout_count = 0;
+				decode_start = Tracer::now();
+				continue;
+			}
 			if ((ans=waitScanData(local_buf, count)) != RESULT_OK) {
                 if (!IS_TIMEOUT(ans) || timeout_count > DEFAULT_TIMEOUT_COUNT ) {
                     if(!isAutoReconnect) {//不重新连接, 退出线程
@@ -400,8 +426,10 @@ namespace ydlidar{
 						scan_node_count = scan_count;
 						_dataEvent.set();
 						_lock.unlock();
+						Tracer::instance().complete(TRACE_DRIVER, "decode", decode_start, scan_count);
 					}
 					scan_count = 0;
+					decode_start = Tracer::now();
 				}
 				local_scan[scan_count++] = local_buf[pos];
 				if (scan_count == _countof(local_scan)){
@@ -936,6 +964,22 @@ namespace ydlidar{
 		return isMultipleRate;
 	}
 
+	void YDlidarDriver::setCachedSamplingRate(int rate) {
+		m_sampling_rate = rate;
+	}
+
+	int YDlidarDriver::getCachedSamplingRate() const {
+		return m_sampling_rate;
+	}
+
+	void YDlidarDriver::setStandby(bool enable) {
+		m_standby = enable;
+	}
+
+	bool YDlidarDriver::isStandby() const {
+		return m_standby;
+	}
+
 	/************************************************************************/
 	/* check one byte transform time                                        */
 	/************************************************************************/
@@ -1028,7 +1072,6 @@ namespace ydlidar{
 	/*  start to scan                                                       */
 	/************************************************************************/
 	result_t YDlidarDriver::startScan(bool force, uint32_t timeout ) {
-		result_t ans;
 		if (!isConnected) {
 			return RESULT_FAIL;
 		}
@@ -1038,8 +1081,21 @@ namespace ydlidar{
 
 		stop();   
 		startMotor();
+		return restartScan(force, timeout);
+	}
+
+	/************************************************************************/
+	/*  start to scan with the motor already spinning                       */
+	/************************************************************************/
+	result_t YDlidarDriver::restartScan(bool force, uint32_t timeout) {
+		result_t ans;
+		if (!isConnected) {
+			return RESULT_FAIL;
+		}
+		if (isScanning) {
+			return RESULT_OK;
+		}
 		checkTransTime();
-        
 
 		{
 			ScopedLocker l(_lock);
@@ -1120,15 +1176,27 @@ namespace ydlidar{
             disableDataGrabbing();
             return RESULT_OK;
         }
+		stopScan();
+		stopMotor();
+		
+		return RESULT_OK;
+	}
+
+	/************************************************************************/
+	/*   stop scan, the motor keeps spinning                                */
+	/************************************************************************/
+	result_t YDlidarDriver::stopScan() {
 		disableDataGrabbing();
 		{
 			ScopedLocker l(_lock);
             sendCommand(LIDAR_CMD_FORCE_STOP);
 			sendCommand(LIDAR_CMD_STOP);
 		}
-
-		stopMotor();
-		
+		// scan data still in flight must not precede the next command answers
+		delay(10);
+		if (isConnected && _serial) {
+			_serial->flushInput();
+		}
 		return RESULT_OK;
 	}
 
@@ -1855,4 +1923,87 @@ namespace ydlidar{
 
        }
 
+	/************************************************************************/
+	/*  queue a configuration command for the next pipelined exchange       */
+	/************************************************************************/
+	void YDlidarDriver::queueCommand(uint8_t cmd, void * response, size_t size, result_t * result, uint32_t timeout) {
+		PendingCommand pending;
+		pending.cmd = cmd;
+		pending.response = reinterpret_cast<uint8_t *>(response);
+		pending.size = size;
+		pending.timeout = timeout;
+		pending.result = result;
+		ScopedLocker l(_cmd_lock);
+		m_pendingCommands.push_back(pending);
+	}
+
+	/************************************************************************/
+	/*  send all queued commands at once and read the responses in order    */
+	/************************************************************************/
+	result_t YDlidarDriver::flushCommands() {
+		std::vector<PendingCommand> pending;
+		{
+			ScopedLocker l(_cmd_lock);
+			pending.swap(m_pendingCommands);
+		}
+		if (pending.empty()) {
+			return RESULT_OK;
+		}
+		if (!isConnected) {
+			for (size_t i = 0; i < pending.size(); i++) {
+				if (pending[i].result) {
+					*pending[i].result = RESULT_FAIL;
+				}
+			}
+			return RESULT_FAIL;
+		}
+
+		disableDataGrabbing();
+		ScopedLocker l(_lock);
+		std::vector<uint8_t> packet;
+		packet.reserve(pending.size()*2);
+		for (size_t i = 0; i < pending.size(); i++) {
+			packet.push_back(LIDAR_CMD_SYNC_BYTE);
+			packet.push_back(pending[i].cmd);
+		}
+		if (sendData(&packet[0], packet.size()) != RESULT_OK) {
+			for (size_t i = 0; i < pending.size(); i++) {
+				if (pending[i].result) {
+					*pending[i].result = RESULT_FAIL;
+				}
+			}
+			return RESULT_FAIL;
+		}
+
+		result_t ans = RESULT_OK;
+		for (size_t i = 0; i < pending.size(); i++) {
+			PendingCommand &cmd = pending[i];
+			lidar_ans_header response_header;
+			result_t r = waitResponseHeader(&response_header, cmd.timeout);
+			if (r == RESULT_OK) {
+				if (waitForData(response_header.size, cmd.timeout) != RESULT_OK) {
+					r = RESULT_FAIL;
+				} else if (response_header.type != LIDAR_ANS_TYPE_DEVINFO ||
+						response_header.size != cmd.size) {
+					// consume the unexpected payload so the next response stays aligned
+					uint8_t skip[256];
+					getData(skip, response_header.size < sizeof(skip) ? response_header.size : sizeof(skip));
+					r = RESULT_FAIL;
+				} else {
+					r = getData(cmd.response, cmd.size);
+				}
+			}
+			if (r == RESULT_OK && (cmd.cmd == LIDAR_CMD_GET_SAMPLING_RATE || cmd.cmd == LIDAR_CMD_SET_SAMPLING_RATE)) {
+				m_sampling_rate = cmd.response[0];
+			}
+			if (r != RESULT_OK) {
+				ans = r;
+			}
+			if (cmd.result) {
+				*cmd.result = r;
+			}
+		}
+		return ans;
+	}
+
 }
@@ -0,0 +1,370 @@
+/*
+ *  YDLIDAR SYSTEM
+ *  YDLIDAR ROS Nodelet
+ *
+ *  Copyright 2015 - 2018 EAI TEAM
+ *  http://www.ydlidar.com
+ *
+ */
+
+#include <ros/ros.h>
+#include <nodelet/nodelet.h>
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <std_srvs/SetBool.h>
+#include <dynamic_reconfigure/server.h>
+#include <ydlidar/YDLidarConfig.h>
+#include <boost/thread/thread.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include "CYdLidar.h"
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cstddef>
+
+using namespace ydlidar;
+
+#define ROSVerision "1.3.9"
+
+namespace ydlidar_ros {
+
+std::vector<float> split(const std::string &s, char delim) {
+    std::vector<float> elems;
+    std::stringstream ss(s);
+    std::string number;
+    while(std::getline(ss, number, delim)) {
+        elems.push_back(atof(number.c_str()));
+    }
+    return elems;
+}
+
+void addPointField(sensor_msgs::PointCloud2 &cloud, const std::string &name, uint32_t offset) {
+    sensor_msgs::PointField field;
+    field.name = name;
+    field.offset = offset;
+    field.datatype = sensor_msgs::PointField::FLOAT32;
+    field.count = 1;
+    cloud.fields.push_back(field);
+}
+
+/** Packs the SDK's cartesian output into a PointCloud2 in a single pass, one point per range */
+void fillPointCloud(const LaserScan &scan, sensor_msgs::PointCloud2 &cloud) {
+    struct CloudPoint {
+        float x, y, z, intensity, time;
+    };
+    if (cloud.fields.empty()) {
+        addPointField(cloud, "x", offsetof(CloudPoint, x));
+        addPointField(cloud, "y", offsetof(CloudPoint, y));
+        addPointField(cloud, "z", offsetof(CloudPoint, z));
+        addPointField(cloud, "intensity", offsetof(CloudPoint, intensity));
+        addPointField(cloud, "time", offsetof(CloudPoint, time));
+        cloud.point_step = sizeof(CloudPoint);
+        cloud.is_bigendian = false;
+        cloud.is_dense = false;
+        cloud.height = 1;
+    }
+    const size_t counts = scan.x.size();
+    cloud.width = counts;
+    cloud.row_step = counts * cloud.point_step;
+    cloud.data.resize(cloud.row_step);
+    CloudPoint *points = reinterpret_cast<CloudPoint *>(cloud.data.data());
+    for (size_t i = 0; i < counts; i++) {
+        points[i].x = scan.x[i];
+        points[i].y = scan.y[i];
+        points[i].z = 0.f;
+        points[i].intensity = scan.intensities[i];
+        points[i].time = scan.point_time[i];
+    }
+}
+
+/**
+ * Runs the lidar driver inside a nodelet manager. Scans are published as
+ * shared pointers, so nodelets in the same manager (e.g. obstacle detection)
+ * receive them without serialization.
+ */
+class YDLidarNodelet: public nodelet::Nodelet {
+protected:
+boost::shared_ptr<ros::NodeHandle> nh, pnh;
+ros::Publisher scan_pub;
+ros::Publisher cloud_pub;
+ros::ServiceServer standby_srv;
+boost::shared_ptr<dynamic_reconfigure::Server<YDLidarConfig> > dyn_srv;
+boost::mutex config_mutex;
+YDLidarConfig pending_config;
+bool config_pending;
+CYdLidar laser;
+std::string frame_id;
+bool publish_cloud;
+std::string replay_file;
+bool auto_standby;
+volatile bool standby_requested;
+volatile bool driver_thread_running;
+boost::thread driver_thread;
+
+bool standbyCallback(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res) {
+    standby_requested = req.data;
+    res.success = true;
+    res.message = req.data ? "standby" : "scanning";
+    return true;
+}
+
+/** Standby on request, or while nobody listens if auto_standby is set */
+bool wantStandby() {
+    if (standby_requested) {
+        return true;
+    }
+    return auto_standby && scan_pub.getNumSubscribers() == 0 &&
+           (!publish_cloud || cloud_pub.getNumSubscribers() == 0);
+}
+
+virtual void configCallback(YDLidarConfig &config, uint32_t level) {
+    NODELET_DEBUG("configCallback");
+    if (config.angle_max < config.angle_min) {
+        std::swap(config.angle_min, config.angle_max);
+    }
+    // applied by the driver thread between two scans, the SDK is not thread safe
+    boost::mutex::scoped_lock lock(config_mutex);
+    pending_config = config;
+    config_pending = true;
+}
+
+/** Reapplies only what changed: crop settings are plain properties, frequency and
+ *  sampling rate go to the device */
+void applyConfig() {
+    YDLidarConfig config;
+    {
+        boost::mutex::scoped_lock lock(config_mutex);
+        if (!config_pending) {
+            return;
+        }
+        config = pending_config;
+        config_pending = false;
+    }
+
+    std::vector<float> ignore_array = split(config.ignore_array, ',');
+    if (ignore_array.size()%2) {
+        NODELET_ERROR_STREAM("ignore array is odd need be even");
+        ignore_array.pop_back();
+    }
+    laser.setMinAngle(config.angle_min);
+    laser.setMaxAngle(config.angle_max);
+    laser.setMinRange(config.range_min);
+    laser.setMaxRange(config.range_max);
+    laser.setIgnoreArray(ignore_array);
+
+    int frequency = (int)config.frequency;
+    if (frequency != laser.getScanFrequency()) {
+        NODELET_INFO_STREAM("Setting scan frequency to: " << frequency << "Hz");
+    }
+    if (!laser.reconfigureScan(frequency, config.samp_rate)) {
+        NODELET_ERROR_STREAM("failed to apply scan frequency " << frequency << "Hz, sampling rate " << config.samp_rate << "K");
+    }
+}
+
+virtual void driverLoop() {
+    sensor_msgs::PointCloud2 cloud_msg;
+    // pause after a failed revolution, doubled up to 1 s while the lidar stays unavailable
+    int retry_ms = 0;
+    while (driver_thread_running && ros::ok()) {
+        applyConfig();
+        // the motor keeps spinning in standby, resuming needs no command round trip
+        bool standby = wantStandby();
+        if (standby != laser.isStandby()) {
+            if (standby) {
+                laser.standby();
+            } else {
+                laser.resume();
+            }
+            NODELET_INFO_STREAM("lidar " << (laser.isStandby() ? "in standby" : "scanning"));
+        }
+        if (laser.isStandby()) {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+            continue;
+        }
+        bool hardError;
+        LaserScan scan;//原始激光数据
+        // doProcessSimple blocks until the next revolution, no extra rate limiting needed
+        // while it succeeds; an unplugged lidar fails straight away
+        if(laser.doProcessSimple(scan, hardError )){
+            retry_ms = 0;
+            YDLIDAR_TRACE_SCOPE(TRACE_NODE, "publish");
+            sensor_msgs::LaserScanPtr scan_msg = boost::make_shared<sensor_msgs::LaserScan>();
+            ros::Time start_scan_time;
+            start_scan_time.sec = scan.system_time_stamp/1000000000ul;
+            start_scan_time.nsec = scan.system_time_stamp%1000000000ul;
+            // replayed scans are restamped, downstream tf lookups need the current time
+            scan_msg->header.stamp = replay_file.empty() ? start_scan_time : ros::Time::now();
+            scan_msg->header.frame_id = frame_id;
+            scan_msg->angle_min = scan.config.min_angle;
+            scan_msg->angle_max = scan.config.max_angle;
+            scan_msg->angle_increment = scan.config.ang_increment;
+            scan_msg->scan_time = scan.config.scan_time;
+            scan_msg->time_increment = scan.config.time_increment;
+            scan_msg->range_min = scan.config.min_range;
+            scan_msg->range_max = scan.config.max_range;
+
+            if(publish_cloud && cloud_pub.getNumSubscribers() > 0){
+                cloud_msg.header = scan_msg->header;
+                fillPointCloud(scan, cloud_msg);
+                cloud_pub.publish(cloud_msg);
+            }
+
+            scan_msg->ranges.swap(scan.ranges);
+            scan_msg->intensities.swap(scan.intensities);
+            // the message must not be modified after publishing, intra-process subscribers share it
+            scan_pub.publish(scan_msg);
+        } else if (laser.replayFinished()) {
+            NODELET_INFO_STREAM("replay of " << replay_file << " finished");
+            break;
+        } else if (replay_file.empty()) {
+            retry_ms = retry_ms == 0 ? 10 : std::min(retry_ms * 2, 1000);
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(retry_ms));
+        }
+    }
+}
+
+virtual void onInit() {
+    nh.reset(new ros::NodeHandle(getNodeHandle()));
+    pnh.reset(new ros::NodeHandle(getPrivateNodeHandle()));
+
+    printf("__   ______  _     ___ ____    _    ____  \n");
+    printf("\\ \\ / /  _ \\| |   |_ _|  _ \\  / \\  |  _ \\ \n");
+    printf(" \\ V /| | | | |    | || | | |/ _ \\ | |_) | \n");
+    printf("  | | | |_| | |___ | || |_| / ___ \\|  _ <  \n");
+    printf("  |_| |____/|_____|___|____/_/   \\_\\_| \\_\\ \n");
+    printf("\n");
+    fflush(stdout);
+
+    std::string port;
+    int baudrate=115200;
+    bool intensities,low_exposure,reversion, resolution_fixed;
+    bool auto_reconnect;
+    double angle_max,angle_min;
+    int samp_rate;
+    std::string list;
+    std::vector<float> ignore_array;
+    double max_range, min_range;
+    double _frequency;
+    int trace_mask;
+    std::string trace_file;
+    std::string cache_file;
+    std::string broker_name;
+    std::string record_file;
+    double replay_speed;
+
+    pnh->param<bool>("publish_cloud", publish_cloud, false);
+    pnh->param<bool>("auto_standby", auto_standby, false);
+    pnh->param<std::string>("port", port, "/dev/ydlidar");
+    pnh->param<int>("baudrate", baudrate, 115200);
+    pnh->param<std::string>("frame_id", frame_id, "laser_frame");
+    pnh->param<bool>("resolution_fixed", resolution_fixed, "true");
+    pnh->param<bool>("intensity", intensities, "false");
+    pnh->param<bool>("low_exposure", low_exposure, "false");
+    pnh->param<bool>("auto_reconnect", auto_reconnect, "true");
+    pnh->param<bool>("reversion", reversion, "false");
+    pnh->param<double>("angle_max", angle_max , 180);
+    pnh->param<double>("angle_min", angle_min , -180);
+    pnh->param<int>("samp_rate", samp_rate, 9);
+    pnh->param<double>("range_max", max_range , 16.0);
+    pnh->param<double>("range_min", min_range , 0.08);
+    pnh->param<double>("frequency", _frequency , 7.0);
+    pnh->param<std::string>("ignore_array",list,"");
+    pnh->param<int>("trace_mask", trace_mask, 0);
+    pnh->param<std::string>("trace_file", trace_file, "");
+    pnh->param<std::string>("cache_file", cache_file, "");
+    pnh->param<std::string>("broker_name", broker_name, "");
+    pnh->param<std::string>("record_file", record_file, "");
+    pnh->param<std::string>("replay_file", replay_file, "");
+    pnh->param<double>("replay_speed", replay_speed, 1.0);
+
+    if(trace_mask != 0 && !Tracer::instance().enable(trace_mask, trace_file.c_str())){
+        NODELET_ERROR_STREAM("cannot open trace file " << trace_file);
+    }
+
+    // a short queue is enough: intra-process subscribers get the pointer, remote ones want the latest scan
+    scan_pub = nh->advertise<sensor_msgs::LaserScan>("scan", 10);
+    if(publish_cloud){
+        cloud_pub = nh->advertise<sensor_msgs::PointCloud2>("scan_cloud", 10);
+    }
+
+    ignore_array = split(list ,',');
+    if(ignore_array.size()%2){
+        NODELET_ERROR_STREAM("ignore array is odd need be even");
+    }
+
+    for(uint16_t i =0 ; i < ignore_array.size();i++){
+        if(ignore_array[i] < -180 && ignore_array[i] > 180){
+            NODELET_ERROR_STREAM("ignore array should be between -180 and 180");
+        }
+    }
+
+    if(_frequency<5){
+       _frequency = 7.0;
+    }
+    if(_frequency>12){
+        _frequency = 12;
+    }
+    if(angle_max < angle_min){
+        double temp = angle_max;
+        angle_max = angle_min;
+        angle_min = temp;
+    }
+
+    laser.setSerialPort(port);
+    laser.setSerialBaudrate(baudrate);
+    laser.setIntensities(intensities);
+    laser.setMaxRange(max_range);
+    laser.setMinRange(min_range);
+    laser.setMaxAngle(angle_max);
+    laser.setMinAngle(angle_min);
+    laser.setReversion(reversion);
+    laser.setFixedResolution(resolution_fixed);
+    laser.setAutoReconnect(auto_reconnect);
+    laser.setExposure(low_exposure);
+    laser.setScanFrequency(_frequency);
+    laser.setSampleRate(samp_rate);
+    laser.setIgnoreArray(ignore_array);
+    laser.setCartesianOutput(publish_cloud);
+    laser.setCacheFile(cache_file);
+    laser.setBrokerName(broker_name);
+    laser.setRecordFile(record_file);
+    laser.setReplayFile(replay_file);
+    laser.setReplaySpeed(replay_speed);
+    laser.initialize();
+
+    standby_srv = pnh->advertiseService("standby", &YDLidarNodelet::standbyCallback, this);
+
+    // starts from the params above (as clamped), later changes are applied by the driver thread
+    pnh->setParam("frequency", _frequency);
+    pnh->setParam("angle_min", angle_min);
+    pnh->setParam("angle_max", angle_max);
+    dyn_srv = boost::make_shared<dynamic_reconfigure::Server<YDLidarConfig> >(*pnh);
+    dynamic_reconfigure::Server<YDLidarConfig>::CallbackType f =
+        boost::bind(&YDLidarNodelet::configCallback, this, _1, _2);
+    dyn_srv->setCallback(f);
+
+    driver_thread_running = true;
+    driver_thread = boost::thread(boost::bind(&YDLidarNodelet::driverLoop, this));
+}
+
+public:
+YDLidarNodelet() : config_pending(false), publish_cloud(false), auto_standby(false),
+    standby_requested(false), driver_thread_running(false) {}
+
+virtual ~YDLidarNodelet() {
+    if (driver_thread_running) {
+        driver_thread_running = false;
+        driver_thread.join();
+    }
+    laser.turnOff();
+    printf("[YDLIDAR INFO] Now YDLIDAR is stopping .......\n");
+    laser.disconnecting();
+}
+};
+} // namespace
+
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(ydlidar_ros::YDLidarNodelet, nodelet::Nodelet)